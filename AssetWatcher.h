@@ -0,0 +1,353 @@
+#ifndef ASSET_WATCHER_H
+#define ASSET_WATCHER_H
+
+#include <glad/glad.h>
+
+#include "ObjLoader.h"
+#include "Profiler.h"
+#include "stb_image.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//byte range of a GPU buffer that has to be re-uploaded
+struct BufferSpan {
+	size_t offset;
+	size_t size;
+};
+
+enum class AssetKind { Mesh, Texture };
+
+//result of re-importing one changed file, produced on the watcher thread
+struct AssetUpdate {
+	AssetKind kind;
+	std::string path;
+
+	//meshes: the new data plus what changed relative to the resident buffers.
+	//a resize flag means the buffer outgrew its storage and needs a full glBufferData
+	ObjMesh mesh;
+	std::vector<BufferSpan> vertexSpans;
+	std::vector<BufferSpan> indexSpans;
+	bool vertexResize = false;
+	bool indexResize = false;
+
+	//textures: decoded pixels, the GL object is created on the render thread
+	std::vector<unsigned char> pixels;
+	int width = 0;
+	int height = 0;
+	int components = 0;
+};
+
+//Watches asset files with inotify and re-imports the ones that change on a worker
+//thread. Meshes are diffed against a copy of what is resident on the GPU, so the
+//render thread only uploads changed ranges. A changed MTL library re-imports the mesh
+//that names it. Nothing touches GL off the render thread: finished work waits in a
+//queue until TakeUpdates() is called between frames.
+class AssetWatcher
+{
+public:
+	AssetWatcher() : running(false), inotifyFd(-1) {}
+	~AssetWatcher() { Stop(); }
+
+	//register meshes before Start(). resident is the mesh data currently in the GPU buffers
+	void WatchMesh(const std::string& path, const ObjMesh& resident)
+	{
+		std::lock_guard<std::mutex> lock(watchMutex);
+		Entry& entry = entries[path];
+		entry.kind = AssetKind::Mesh;
+		entry.vertices.assign((const unsigned char*)resident.vertices.data(), (const unsigned char*)(resident.vertices.data() + resident.vertices.size()));
+		entry.indices.assign((const unsigned char*)resident.indices.data(), (const unsigned char*)(resident.indices.data() + resident.indices.size()));
+		entry.vertexCapacity = entry.vertices.size();
+		entry.indexCapacity = entry.indices.size();
+		addWatch(path);
+	}
+
+	//textures and libraries can be added while running, e.g. the ones a reload brought in.
+	//watching a path twice is harmless
+	void WatchTexture(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(watchMutex);
+		entries[path].kind = AssetKind::Texture;
+		addWatch(path);
+	}
+
+	//an MTL file of meshPath, which has to be watched as a mesh
+	void WatchLibrary(const std::string& path, const std::string& meshPath)
+	{
+		std::lock_guard<std::mutex> lock(watchMutex);
+		entries[path].library = meshPath;
+		addWatch(path);
+	}
+
+	bool Start()
+	{
+#ifndef _WIN32
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFd < 0)
+		{
+			std::cout << "ERROR::WATCHER::INOTIFY_INIT_FAILED: " << strerror(errno) << std::endl;
+			return false;
+		}
+		{
+			std::lock_guard<std::mutex> lock(watchMutex);
+			for (const std::pair<const std::string, Entry>& entry : entries)
+				addWatch(entry.first);
+		}
+		running = true;
+		worker = std::thread(&AssetWatcher::run, this);
+		return true;
+#else
+		std::cout << "ERROR::WATCHER::INOTIFY_NOT_AVAILABLE_ON_THIS_PLATFORM" << std::endl;
+		return false;
+#endif
+	}
+
+	void Stop()
+	{
+		if (!running)
+			return;
+		running = false;
+		worker.join();
+#ifndef _WIN32
+		close(inotifyFd);
+#endif
+		inotifyFd = -1;
+	}
+
+	//finished re-imports, oldest first. call on the GL thread between frames
+	std::vector<AssetUpdate> TakeUpdates()
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		std::vector<AssetUpdate> updates;
+		updates.swap(pending);
+		return updates;
+	}
+
+	//byte spans where incoming differs from resident, compared one element (stride bytes) at a
+	//time. spans separated by fewer than mergeGap equal elements are merged, trading a few
+	//redundant bytes for fewer glBufferSubData calls. growth past resident is one trailing span
+	static std::vector<BufferSpan> DiffSpans(const unsigned char* resident, size_t residentSize, const unsigned char* incoming, size_t incomingSize, size_t stride, size_t mergeGap = 64)
+	{
+		std::vector<BufferSpan> spans;
+		size_t common = std::min(residentSize, incomingSize) / stride * stride;
+		size_t gapBytes = mergeGap * stride;
+		for (size_t offset = 0; offset < common; offset += stride)
+		{
+			if (memcmp(resident + offset, incoming + offset, stride) == 0)
+				continue;
+			if (!spans.empty() && offset - (spans.back().offset + spans.back().size) <= gapBytes)
+				spans.back().size = offset + stride - spans.back().offset;
+			else
+				spans.push_back({ offset, stride });
+		}
+		if (incomingSize > common)
+		{
+			if (!spans.empty() && common - (spans.back().offset + spans.back().size) <= gapBytes)
+				spans.back().size = incomingSize - spans.back().offset;
+			else
+				spans.push_back({ common, incomingSize - common });
+		}
+		return spans;
+	}
+
+	//uploads the spans of data into buffer (bound to target), returns the bytes sent
+	static size_t UploadSpans(GLenum target, unsigned int buffer, const void* data, const std::vector<BufferSpan>& spans)
+	{
+		size_t bytes = 0;
+		glBindBuffer(target, buffer);
+		for (const BufferSpan& span : spans)
+		{
+			glBufferSubData(target, (GLintptr)span.offset, (GLsizeiptr)span.size, (const unsigned char*)data + span.offset);
+			bytes += span.size;
+		}
+		return bytes;
+	}
+
+	//builds a complete texture object from a decoded update, so the caller can swap ids in one step
+	static unsigned int CreateTexture(const AssetUpdate& update)
+	{
+		GLenum format = update.components == 1 ? GL_RED : update.components == 3 ? GL_RGB : GL_RGBA;
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, update.width, update.height, 0, format, GL_UNSIGNED_BYTE, update.pixels.data());
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return textureID;
+	}
+
+private:
+	//what the GPU currently holds for a watched mesh, only touched by the worker after Start()
+	struct Entry {
+		AssetKind kind = AssetKind::Texture;
+		//MTL libraries: the mesh to re-import when the file changes
+		std::string library;
+		std::vector<unsigned char> vertices;
+		std::vector<unsigned char> indices;
+		size_t vertexCapacity = 0;
+		size_t indexCapacity = 0;
+	};
+
+	//guards the three maps below, which the render thread can add to while the worker runs.
+	//entries are never removed, so references into it stay valid without the lock
+	std::mutex watchMutex;
+	std::map<std::string, Entry> entries;
+	std::map<std::string, int> directoryWatches;
+	std::map<std::pair<int, std::string>, std::string> watchedNames;
+
+	std::atomic<bool> running;
+	std::thread worker;
+	int inotifyFd;
+
+	std::mutex queueMutex;
+	std::vector<AssetUpdate> pending;
+
+	//watches path's directory rather than the file: exporters and editors usually write a
+	//temporary file and rename it over the old one, which drops a per-file watch. does
+	//nothing before Start(), which adds every registered path. watchMutex must be held
+	void addWatch(const std::string& path)
+	{
+#ifndef _WIN32
+		if (inotifyFd < 0)
+			return;
+		std::pair<std::string, std::string> split = splitPath(path);
+		int wd = -1;
+		std::map<std::string, int>::iterator itr = directoryWatches.find(split.first);
+		if (itr != directoryWatches.end())
+			wd = itr->second;
+		else
+		{
+			wd = inotify_add_watch(inotifyFd, split.first.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (wd < 0)
+			{
+				std::cout << "ERROR::WATCHER::UNABLE_TO_WATCH: " << split.first << " (" << strerror(errno) << ")" << std::endl;
+				return;
+			}
+			directoryWatches[split.first] = wd;
+		}
+		watchedNames[std::make_pair(wd, split.second)] = path;
+#endif
+	}
+
+	static std::pair<std::string, std::string> splitPath(const std::string& path)
+	{
+		size_t split = path.find_last_of("/\\");
+		if (split == std::string::npos)
+			return std::make_pair(std::string("."), path);
+		return std::make_pair(path.substr(0, split), path.substr(split + 1));
+	}
+
+	void run()
+	{
+#ifndef _WIN32
+		//one save often arrives as several events, collect them until the directory is
+		//quiet for a moment and re-import each changed file once
+		const std::chrono::milliseconds settle(100);
+		std::set<std::string> changed;
+		std::chrono::steady_clock::time_point lastEvent;
+		alignas(struct inotify_event) char buffer[4096];
+		while (running)
+		{
+			pollfd descriptor = { inotifyFd, POLLIN, 0 };
+			if (poll(&descriptor, 1, 50) > 0)
+			{
+				ssize_t length;
+				while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+				{
+					for (char* p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+					{
+						const struct inotify_event* event = (const struct inotify_event*)p;
+						if (event->len == 0)
+							continue;
+						std::lock_guard<std::mutex> lock(watchMutex);
+						std::map<std::pair<int, std::string>, std::string>::iterator itr = watchedNames.find(std::make_pair(event->wd, std::string(event->name)));
+						if (itr == watchedNames.end())
+							continue;
+						const std::string& library = entries[itr->second].library;
+						changed.insert(library.empty() ? itr->second : library);
+						lastEvent = std::chrono::steady_clock::now();
+					}
+				}
+			}
+			if (changed.empty() || std::chrono::steady_clock::now() - lastEvent < settle)
+				continue;
+			for (const std::string& path : changed)
+				reimport(path);
+			changed.clear();
+		}
+#endif
+	}
+
+	void reimport(const std::string& path)
+	{
+		std::unique_lock<std::mutex> watchLock(watchMutex);
+		Entry& entry = entries[path];
+		watchLock.unlock();
+		AssetUpdate update;
+		update.kind = entry.kind;
+		update.path = path;
+
+		if (entry.kind == AssetKind::Mesh)
+		{
+			PROFILE_ZONE("reload.mesh", "reload");
+			//a half-written or broken file keeps the old mesh on screen
+			if (!LoadObjFile(path, update.mesh))
+				return;
+			const unsigned char* vertices = (const unsigned char*)update.mesh.vertices.data();
+			const unsigned char* indices = (const unsigned char*)update.mesh.indices.data();
+			size_t vertexBytes = update.mesh.vertices.size() * sizeof(ObjVertex);
+			size_t indexBytes = update.mesh.indices.size() * sizeof(unsigned int);
+
+			update.vertexResize = vertexBytes > entry.vertexCapacity;
+			update.indexResize = indexBytes > entry.indexCapacity;
+			if (!update.vertexResize)
+				update.vertexSpans = DiffSpans(entry.vertices.data(), entry.vertices.size(), vertices, vertexBytes, sizeof(ObjVertex));
+			if (!update.indexResize)
+				update.indexSpans = DiffSpans(entry.indices.data(), entry.indices.size(), indices, indexBytes, 3 * sizeof(unsigned int));
+			if (update.vertexResize)
+				entry.vertexCapacity = vertexBytes;
+			if (update.indexResize)
+				entry.indexCapacity = indexBytes;
+			entry.vertices.assign(vertices, vertices + vertexBytes);
+			entry.indices.assign(indices, indices + indexBytes);
+			PROFILE_COUNTER("reload.meshes", 1);
+		}
+		else
+		{
+			PROFILE_ZONE("reload.texture", "reload");
+			unsigned char* data = stbi_load(path.c_str(), &update.width, &update.height, &update.components, 0);
+			if (!data)
+			{
+				std::cout << "ERROR::WATCHER::UNABLE_TO_DECODE_TEXTURE: " << path << std::endl;
+				return;
+			}
+			update.pixels.assign(data, data + (size_t)update.width * update.height * update.components);
+			stbi_image_free(data);
+			PROFILE_COUNTER("reload.textures", 1);
+		}
+
+		std::lock_guard<std::mutex> lock(queueMutex);
+		pending.push_back(std::move(update));
+	}
+};
+
+#endif
@@ -0,0 +1,580 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+//closest hit of a ray. distance is in units of the ray direction, so with a unit direction it
+//is the distance from the origin
+struct RayHit {
+	float distance;
+	//the triangle's position in the index list, its corners are indices[3 * triangle + k]
+	unsigned int triangle;
+	//barycentric coordinates, the point is (1 - u - v) * corner0 + u * corner1 + v * corner2
+	float u;
+	float v;
+};
+
+//four children in SoA, so a ray or a query tests all four boxes in one loop the compiler
+//vectorizes. count 0 is an inner node at index child, a leaf holds count triangles starting
+//at child, and an unused slot has child -1
+struct BvhNode4 {
+	float minX[4], minY[4], minZ[4];
+	float maxX[4], maxY[4], maxZ[4];
+	int child[4];
+	unsigned int count[4];
+};
+
+//one triangle in leaf order, stored as a corner and two edges for the ray test
+struct BvhTriangle {
+	glm::vec3 v0, e1, e2;
+	unsigned int index;
+};
+
+namespace mesh_bvh {
+
+struct Bounds {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void Grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	void Grow(const Bounds& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+	float Area() const
+	{
+		if (max.x < min.x)
+			return 0.0f;
+		glm::vec3 size = max - min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+};
+
+//one triangle during the build, moved around by the partitions so every pass reads sequentially
+struct BuildItem {
+	Bounds box;
+	glm::vec3 centroid;
+	unsigned int triangle;
+};
+
+//binary node of the build, count > 0 is a leaf over items[first, first + count)
+struct BuildNode {
+	Bounds bounds;
+	unsigned int left;
+	unsigned int first;
+	unsigned int count;
+};
+
+const int BINS = 16;
+const unsigned int MAX_LEAF = 8;
+//ranges larger than this build their two halves as separate jobs
+const unsigned int PARALLEL_RANGE = 16384;
+//past this depth ranges are split at the median, which keeps the traversal stacks bounded
+const int MAX_SAH_DEPTH = 40;
+const int STACK_SIZE = 192;
+
+inline void setSlot(BvhNode4& node, int slot, const Bounds& bounds, int child, unsigned int count)
+{
+	node.minX[slot] = bounds.min.x;
+	node.minY[slot] = bounds.min.y;
+	node.minZ[slot] = bounds.min.z;
+	node.maxX[slot] = bounds.max.x;
+	node.maxY[slot] = bounds.max.y;
+	node.maxZ[slot] = bounds.max.z;
+	node.child[slot] = child;
+	node.count[slot] = count;
+}
+
+inline BvhNode4 emptyNode()
+{
+	BvhNode4 node;
+	for (int slot = 0; slot < 4; slot++)
+		setSlot(node, slot, Bounds(), -1, 0);
+	return node;
+}
+
+//separating axis test of a triangle against a box given by its center and half size
+inline bool triangleOverlapsBox(glm::vec3 a, glm::vec3 b, glm::vec3 c, const glm::vec3& center, const glm::vec3& half)
+{
+	a -= center;
+	b -= center;
+	c -= center;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (std::min(a[axis], std::min(b[axis], c[axis])) > half[axis] || std::max(a[axis], std::max(b[axis], c[axis])) < -half[axis])
+			return false;
+	}
+	glm::vec3 edges[3] = { b - a, c - b, a - c };
+	glm::vec3 normal = glm::cross(edges[0], edges[1]);
+	if (std::fabs(glm::dot(normal, a)) > glm::dot(half, glm::abs(normal)))
+		return false;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec3 unit(0.0f);
+		unit[axis] = 1.0f;
+		for (const glm::vec3& edge : edges)
+		{
+			glm::vec3 separating = glm::cross(unit, edge);
+			float pa = glm::dot(a, separating), pb = glm::dot(b, separating), pc = glm::dot(c, separating);
+			float radius = glm::dot(half, glm::abs(separating));
+			if (std::min(pa, std::min(pb, pc)) > radius || std::max(pa, std::max(pb, pc)) < -radius)
+				return false;
+		}
+	}
+	return true;
+}
+
+//closest point of triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+inline glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return a;
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return b;
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return c;
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denominator = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+}
+
+//Triangle BVH over one mesh, in the mesh's own (object) space. The build is a binned SAH
+//split on a binary tree, with large ranges split across the job system. The tree is then
+//collapsed into 4-wide nodes stored depth first, with the triangles copied in leaf order,
+//so a traversal walks two flat arrays. Raycast() returns the closest hit, the overlap
+//queries every triangle touching a box or a sphere.
+class MeshBvh
+{
+public:
+	bool Built() const { return !nodes.empty(); }
+	size_t NodeCount() const { return nodes.size(); }
+	size_t TriangleCount() const { return triangles.size(); }
+
+	void Clear()
+	{
+		nodes.clear();
+		triangles.clear();
+	}
+
+	//V needs Position. indices is a triangle list
+	template <typename V>
+	void Build(const std::vector<V>& vertices, const std::vector<unsigned int>& indices)
+	{
+		using namespace mesh_bvh;
+		PROFILE_ZONE("bvh.build", "import");
+		Clear();
+		unsigned int count = (unsigned int)(indices.size() / 3);
+		PROFILE_COUNTER("bvh.triangles", count);
+		if (count == 0)
+			return;
+
+		//bounds and centroid of every triangle, the only pass that touches the vertices
+		std::vector<BuildItem> items(count);
+		JobSystem& jobs = JobSystem::Get();
+		jobs.Wait(jobs.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++)
+			{
+				Bounds box;
+				for (int k = 0; k < 3; k++)
+					box.Grow(vertices[indices[t * 3 + k]].Position);
+				items[t].box = box;
+				items[t].centroid = (box.min + box.max) * 0.5f;
+				items[t].triangle = (unsigned int)t;
+			}
+		}));
+
+		std::vector<BuildNode> built(2 * (size_t)count);
+		std::atomic<unsigned int> used(1);
+		{
+			PROFILE_ZONE("bvh.split", "import");
+			buildRange(built, used, items, 0, 0, count, 0);
+		}
+
+		{
+			PROFILE_ZONE("bvh.collapse", "import");
+			nodes.reserve(used / 2 + 1);
+			if (built[0].count > 0)
+			{
+				//a single leaf still gets a node, so traversal always starts at nodes[0]
+				nodes.push_back(emptyNode());
+				setSlot(nodes[0], 0, built[0].bounds, 0, built[0].count);
+			}
+			else
+				collapse(built, 0);
+		}
+
+		triangles.resize(count);
+		jobs.Wait(jobs.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				unsigned int t = items[i].triangle;
+				const glm::vec3& v0 = vertices[indices[t * 3]].Position;
+				BvhTriangle& triangle = triangles[i];
+				triangle.v0 = v0;
+				triangle.e1 = vertices[indices[t * 3 + 1]].Position - v0;
+				triangle.e2 = vertices[indices[t * 3 + 2]].Position - v0;
+				triangle.index = t;
+			}
+		}));
+		PROFILE_COUNTER("bvh.nodes", nodes.size());
+	}
+
+	//closest triangle hit by origin + t * direction for 0 <= t < maxDistance, both faces count
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, float maxDistance = FLT_MAX) const
+	{
+		if (nodes.empty())
+			return false;
+		glm::vec3 inverse;
+		for (int axis = 0; axis < 3; axis++)
+			inverse[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : std::copysign(FLT_MAX, direction[axis]);
+		hit.distance = maxDistance;
+		bool found = false;
+
+		int stack[mesh_bvh::STACK_SIZE];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const BvhNode4& node = nodes[stack[--top]];
+			float entry[4];
+			bool overlaps[4];
+			for (int slot = 0; slot < 4; slot++)
+			{
+				float x0 = (node.minX[slot] - origin.x) * inverse.x, x1 = (node.maxX[slot] - origin.x) * inverse.x;
+				float y0 = (node.minY[slot] - origin.y) * inverse.y, y1 = (node.maxY[slot] - origin.y) * inverse.y;
+				float z0 = (node.minZ[slot] - origin.z) * inverse.z, z1 = (node.maxZ[slot] - origin.z) * inverse.z;
+				float nearest = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+				float farthest = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), hit.distance));
+				entry[slot] = nearest;
+				overlaps[slot] = node.child[slot] >= 0 && nearest <= farthest;
+			}
+			//nearest child first: leaves are tested right away and shorten the ray for the
+			//rest, inner nodes are pushed farthest first so the nearest is popped next
+			int sorted[4], hits = 0;
+			for (int slot = 0; slot < 4; slot++)
+			{
+				if (!overlaps[slot])
+					continue;
+				int i = hits++;
+				while (i > 0 && entry[sorted[i - 1]] > entry[slot])
+				{
+					sorted[i] = sorted[i - 1];
+					i--;
+				}
+				sorted[i] = slot;
+			}
+			int inner[4], innerCount = 0;
+			for (int i = 0; i < hits; i++)
+			{
+				int slot = sorted[i];
+				if (entry[slot] > hit.distance)
+					break;
+				if (node.count[slot] == 0)
+					inner[innerCount++] = node.child[slot];
+				else
+					found = intersectLeaf(node.child[slot], node.count[slot], origin, direction, hit) || found;
+			}
+			while (innerCount > 0)
+				stack[top++] = inner[--innerCount];
+		}
+		return found;
+	}
+
+	//ray from the camera (eye and unit front vector in world space) against the mesh drawn
+	//with model. the hit distance is in world units along front
+	bool Pick(const glm::vec3& eye, const glm::vec3& front, const glm::mat4& model, RayHit& hit) const
+	{
+		//an affine transform keeps the ray parameter, so t stays the world distance
+		glm::mat4 toObject = glm::inverse(model);
+		glm::vec3 origin = glm::vec3(toObject * glm::vec4(eye, 1.0f));
+		glm::vec3 direction = glm::mat3(toObject) * front;
+		return Raycast(origin, direction, hit);
+	}
+
+	//appends every triangle that overlaps the box [boxMin, boxMax]
+	void QueryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<unsigned int>& found) const
+	{
+		glm::vec3 center = (boxMin + boxMax) * 0.5f, half = (boxMax - boxMin) * 0.5f;
+		query([&](const BvhNode4& node, int slot) {
+			return node.minX[slot] <= boxMax.x && node.maxX[slot] >= boxMin.x && node.minY[slot] <= boxMax.y && node.maxY[slot] >= boxMin.y
+				&& node.minZ[slot] <= boxMax.z && node.maxZ[slot] >= boxMin.z;
+		}, [&](const BvhTriangle& triangle) {
+			return mesh_bvh::triangleOverlapsBox(triangle.v0, triangle.v0 + triangle.e1, triangle.v0 + triangle.e2, center, half);
+		}, found);
+	}
+
+	//appends every triangle closer than radius to center
+	void QuerySphere(const glm::vec3& center, float radius, std::vector<unsigned int>& found) const
+	{
+		float radiusSquared = radius * radius;
+		query([&](const BvhNode4& node, int slot) {
+			float dx = std::max(std::max(node.minX[slot] - center.x, center.x - node.maxX[slot]), 0.0f);
+			float dy = std::max(std::max(node.minY[slot] - center.y, center.y - node.maxY[slot]), 0.0f);
+			float dz = std::max(std::max(node.minZ[slot] - center.z, center.z - node.maxZ[slot]), 0.0f);
+			return dx * dx + dy * dy + dz * dz <= radiusSquared;
+		}, [&](const BvhTriangle& triangle) {
+			glm::vec3 closest = mesh_bvh::closestPointOnTriangle(center, triangle.v0, triangle.v0 + triangle.e1, triangle.v0 + triangle.e2);
+			glm::vec3 offset = closest - center;
+			return glm::dot(offset, offset) <= radiusSquared;
+		}, found);
+	}
+
+private:
+	std::vector<BvhNode4> nodes;
+	std::vector<BvhTriangle> triangles;
+
+	//Moller-Trumbore against every triangle of a leaf, shortening hit.distance
+	bool intersectLeaf(int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const
+	{
+		bool found = false;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			const BvhTriangle& triangle = triangles[i];
+			glm::vec3 p = glm::cross(direction, triangle.e2);
+			float determinant = glm::dot(triangle.e1, p);
+			if (std::fabs(determinant) < 1e-20f)
+				continue;
+			float inverse = 1.0f / determinant;
+			glm::vec3 s = origin - triangle.v0;
+			float u = glm::dot(s, p) * inverse;
+			if (u < 0.0f || u > 1.0f)
+				continue;
+			glm::vec3 q = glm::cross(s, triangle.e1);
+			float v = glm::dot(direction, q) * inverse;
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+			float t = glm::dot(triangle.e2, q) * inverse;
+			if (t >= 0.0f && t < hit.distance)
+			{
+				hit.distance = t;
+				hit.triangle = triangle.index;
+				hit.u = u;
+				hit.v = v;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	//visits every slot overlapsNode accepts and appends the leaf triangles matches accepts
+	template <typename NodeTest, typename TriangleTest>
+	void query(NodeTest overlapsNode, TriangleTest matches, std::vector<unsigned int>& found) const
+	{
+		if (nodes.empty())
+			return;
+		int stack[mesh_bvh::STACK_SIZE];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const BvhNode4& node = nodes[stack[--top]];
+			for (int slot = 0; slot < 4; slot++)
+			{
+				if (node.child[slot] < 0 || !overlapsNode(node, slot))
+					continue;
+				if (node.count[slot] == 0)
+				{
+					stack[top++] = node.child[slot];
+					continue;
+				}
+				for (unsigned int i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++)
+				{
+					if (matches(triangles[i]))
+						found.push_back(triangles[i].index);
+				}
+			}
+		}
+	}
+
+	//builds items[begin, end) into built[index], choosing the split with the lowest SAH cost
+	static void buildRange(std::vector<mesh_bvh::BuildNode>& built, std::atomic<unsigned int>& used, std::vector<mesh_bvh::BuildItem>& items,
+		unsigned int index, unsigned int begin, unsigned int end, int depth)
+	{
+		using namespace mesh_bvh;
+		BuildNode& node = built[index];
+		Bounds bounds, centroidBounds;
+		for (unsigned int i = begin; i < end; i++)
+		{
+			bounds.Grow(items[i].box);
+			centroidBounds.Grow(items[i].centroid);
+		}
+		node.bounds = bounds;
+		node.first = begin;
+		node.count = end - begin;
+		unsigned int count = end - begin;
+		if (count <= 2)
+			return;
+
+		//binned SAH on every axis the centroids spread along, all three binned in one pass
+		int bestAxis = -1, bestSplit = 0;
+		float bestCost = FLT_MAX;
+		glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+		glm::vec3 scales;
+		for (int axis = 0; axis < 3; axis++)
+			scales[axis] = extent[axis] > 0.0f ? BINS / extent[axis] : 0.0f;
+		Bounds bins[3][BINS];
+		unsigned int binCounts[3][BINS] = {};
+		if (depth < MAX_SAH_DEPTH)
+		{
+			for (unsigned int i = begin; i < end; i++)
+			{
+				const Bounds& box = items[i].box;
+				glm::vec3 offset = (items[i].centroid - centroidBounds.min) * scales;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					int bin = std::min(BINS - 1, (int)offset[axis]);
+					bins[axis][bin].Grow(box);
+					binCounts[axis][bin]++;
+				}
+			}
+		}
+		for (int axis = 0; axis < 3 && depth < MAX_SAH_DEPTH; axis++)
+		{
+			if (extent[axis] <= 0.0f)
+				continue;
+			const Bounds* binBounds = bins[axis];
+			const unsigned int* binCount = binCounts[axis];
+			//area and count of everything right of each split
+			float rightArea[BINS];
+			unsigned int rightCount[BINS];
+			Bounds right;
+			unsigned int rightTotal = 0;
+			for (int bin = BINS - 1; bin > 0; bin--)
+			{
+				right.Grow(binBounds[bin]);
+				rightTotal += binCount[bin];
+				rightArea[bin] = right.Area();
+				rightCount[bin] = rightTotal;
+			}
+			Bounds left;
+			unsigned int leftTotal = 0;
+			for (int split = 1; split < BINS; split++)
+			{
+				left.Grow(binBounds[split - 1]);
+				leftTotal += binCount[split - 1];
+				if (leftTotal == 0 || rightCount[split] == 0)
+					continue;
+				float cost = left.Area() * leftTotal + rightArea[split] * rightCount[split];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		unsigned int middle;
+		if (bestAxis >= 0)
+		{
+			//a leaf costs one test per triangle, a split one traversal step plus its children
+			float splitCost = 1.0f + bestCost / std::max(bounds.Area(), 1e-30f);
+			if (count <= MAX_LEAF && splitCost >= (float)count)
+				return;
+			float scale = scales[bestAxis];
+			float minimum = centroidBounds.min[bestAxis];
+			middle = (unsigned int)(std::partition(items.begin() + begin, items.begin() + end, [&](const BuildItem& item) {
+				return std::min(BINS - 1, (int)((item.centroid[bestAxis] - minimum) * scale)) < bestSplit;
+			}) - items.begin());
+		}
+		else
+		{
+			//identical centroids or too deep: split at the median of the widest axis
+			if (count <= MAX_LEAF)
+				return;
+			int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+			middle = begin + count / 2;
+			std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [&](const BuildItem& a, const BuildItem& b) {
+				return a.centroid[axis] < b.centroid[axis];
+			});
+		}
+
+		unsigned int left = used.fetch_add(2);
+		node.left = left;
+		node.count = 0;
+		if (count > PARALLEL_RANGE)
+		{
+			JobSystem& jobs = JobSystem::Get();
+			JobHandle leftDone = jobs.Schedule([&, left, begin, middle, depth]() {
+				buildRange(built, used, items, left, begin, middle, depth + 1);
+			});
+			buildRange(built, used, items, left + 1, middle, end, depth + 1);
+			jobs.Wait(leftDone);
+		}
+		else
+		{
+			buildRange(built, used, items, left, begin, middle, depth + 1);
+			buildRange(built, used, items, left + 1, middle, end, depth + 1);
+		}
+	}
+
+	//turns the binary node at index into a 4-wide node by opening its largest inner
+	//children until it has four, then does the same for every inner child
+	int collapse(const std::vector<mesh_bvh::BuildNode>& built, unsigned int index)
+	{
+		using namespace mesh_bvh;
+		unsigned int children[4] = { built[index].left, built[index].left + 1 };
+		int childCount = 2;
+		while (childCount < 4)
+		{
+			int open = -1;
+			float largest = -1.0f;
+			for (int i = 0; i < childCount; i++)
+			{
+				const BuildNode& child = built[children[i]];
+				if (child.count == 0 && child.bounds.Area() > largest)
+				{
+					largest = child.bounds.Area();
+					open = i;
+				}
+			}
+			if (open < 0)
+				break;
+			unsigned int opened = children[open];
+			children[open] = built[opened].left;
+			children[childCount++] = built[opened].left + 1;
+		}
+
+		int position = (int)nodes.size();
+		nodes.push_back(emptyNode());
+		for (int i = 0; i < childCount; i++)
+		{
+			const BuildNode& child = built[children[i]];
+			int target = child.count > 0 ? (int)child.first : collapse(built, children[i]);
+			setSlot(nodes[position], i, child.bounds, target, child.count);
+		}
+		return position;
+	}
+};
+
+#endif
@@ -64,32 +64,27 @@ public:
 
 	glm::mat4 lookAt(glm::vec3 Position, glm::vec3 Target, glm::vec3 Upward)
 	{
-		glm::mat4 translation = glm::mat4(1.0f);
-		glm::mat4 rotation = glm::mat4(1.0f);
-
-		//update translation matrix
-		translation[3][0] = -Position.x;
-		translation[3][1] = -Position.y;
-		translation[3][2] = -Position.z;
-
 		//recalculate forward (AKA negative z-axis), upward, and right vectors
 		glm::vec3 cameraForward = glm::normalize(Position - Target);
 		glm::vec3 cameraRight = glm::normalize(glm::cross(Upward, cameraForward));
 		glm::vec3 cameraUpward = glm::normalize(glm::cross(cameraForward, cameraRight));
 
-		//update rotation matrix
-		rotation[0][0] = cameraRight.x;
-		rotation[1][0] = cameraRight.y;
-		rotation[2][0] = cameraRight.z;
-		rotation[0][1] = cameraUpward.x;
-		rotation[1][1] = cameraUpward.y;
-		rotation[2][1] = cameraUpward.z;
-		rotation[0][2] = cameraForward.x;
-		rotation[1][2] = cameraForward.y;
-		rotation[2][2] = cameraForward.z;
-
-		return rotation * translation;
-
+		//rotation * translation written out: the rotation rows are the camera axes and the
+		//translation column is the position moved into camera space, no matrix product needed
+		glm::mat4 view = glm::mat4(1.0f);
+		view[0][0] = cameraRight.x;
+		view[1][0] = cameraRight.y;
+		view[2][0] = cameraRight.z;
+		view[0][1] = cameraUpward.x;
+		view[1][1] = cameraUpward.y;
+		view[2][1] = cameraUpward.z;
+		view[0][2] = cameraForward.x;
+		view[1][2] = cameraForward.y;
+		view[2][2] = cameraForward.z;
+		view[3][0] = -glm::dot(cameraRight, Position);
+		view[3][1] = -glm::dot(cameraUpward, Position);
+		view[3][2] = -glm::dot(cameraForward, Position);
+		return view;
 	}
 
 	//return view matrix calculated by euler angles
@@ -98,6 +93,29 @@ public:
 		return lookAt(Position, Position + Front, Up);
 	}
 
+	//place the camera and turn it towards target, recomputing yaw and pitch so mouse input continues from there
+	void PointAt(glm::vec3 position, glm::vec3 target)
+	{
+		Position = position;
+		glm::vec3 offset = target - position;
+		//coinciding points give no direction, e.g. an orbit of radius 0: keep the current one
+		if (glm::dot(offset, offset) > 0.0f)
+		{
+			glm::vec3 direction = glm::normalize(offset);
+			Pitch = glm::degrees(asin(glm::clamp(direction.y, -1.0f, 1.0f)));
+			Yaw = glm::degrees(atan2(direction.z, direction.x));
+		}
+		updateCameraVectors();
+	}
+
+	//set yaw and pitch directly, for a camera copied from an interpolated simulation state
+	void SetOrientation(float yaw, float pitch)
+	{
+		Yaw = yaw;
+		Pitch = pitch;
+		updateCameraVectors();
+	}
+
 	// processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
 	void ProcessKeyBoard(Camera_Movement direction, float delta_time)
 	{
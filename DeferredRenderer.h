@@ -0,0 +1,359 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Lights.h"
+#include "MemoryRegistry.h"
+#include "Profiler.h"
+#include "RingBuffer.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Alternate lighting path for scenes with many point lights. The geometry pass writes
+//albedo, specular color + shininess, normal and depth once per pixel; the lighting pass
+//then runs the directional and spot light as one full-screen triangle and each point
+//light only over the pixels its light volume (an instanced sphere) covers.
+class DeferredRenderer
+{
+public:
+	int Width;
+	int Height;
+
+	DeferredRenderer() : Width(0), Height(0), gBuffer(0), albedoTexture(0), specularTexture(0), normalTexture(0), depthTexture(0),
+		emptyVAO(0), sphereVAO(0), sphereVBO(0), sphereEBO(0), instanceVBO(0), sphereIndexCount(0), instanceCapacity(0) {}
+
+	//builds the G-buffer and the lighting programs, must run with the GL context current
+	bool Create(int width, int height)
+	{
+		PROFILE_ZONE("deferred.create", "gpu");
+		geometryShaders.reset(new ShaderVariants("shader.vs", "gbuffer.fs"));
+		directionalShader.reset(new Shader("deferred_quad.vs", "deferred_dir.fs"));
+		pointShader.reset(new Shader("deferred_point.vs", "deferred_point.fs"));
+		if (directionalShader->ID == 0 || pointShader->ID == 0)
+			return false;
+
+		glGenVertexArrays(1, &emptyVAO);
+		createSphere();
+		return Resize(width, height);
+	}
+
+	//reallocates the G-buffer attachments, cheap to call every frame when the size is unchanged
+	bool Resize(int width, int height)
+	{
+		if (width == Width && height == Height && gBuffer != 0)
+			return true;
+		releaseTargets();
+		Width = width;
+		Height = height;
+
+		glGenFramebuffers(1, &gBuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+		albedoTexture = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0);
+		//shininess goes into alpha unscaled: exact up to 2048, far beyond the MTL range
+		specularTexture = createTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_COLOR_ATTACHMENT1);
+		normalTexture = createTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_COLOR_ATTACHMENT2);
+		depthTexture = createTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_DEPTH_STENCIL_ATTACHMENT);
+		GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		glDrawBuffers(3, attachments);
+		//one RGBA8, two RGBA16F and a 24+8 depth attachment
+		targetMemory = MemoryAllocation(MEMORY_RENDER_TARGETS, "deferred", (size_t)Width * Height * (4 + 8 + 8 + 4));
+
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "ERROR::DEFERRED::GBUFFER_INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return complete;
+	}
+
+	//G-buffer programs, one per material permutation (only the map switches matter here)
+	ShaderVariants& GeometryShaders() { return *geometryShaders; }
+
+	//binds and clears the G-buffer, the caller then draws the opaque geometry
+	void BeginGeometry()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+		glViewport(0, 0, Width, Height);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	//resolves lighting into targetFramebuffer (already cleared by the caller) and copies the
+	//scene depth there, so forward passes drawn afterwards are depth tested against it.
+	//with a ring the light instances are written into this frame's section of it
+	void Light(unsigned int targetFramebuffer, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, const SceneLights& lights, size_t pointLightCount,
+		FrameRingBuffer* ring = NULL)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer);
+		glBlitFramebuffer(0, 0, Width, Height, 0, 0, Width, Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+		glViewport(0, 0, Width, Height);
+
+		glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+		bindTargets();
+
+		//directional + spot light, every covered pixel once
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+		Shader& directional = *directionalShader;
+		directional.use();
+		setCommonUniforms(directional, viewPos, inverseViewProjection);
+		directional.setVec3("dirLight.direction", lights.dirLight.direction);
+		directional.setVec3("dirLight.ambient", lights.dirLight.ambient);
+		directional.setVec3("dirLight.diffuse", lights.dirLight.diffuse);
+		directional.setVec3("dirLight.specular", lights.dirLight.specular);
+		directional.setBool("spotEnabled", lights.spotLight.enabled);
+		directional.setVec3("spotLight.position", lights.spotLight.position);
+		directional.setVec3("spotLight.direction", lights.spotLight.direction);
+		directional.setVec3("spotLight.ambient", lights.spotLight.ambient);
+		directional.setVec3("spotLight.diffuse", lights.spotLight.diffuse);
+		directional.setVec3("spotLight.specular", lights.spotLight.specular);
+		directional.setFloat("spotLight.constant", lights.spotLight.constant);
+		directional.setFloat("spotLight.linear", lights.spotLight.linear);
+		directional.setFloat("spotLight.quadratic", lights.spotLight.quadratic);
+		directional.setFloat("spotLight.cutOff", lights.spotLight.cutOff);
+		directional.setFloat("spotLight.outerCutOff", lights.spotLight.outerCutOff);
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		//point lights, added over their volumes. drawing the back faces with GREATER/EQUAL
+		//depth keeps only pixels whose surface lies in front of the volume's far side, and
+		//still works when the camera is inside a volume
+		pointLightCount = std::min(pointLightCount, lights.pointLights.size());
+		if (pointLightCount > 0)
+		{
+			uploadInstances(lights.pointLights, pointLightCount, ring);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_ONE, GL_ONE);
+			glEnable(GL_DEPTH_TEST);
+			glDepthFunc(GL_GEQUAL);
+			glEnable(GL_CULL_FACE);
+			glCullFace(GL_FRONT);
+			//volumes reaching past the far plane must not lose their back faces
+			glEnable(GL_DEPTH_CLAMP);
+			Shader& point = *pointShader;
+			point.use();
+			setCommonUniforms(point, viewPos, inverseViewProjection);
+			point.setMat4("view", view);
+			point.setMat4("projection", projection);
+			glBindVertexArray(sphereVAO);
+			glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)pointLightCount);
+			glDisable(GL_DEPTH_CLAMP);
+			glCullFace(GL_BACK);
+			glDisable(GL_CULL_FACE);
+			glDepthFunc(GL_LESS);
+			glDisable(GL_BLEND);
+		}
+
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//picks up edits to any of the deferred shaders, see Shader::ReloadIfChanged
+	void ReloadIfChanged()
+	{
+		geometryShaders->ReloadIfChanged();
+		directionalShader->ReloadIfChanged();
+		pointShader->ReloadIfChanged();
+	}
+
+	//must run while the GL context is still current
+	void Destroy()
+	{
+		releaseTargets();
+		glDeleteVertexArrays(1, &emptyVAO);
+		glDeleteVertexArrays(1, &sphereVAO);
+		glDeleteBuffers(1, &sphereVBO);
+		glDeleteBuffers(1, &sphereEBO);
+		glDeleteBuffers(1, &instanceVBO);
+		emptyVAO = sphereVAO = sphereVBO = sphereEBO = instanceVBO = 0;
+		instanceCapacity = 0;
+		sphereVertexMemory.Reset();
+		sphereIndexMemory.Reset();
+		instanceMemory.Reset();
+		geometryShaders.reset();
+		directionalShader.reset();
+		pointShader.reset();
+	}
+
+private:
+	//per-instance layout of deferred_point.vs
+	struct PointLightInstance {
+		glm::vec4 positionRadius;
+		glm::vec3 ambient;
+		glm::vec3 diffuse;
+		glm::vec3 specular;
+		glm::vec3 attenuation;
+	};
+
+	unsigned int gBuffer, albedoTexture, specularTexture, normalTexture, depthTexture;
+	unsigned int emptyVAO, sphereVAO, sphereVBO, sphereEBO, instanceVBO;
+	GLsizei sphereIndexCount;
+	size_t instanceCapacity;
+	MemoryAllocation targetMemory, sphereVertexMemory, sphereIndexMemory, instanceMemory;
+	std::vector<PointLightInstance> instances;
+	std::unique_ptr<ShaderVariants> geometryShaders;
+	std::unique_ptr<Shader> directionalShader;
+	std::unique_ptr<Shader> pointShader;
+
+	unsigned int createTarget(GLenum internalFormat, GLenum format, GLenum type, GLenum attachment)
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, Width, Height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+		return texture;
+	}
+
+	void releaseTargets()
+	{
+		unsigned int textures[4] = { albedoTexture, specularTexture, normalTexture, depthTexture };
+		glDeleteTextures(4, textures);
+		glDeleteFramebuffers(1, &gBuffer);
+		gBuffer = albedoTexture = specularTexture = normalTexture = depthTexture = 0;
+		targetMemory.Reset();
+	}
+
+	void bindTargets()
+	{
+		unsigned int textures[4] = { albedoTexture, specularTexture, normalTexture, depthTexture };
+		for (int i = 0; i < 4; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+		}
+	}
+
+	void setCommonUniforms(Shader& shader, const glm::vec3& viewPos, const glm::mat4& inverseViewProjection)
+	{
+		shader.setInt("gAlbedo", 0);
+		shader.setInt("gSpecular", 1);
+		shader.setInt("gNormal", 2);
+		shader.setInt("gDepth", 3);
+		shader.setVec3("viewPos", viewPos);
+		shader.setMat4("inverseViewProjection", inverseViewProjection);
+		shader.setVec2("screenSize", (float)Width, (float)Height);
+	}
+
+	//low-poly UV sphere pushed out so its flat faces still enclose the unit sphere
+	void createSphere()
+	{
+		const unsigned int stacks = 8, slices = 12;
+		const float pi = 3.14159265f;
+		float grow = 1.0f / (std::cos(pi / stacks) * std::cos(pi / slices));
+		std::vector<glm::vec3> positions;
+		std::vector<unsigned int> indices;
+		for (unsigned int i = 0; i <= stacks; i++)
+		{
+			float theta = pi * i / stacks;
+			for (unsigned int j = 0; j <= slices; j++)
+			{
+				float phi = 2.0f * pi * j / slices;
+				positions.push_back(grow * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+			}
+		}
+		for (unsigned int i = 0; i < stacks; i++)
+		{
+			for (unsigned int j = 0; j < slices; j++)
+			{
+				unsigned int a = i * (slices + 1) + j;
+				unsigned int b = a + slices + 1;
+				indices.insert(indices.end(), { a, a + 1, b, b, a + 1, b + 1 });
+			}
+		}
+		sphereIndexCount = (GLsizei)indices.size();
+
+		glGenVertexArrays(1, &sphereVAO);
+		glGenBuffers(1, &sphereVBO);
+		glGenBuffers(1, &sphereEBO);
+		glGenBuffers(1, &instanceVBO);
+		glBindVertexArray(sphereVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+		glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+		sphereVertexMemory = MemoryAllocation(MEMORY_VERTEX_BUFFERS, "deferred", positions.size() * sizeof(glm::vec3));
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		sphereIndexMemory = MemoryAllocation(MEMORY_INDEX_BUFFERS, "deferred", indices.size() * sizeof(unsigned int));
+
+		for (unsigned int attribute = 1; attribute <= 5; attribute++)
+		{
+			glEnableVertexAttribArray(attribute);
+			glVertexAttribDivisor(attribute, 1);
+		}
+		pointInstances(instanceVBO, 0);
+		glBindVertexArray(0);
+	}
+
+	//sources the instance attributes of the sphere VAO from buffer at offset
+	void pointInstances(unsigned int buffer, size_t offset)
+	{
+		glBindVertexArray(sphereVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(PointLightInstance), (void*)(offset + offsetof(PointLightInstance, positionRadius)));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(PointLightInstance), (void*)(offset + offsetof(PointLightInstance, ambient)));
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(PointLightInstance), (void*)(offset + offsetof(PointLightInstance, diffuse)));
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(PointLightInstance), (void*)(offset + offsetof(PointLightInstance, specular)));
+		glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(PointLightInstance), (void*)(offset + offsetof(PointLightInstance, attenuation)));
+	}
+
+	void uploadInstances(const std::vector<PointLightSource>& lights, size_t count, FrameRingBuffer* ring)
+	{
+		RingAllocation allocation = { NULL, 0, 0 };
+		if (ring)
+			allocation = ring->Allocate(count * sizeof(PointLightInstance), 16);
+		PointLightInstance* target;
+		if (allocation.Valid())
+			target = (PointLightInstance*)allocation.Data;
+		else
+		{
+			instances.resize(count);
+			target = instances.data();
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			const PointLightSource& light = lights[i];
+			target[i] = { glm::vec4(light.position, PointLightRadius(light)), light.ambient, light.diffuse, light.specular,
+				glm::vec3(light.constant, light.linear, light.quadratic) };
+		}
+		if (allocation.Valid())
+		{
+			ring->Flush();
+			pointInstances(ring->Buffer(), (size_t)allocation.Offset);
+			return;
+		}
+		pointInstances(instanceVBO, 0);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		if (count > instanceCapacity)
+		{
+			instanceCapacity = count;
+			glBufferData(GL_ARRAY_BUFFER, count * sizeof(PointLightInstance), instances.data(), GL_DYNAMIC_DRAW);
+			if (instanceMemory.Active())
+				instanceMemory.Resize(count * sizeof(PointLightInstance));
+			else
+				instanceMemory = MemoryAllocation(MEMORY_STREAMING_BUFFERS, "deferred", count * sizeof(PointLightInstance));
+		}
+		else
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(PointLightInstance), instances.data());
+	}
+};
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//Fixed-size history of per-frame samples (milliseconds) with percentile queries
+class RollingStats
+{
+public:
+	RollingStats(size_t capacity = 600) : capacity(capacity), head(0), total(0) {}
+
+	void Add(double value)
+	{
+		if (samples.size() < capacity)
+			samples.push_back(value);
+		else
+			samples[head] = value;
+		head = (head + 1) % capacity;
+		total++;
+	}
+
+	size_t Count() const { return samples.size(); }
+	size_t TotalCount() const { return total; }
+
+	double Mean() const
+	{
+		if (samples.empty())
+			return 0.0;
+		double sum = 0.0;
+		for (double value : samples)
+			sum += value;
+		return sum / samples.size();
+	}
+
+	double Max() const
+	{
+		return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+	}
+
+	//nearest-rank percentile over the current window, p in [0, 100]
+	double Percentile(double p) const
+	{
+		if (samples.empty())
+			return 0.0;
+		scratch = samples;
+		size_t rank = (size_t)(p / 100.0 * (scratch.size() - 1) + 0.5);
+		std::nth_element(scratch.begin(), scratch.begin() + rank, scratch.end());
+		return scratch[rank];
+	}
+
+private:
+	size_t capacity;
+	size_t head;
+	size_t total;
+	std::vector<double> samples;
+	mutable std::vector<double> scratch;
+};
+
+//In-process frame profiler for the render loop. GPU passes are timed with
+//GL_TIME_ELAPSED queries, two per pass so that a frame only ever reads back the
+//queries it issued two frames earlier and never waits on the current one.
+//CPU zones may be entered several times per frame and are summed per frame.
+//The queries of the last two frames are collected when the CSV is written.
+class FrameProfiler
+{
+public:
+	FrameProfiler(size_t historySize = 600) : historySize(historySize), frameIndex(0), activeGpuPass(-1), skippedGpuPasses(0), frameTime(historySize), inFrame(false) {}
+
+	void BeginFrame()
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (inFrame)
+			frameTime.Add(std::chrono::duration<double, std::milli>(now - frameStart).count());
+		frameStart = now;
+		inFrame = true;
+
+		//the queries this frame is about to reuse were issued two frames ago
+		collect(frameIndex % 2);
+		for (CpuZone& zone : cpuZones)
+			zone.frameTotal = 0.0;
+	}
+
+	void EndFrame()
+	{
+		for (CpuZone& zone : cpuZones)
+		{
+			if (zone.touched)
+				zone.stats.Add(zone.frameTotal);
+			zone.touched = false;
+		}
+		frameIndex++;
+	}
+
+	//GL_TIME_ELAPSED queries cannot nest, so GPU passes must be sequential. a pass begun
+	//inside another is skipped, and its EndGpu leaves the outer pass running
+	void BeginGpu(const std::string& name)
+	{
+		if (activeGpuPass != -1)
+		{
+			std::cout << "ERROR::FRAME_PROFILER::NESTED_GPU_PASS: " << name << " inside " << gpuPasses[activeGpuPass].name << std::endl;
+			skippedGpuPasses++;
+			return;
+		}
+		activeGpuPass = findGpuPass(name);
+		GpuPass& pass = gpuPasses[activeGpuPass];
+		glBeginQuery(GL_TIME_ELAPSED, pass.queries[frameIndex % 2]);
+	}
+
+	void EndGpu()
+	{
+		if (skippedGpuPasses > 0)
+		{
+			skippedGpuPasses--;
+			return;
+		}
+		if (activeGpuPass == -1)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		gpuPasses[activeGpuPass].issued[frameIndex % 2] = true;
+		activeGpuPass = -1;
+	}
+
+	void BeginCpu(const std::string& name)
+	{
+		CpuZone& zone = cpuZones[findCpuZone(name)];
+		zone.start = std::chrono::steady_clock::now();
+	}
+
+	void EndCpu(const std::string& name)
+	{
+		CpuZone& zone = cpuZones[findCpuZone(name)];
+		zone.frameTotal += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - zone.start).count();
+		zone.touched = true;
+	}
+
+	//RAII helper for CPU zones
+	class CpuScope
+	{
+	public:
+		CpuScope(FrameProfiler& profiler, const std::string& name) : profiler(profiler), name(name) { profiler.BeginCpu(name); }
+		~CpuScope() { profiler.EndCpu(name); }
+		CpuScope(const CpuScope&) = delete;
+		CpuScope& operator=(const CpuScope&) = delete;
+	private:
+		FrameProfiler& profiler;
+		std::string name;
+	};
+
+	//one row per metric: type, name, samples, mean, p50, p95, p99, max (milliseconds).
+	//waits for the queries still in flight first, so the last two frames are counted
+	bool WriteCsv(const std::string& path)
+	{
+		collect(0);
+		collect(1);
+		std::ofstream out(path);
+		if (!out)
+		{
+			std::cout << "ERROR::FRAME_PROFILER::UNABLE_TO_WRITE_CSV: " << path << std::endl;
+			return false;
+		}
+		out << "type,name,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+		out << std::fixed << std::setprecision(4);
+		writeRow(out, "cpu", "frame", frameTime);
+		for (const CpuZone& zone : cpuZones)
+			writeRow(out, "cpu", zone.name, zone.stats);
+		for (const GpuPass& pass : gpuPasses)
+			writeRow(out, "gpu", pass.name, pass.stats);
+		return true;
+	}
+
+	void PrintSummary() const
+	{
+		std::cout << std::fixed << std::setprecision(3);
+		printRow("cpu", "frame", frameTime);
+		for (const CpuZone& zone : cpuZones)
+			printRow("cpu", zone.name, zone.stats);
+		for (const GpuPass& pass : gpuPasses)
+			printRow("gpu", pass.name, pass.stats);
+		std::cout << std::defaultfloat;
+	}
+
+	const RollingStats& GetFrameStats() const { return frameTime; }
+
+	//stats of a GPU pass by name, nullptr before the pass has been timed
+	const RollingStats* GetGpuStats(const std::string& name) const
+	{
+		for (const GpuPass& pass : gpuPasses)
+			if (pass.name == name)
+				return &pass.stats;
+		return nullptr;
+	}
+
+	//delete the query objects, must run while the GL context is still current
+	void Release()
+	{
+		for (GpuPass& pass : gpuPasses)
+			glDeleteQueries(2, pass.queries);
+		gpuPasses.clear();
+	}
+
+private:
+	struct GpuPass {
+		std::string name;
+		GLuint queries[2];
+		bool issued[2];
+		RollingStats stats;
+	};
+
+	struct CpuZone {
+		std::string name;
+		std::chrono::steady_clock::time_point start;
+		double frameTotal;
+		bool touched;
+		RollingStats stats;
+	};
+
+	size_t historySize;
+	unsigned long long frameIndex;
+	int activeGpuPass;
+	int skippedGpuPasses;
+	std::vector<GpuPass> gpuPasses;
+	std::vector<CpuZone> cpuZones;
+	RollingStats frameTime;
+	std::chrono::steady_clock::time_point frameStart;
+	bool inFrame;
+
+	//reads back the queries issued into slot, blocking until the GPU has finished them
+	void collect(int slot)
+	{
+		for (GpuPass& pass : gpuPasses)
+		{
+			if (!pass.issued[slot])
+				continue;
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &elapsed);
+			pass.stats.Add(elapsed / 1.0e6);
+			pass.issued[slot] = false;
+		}
+	}
+
+	//a handful of passes per frame, a linear scan beats hashing the name
+	int findGpuPass(const std::string& name)
+	{
+		for (size_t i = 0; i < gpuPasses.size(); i++)
+			if (gpuPasses[i].name == name)
+				return (int)i;
+		GpuPass pass = { name, { 0, 0 }, { false, false }, RollingStats(historySize) };
+		glGenQueries(2, pass.queries);
+		gpuPasses.push_back(pass);
+		return (int)gpuPasses.size() - 1;
+	}
+
+	int findCpuZone(const std::string& name)
+	{
+		for (size_t i = 0; i < cpuZones.size(); i++)
+			if (cpuZones[i].name == name)
+				return (int)i;
+		CpuZone zone = { name, std::chrono::steady_clock::time_point(), 0.0, false, RollingStats(historySize) };
+		cpuZones.push_back(zone);
+		return (int)cpuZones.size() - 1;
+	}
+
+	static void writeRow(std::ofstream& out, const char* type, const std::string& name, const RollingStats& stats)
+	{
+		out << type << "," << name << "," << stats.TotalCount() << "," << stats.Mean() << ","
+			<< stats.Percentile(50.0) << "," << stats.Percentile(95.0) << "," << stats.Percentile(99.0) << ","
+			<< stats.Max() << "\n";
+	}
+
+	static void printRow(const char* type, const std::string& name, const RollingStats& stats)
+	{
+		std::cout << "FRAME::" << type << " " << name << " p50 " << stats.Percentile(50.0) << " ms, p95 "
+			<< stats.Percentile(95.0) << " ms, p99 " << stats.Percentile(99.0) << " ms" << std::endl;
+	}
+};
+
+#endif
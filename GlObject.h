@@ -0,0 +1,109 @@
+#ifndef GL_OBJECT_H
+#define GL_OBJECT_H
+
+#include <glad/glad.h>
+
+#include "MemoryRegistry.h"
+
+#include <string>
+
+enum GlObjectKind { GL_OBJECT_BUFFER, GL_OBJECT_VERTEX_ARRAY, GL_OBJECT_TEXTURE };
+
+//Owns one GL object name and deletes it on destruction, with the registry entry for its
+//storage. Move-only, so a vector of them (or of classes holding them) never ends up with
+//two owners of one name. Destruction has to happen while the context is current: objects
+//that outlive the render loop are reset before the context goes.
+template <GlObjectKind Kind>
+class GlObject
+{
+public:
+	GlObject() : id(0) {}
+	GlObject(GlObject&& other) noexcept : id(other.id), memory(std::move(other.memory)) { other.id = 0; }
+	GlObject& operator=(GlObject&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			id = other.id;
+			memory = std::move(other.memory);
+			other.id = 0;
+		}
+		return *this;
+	}
+	GlObject(const GlObject&) = delete;
+	GlObject& operator=(const GlObject&) = delete;
+	~GlObject() { Reset(); }
+
+	static GlObject Create()
+	{
+		GlObject object;
+		if (Kind == GL_OBJECT_BUFFER)
+			glGenBuffers(1, &object.id);
+		else if (Kind == GL_OBJECT_VERTEX_ARRAY)
+			glGenVertexArrays(1, &object.id);
+		else
+			glGenTextures(1, &object.id);
+		return object;
+	}
+
+	//takes over a name created elsewhere, e.g. by AssetWatcher::CreateTexture
+	static GlObject Adopt(unsigned int name)
+	{
+		GlObject object;
+		object.id = name;
+		return object;
+	}
+
+	unsigned int Id() const { return id; }
+	explicit operator bool() const { return id != 0; }
+
+	//what the object's storage holds now, replaces the previous size
+	void Track(MemoryCategory category, const std::string& owner, size_t bytes)
+	{
+		if (memory.Active())
+			memory.Resize(bytes);
+		else
+			memory = MemoryAllocation(category, owner, bytes);
+	}
+
+	void Reset()
+	{
+		if (id != 0)
+		{
+			if (Kind == GL_OBJECT_BUFFER)
+				glDeleteBuffers(1, &id);
+			else if (Kind == GL_OBJECT_VERTEX_ARRAY)
+				glDeleteVertexArrays(1, &id);
+			else
+				glDeleteTextures(1, &id);
+		}
+		id = 0;
+		memory.Reset();
+	}
+
+private:
+	unsigned int id;
+	MemoryAllocation memory;
+};
+
+typedef GlObject<GL_OBJECT_BUFFER> GlBuffer;
+typedef GlObject<GL_OBJECT_VERTEX_ARRAY> GlVertexArray;
+typedef GlObject<GL_OBJECT_TEXTURE> GlTexture;
+
+//bytes of an 8-bit texture with components channels, with or without its full mip chain
+inline size_t TextureBytes(int width, int height, int components, bool mipmaps)
+{
+	size_t bytes = 0;
+	for (int level = 0;; level++)
+	{
+		int levelWidth = width >> level, levelHeight = height >> level;
+		if (levelWidth == 0 && levelHeight == 0)
+			break;
+		bytes += (size_t)(levelWidth > 0 ? levelWidth : 1) * (levelHeight > 0 ? levelHeight : 1) * components;
+		if (!mipmaps)
+			break;
+	}
+	return bytes;
+}
+
+#endif
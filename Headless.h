@@ -0,0 +1,214 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "Camera.h"
+#include "MemoryRegistry.h"
+
+#include <iostream>
+#include <vector>
+
+//Windowless GL context for machines without a display or GPU. Uses an EGL
+//surfaceless context (Mesa's llvmpipe is enough); rendering goes to an FBO.
+class HeadlessContext
+{
+public:
+	HeadlessContext() : created(false)
+	{
+#ifndef _WIN32
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+#endif
+	}
+
+	//creates a 3.3 core context and makes it current, then loads GL through glad
+	bool Create()
+	{
+#ifndef _WIN32
+		//prefer the surfaceless platform so no X/Wayland server is needed at all
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		{
+			std::cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED: " << std::hex << eglGetError() << std::dec << std::endl;
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			std::cout << "ERROR::HEADLESS::EGL_OPENGL_API_UNAVAILABLE" << std::endl;
+			return false;
+		}
+
+		EGLint configAttribs[] = { EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config = 0;
+		EGLint numConfigs = 0;
+		eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+		EGLint contextAttribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			std::cout << "ERROR::HEADLESS::EGL_CONTEXT_FAILED: " << std::hex << eglGetError() << std::dec << std::endl;
+			return false;
+		}
+
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return false;
+		}
+		created = true;
+		std::cout << "HEADLESS::RENDERER " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+		return true;
+#else
+		std::cout << "ERROR::HEADLESS::EGL_NOT_AVAILABLE_ON_THIS_PLATFORM" << std::endl;
+		return false;
+#endif
+	}
+
+	void Destroy()
+	{
+#ifndef _WIN32
+		if (!created)
+			return;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		created = false;
+#endif
+	}
+
+private:
+	bool created;
+#ifndef _WIN32
+	EGLDisplay display;
+	EGLContext context;
+#endif
+};
+
+//Color + depth framebuffer the headless mode renders into and reads back from
+class OffscreenTarget
+{
+public:
+	int Width;
+	int Height;
+
+	OffscreenTarget() : Width(0), Height(0), FBO(0), colorRBO(0), depthRBO(0) {}
+
+	bool Create(int width, int height)
+	{
+		if (width < 1 || height < 1)
+		{
+			std::cout << "ERROR::HEADLESS::INVALID_SIZE: " << width << "x" << height << std::endl;
+			return false;
+		}
+		Width = width;
+		Height = height;
+
+		glGenFramebuffers(1, &FBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+		glGenRenderbuffers(1, &colorRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+		glGenRenderbuffers(1, &depthRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		pixels.resize((size_t)width * height * 4);
+		//RGBA8 color and 24+8 depth
+		memory = MemoryAllocation(MEMORY_RENDER_TARGETS, "offscreen", (size_t)width * height * 8);
+		return complete;
+	}
+
+	void Bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glViewport(0, 0, Width, Height);
+	}
+
+	//reads the color buffer back (this synchronizes with the GPU) and returns its FNV-1a hash
+	unsigned long long ReadAndHash()
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		return HashBytes(pixels.data(), pixels.size());
+	}
+
+	const std::vector<unsigned char>& GetPixels() const { return pixels; }
+
+	unsigned int Framebuffer() const { return FBO; }
+
+	void Destroy()
+	{
+		glDeleteRenderbuffers(1, &colorRBO);
+		glDeleteRenderbuffers(1, &depthRBO);
+		glDeleteFramebuffers(1, &FBO);
+		FBO = colorRBO = depthRBO = 0;
+		memory.Reset();
+	}
+
+	static unsigned long long HashBytes(const unsigned char* data, size_t size, unsigned long long hash = 14695981039346656037ull)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+private:
+	unsigned int FBO, colorRBO, depthRBO;
+	std::vector<unsigned char> pixels;
+	MemoryAllocation memory;
+};
+
+//Deterministic camera path for benchmark runs: one orbit around the model's
+//bounding sphere with a gentle rise and fall, parameterized by frame number only.
+class CameraPath
+{
+public:
+	CameraPath(glm::vec3 center, float radius) : center(center), radius(radius > 0.0f ? radius : 1.0f) {}
+
+	void Apply(Camera& camera, int frame, int frameCount) const
+	{
+		float t = frameCount > 1 ? (float)frame / (float)(frameCount - 1) : 0.0f;
+		float angle = t * 2.0f * 3.14159265f;
+		float distance = radius * 2.5f;
+		float height = radius * 0.5f * (float)sin(angle * 2.0f);
+		glm::vec3 position = center + glm::vec3((float)cos(angle) * distance, height, (float)sin(angle) * distance);
+		camera.PointAt(position, center);
+	}
+
+private:
+	glm::vec3 center;
+	float radius;
+};
+
+#endif
@@ -0,0 +1,371 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "MemoryRegistry.h"
+#include "ObjLoader.h"
+#include "Profiler.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+//a run of triangles inside one material range with its object-space bounds,
+//the unit the occlusion test accepts or rejects
+struct MeshCluster {
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+enum class ClusterVisibility { Visible, OutsideFrustum, Occluded };
+
+//clusters of one material range: ObjMesh::ranges[i] owns clusters [first, first + count)
+struct ClusterRange {
+	unsigned int firstCluster;
+	unsigned int clusterCount;
+};
+
+//cuts every material range into clusters of at most trianglesPerCluster triangles. the
+//loader keeps faces in file order, which exporters write roughly object by object, so
+//consecutive triangles are usually close together and the boxes stay tight
+inline void BuildClusters(const ObjMesh& mesh, unsigned int trianglesPerCluster, std::vector<MeshCluster>& clusters, std::vector<ClusterRange>& clusterRanges)
+{
+	PROFILE_ZONE("clusters.build", "import");
+	clusters.clear();
+	clusterRanges.clear();
+	unsigned int clusterIndices = std::max(1u, trianglesPerCluster) * 3;
+	for (const ObjMaterialRange& range : mesh.ranges)
+	{
+		ClusterRange clusterRange = { (unsigned int)clusters.size(), 0 };
+		for (unsigned int offset = 0; offset < range.indexCount; offset += clusterIndices)
+		{
+			MeshCluster cluster;
+			cluster.indexOffset = range.indexOffset + offset;
+			cluster.indexCount = std::min(clusterIndices, range.indexCount - offset);
+			cluster.boundsMin = glm::vec3(FLT_MAX);
+			cluster.boundsMax = glm::vec3(-FLT_MAX);
+			for (unsigned int i = 0; i < cluster.indexCount; i++)
+			{
+				const glm::vec3& position = mesh.vertices[mesh.indices[cluster.indexOffset + i]].Position;
+				cluster.boundsMin = glm::min(cluster.boundsMin, position);
+				cluster.boundsMax = glm::max(cluster.boundsMax, position);
+			}
+			clusters.push_back(cluster);
+			clusterRange.clusterCount++;
+		}
+		clusterRanges.push_back(clusterRange);
+	}
+	PROFILE_COUNTER("clusters.count", clusters.size());
+}
+
+//Hierarchical-Z buffer built from the finished frame's depth. Every mip level stores the
+//farthest depth of the texels below it, so a box whose nearest point is behind that value
+//is hidden. The test runs on the CPU against a small level read back through two PBOs.
+//A readback is mapped one frame after it was issued, so culling uses depth from two
+//frames back, reprojected with that frame's matrices, and never waits on the GPU.
+//Something that comes out from behind an occluder can show up a frame or two late.
+class HiZBuffer
+{
+public:
+	int Width;
+	int Height;
+
+	HiZBuffer() : Width(0), Height(0), depthFramebuffer(0), depthTexture(0), pyramidTexture(0), emptyVAO(0), levelCount(0), readLevel(0),
+		readWidth(0), readHeight(0), frameIndex(0), hasDepth(false) { pixelBuffers[0] = pixelBuffers[1] = 0; pending[0] = pending[1] = false; }
+
+	bool Create(int width, int height)
+	{
+		copyShader.reset(new Shader("deferred_quad.vs", "hiz_copy.fs"));
+		downsampleShader.reset(new Shader("deferred_quad.vs", "hiz_downsample.fs"));
+		if (copyShader->ID == 0 || downsampleShader->ID == 0)
+			return false;
+		glGenVertexArrays(1, &emptyVAO);
+		glGenBuffers(2, pixelBuffers);
+		return Resize(width, height);
+	}
+
+	bool Resize(int width, int height)
+	{
+		if (width == Width && height == Height && depthFramebuffer != 0)
+			return true;
+		releaseTargets();
+		Width = width;
+		Height = height;
+
+		//depth lands here first, a blit needs a depth attachment of the source's format
+		glGenFramebuffers(1, &depthFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+		glGenTextures(1, &depthTexture);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		setNearest();
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+		//the pyramid, level 0 at full resolution
+		levelCount = 1;
+		while ((width >> levelCount) > 0 || (height >> levelCount) > 0)
+			levelCount++;
+		glGenTextures(1, &pyramidTexture);
+		glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+		for (int level = 0; level < levelCount; level++)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(1, width >> level), std::max(1, height >> level), 0, GL_RED, GL_FLOAT, NULL);
+		setNearest();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+		levelFramebuffers.resize(levelCount);
+		glGenFramebuffers(levelCount, levelFramebuffers.data());
+		for (int level = 0; level < levelCount; level++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[level]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, level);
+			complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (!complete)
+			std::cout << "ERROR::HIZ::FRAMEBUFFER_INCOMPLETE" << std::endl;
+
+		//read back the first level at most 160 texels wide, a few tens of KB per frame
+		readLevel = 0;
+		while ((width >> readLevel) > 160 && readLevel < levelCount - 1)
+			readLevel++;
+		readWidth = std::max(1, width >> readLevel);
+		readHeight = std::max(1, height >> readLevel);
+		for (int i = 0; i < 2; i++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)readWidth * readHeight * sizeof(float), NULL, GL_STREAM_READ);
+			pending[i] = false;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		//24+8 depth copy and the R32F pyramid, about a third over its first level
+		size_t pyramidBytes = 0;
+		for (int level = 0; level < levelCount; level++)
+			pyramidBytes += (size_t)std::max(1, width >> level) * std::max(1, height >> level) * sizeof(float);
+		targetMemory = MemoryAllocation(MEMORY_RENDER_TARGETS, "hiz", (size_t)width * height * 4 + pyramidBytes);
+		readbackMemory = MemoryAllocation(MEMORY_STREAMING_BUFFERS, "hiz", 2 * (size_t)readWidth * readHeight * sizeof(float));
+		hasDepth = false;
+		return complete;
+	}
+
+	//builds the pyramid from sourceFramebuffer's depth and starts reading it back. viewProjection
+	//is the matrix that frame was drawn with, later tests project boxes with it
+	void Build(unsigned int sourceFramebuffer, const glm::mat4& viewProjection)
+	{
+		//pick up the readback started last frame before reusing anything
+		int slot = (int)(frameIndex % 2);
+		int previous = 1 - slot;
+		if (pending[previous])
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[previous]);
+			const float* data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)readWidth * readHeight * sizeof(float), GL_MAP_READ_BIT);
+			if (data)
+			{
+				depth.assign(data, data + (size_t)readWidth * readHeight);
+				depthViewProjection = pendingViewProjection[previous];
+				hasDepth = true;
+			}
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			pending[previous] = false;
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+		glBlitFramebuffer(0, 0, Width, Height, 0, 0, Width, Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		glDisable(GL_DEPTH_TEST);
+		glBindVertexArray(emptyVAO);
+		glActiveTexture(GL_TEXTURE0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[0]);
+		glViewport(0, 0, Width, Height);
+		copyShader->use();
+		copyShader->setInt("depthTexture", 0);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		downsampleShader->use();
+		downsampleShader->setInt("previousLevel", 0);
+		glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+		for (int level = 1; level <= readLevel; level++)
+		{
+			//read only from the level above while writing this one
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+			glBindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[level]);
+			glViewport(0, 0, std::max(1, Width >> level), std::max(1, Height >> level));
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, levelFramebuffers[readLevel]);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, readWidth, readHeight, GL_RED, GL_FLOAT, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		pending[slot] = true;
+		pendingViewProjection[slot] = viewProjection;
+		frameIndex++;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, sourceFramebuffer);
+		glViewport(0, 0, Width, Height);
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+	}
+
+	//frustum test against this frame's viewProjection, then the occlusion test against the
+	//latest depth that finished reading back. boxes crossing the near plane of the depth
+	//frame and frames before any depth arrived are never occluded
+	ClusterVisibility Test(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model, const glm::mat4& viewProjection) const
+	{
+		glm::vec3 screenMin, screenMax;
+		if (projectBox(boundsMin, boundsMax, viewProjection * model, screenMin, screenMax) &&
+			(screenMax.x < -1.0f || screenMin.x > 1.0f || screenMax.y < -1.0f || screenMin.y > 1.0f || screenMin.z > 1.0f))
+			return ClusterVisibility::OutsideFrustum;
+		if (!hasDepth || !projectBox(boundsMin, boundsMax, depthViewProjection * model, screenMin, screenMax))
+			return ClusterVisibility::Visible;
+		if (screenMax.x < -1.0f || screenMin.x > 1.0f || screenMax.y < -1.0f || screenMin.y > 1.0f)
+			return ClusterVisibility::Visible;
+
+		//a texel of the read level holds the farthest depth below it, one texel in front of
+		//the box's nearest point means something of the box may show
+		int x0 = std::max(0, (int)((screenMin.x * 0.5f + 0.5f) * readWidth));
+		int x1 = std::min(readWidth - 1, (int)((screenMax.x * 0.5f + 0.5f) * readWidth));
+		int y0 = std::max(0, (int)((screenMin.y * 0.5f + 0.5f) * readHeight));
+		int y1 = std::min(readHeight - 1, (int)((screenMax.y * 0.5f + 0.5f) * readHeight));
+		float nearest = screenMin.z * 0.5f + 0.5f;
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				if (depth[(size_t)y * readWidth + x] >= nearest)
+					return ClusterVisibility::Visible;
+		return ClusterVisibility::Occluded;
+	}
+
+	//forget the depth read so far, for when culling was off and the frames in between were not recorded
+	void Invalidate()
+	{
+		hasDepth = false;
+		pending[0] = pending[1] = false;
+	}
+
+	//must run while the GL context is still current
+	void Destroy()
+	{
+		releaseTargets();
+		glDeleteBuffers(2, pixelBuffers);
+		glDeleteVertexArrays(1, &emptyVAO);
+		pixelBuffers[0] = pixelBuffers[1] = emptyVAO = 0;
+		readbackMemory.Reset();
+		copyShader.reset();
+		downsampleShader.reset();
+	}
+
+private:
+	unsigned int depthFramebuffer, depthTexture, pyramidTexture, emptyVAO;
+	std::vector<unsigned int> levelFramebuffers;
+	int levelCount, readLevel, readWidth, readHeight;
+	unsigned int pixelBuffers[2];
+	MemoryAllocation targetMemory, readbackMemory;
+	bool pending[2];
+	glm::mat4 pendingViewProjection[2];
+	unsigned long long frameIndex;
+	std::vector<float> depth;
+	glm::mat4 depthViewProjection;
+	bool hasDepth;
+	std::unique_ptr<Shader> copyShader;
+	std::unique_ptr<Shader> downsampleShader;
+
+	//NDC bounds of the box's corners, false when a corner is behind the eye
+	static bool projectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform, glm::vec3& screenMin, glm::vec3& screenMax)
+	{
+		screenMin = glm::vec3(FLT_MAX);
+		screenMax = glm::vec3(-FLT_MAX);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+			glm::vec4 clip = transform * glm::vec4(point, 1.0f);
+			if (clip.w <= 0.0f)
+				return false;
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			screenMin = glm::min(screenMin, ndc);
+			screenMax = glm::max(screenMax, ndc);
+		}
+		return true;
+	}
+
+	static void setNearest()
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	void releaseTargets()
+	{
+		if (!levelFramebuffers.empty())
+			glDeleteFramebuffers((GLsizei)levelFramebuffers.size(), levelFramebuffers.data());
+		levelFramebuffers.clear();
+		glDeleteFramebuffers(1, &depthFramebuffer);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &pyramidTexture);
+		depthFramebuffer = depthTexture = pyramidTexture = 0;
+		targetMemory.Reset();
+	}
+};
+
+//GL_SAMPLES_PASSED around a pass, read two frames later like the FrameProfiler timers,
+//counts the fragments that survived the depth test, i.e. the fragments that were shaded
+class FragmentCounter
+{
+public:
+	FragmentCounter() : Last(0), frameIndex(0) { queries[0] = queries[1] = 0; issued[0] = issued[1] = false; }
+
+	//most recent result, two frames old
+	unsigned long long Last;
+
+	void Begin()
+	{
+		if (queries[0] == 0)
+			glGenQueries(2, queries);
+		int slot = (int)(frameIndex % 2);
+		if (issued[slot])
+		{
+			GLuint64 samples = 0;
+			glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &samples);
+			Last = samples;
+			issued[slot] = false;
+		}
+		glBeginQuery(GL_SAMPLES_PASSED, queries[slot]);
+	}
+
+	void End()
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		issued[frameIndex % 2] = true;
+		frameIndex++;
+	}
+
+	void Release()
+	{
+		glDeleteQueries(2, queries);
+		queries[0] = queries[1] = 0;
+	}
+
+private:
+	unsigned int queries[2];
+	bool issued[2];
+	unsigned long long frameIndex;
+};
+
+#endif
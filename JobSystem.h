@@ -0,0 +1,380 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//state of one scheduled job, only used through a JobHandle. pending counts the unfinished
+//dependencies, continuations are the jobs waiting for this one
+struct Job {
+	std::function<void()> work;
+	bool mainThread = false;
+	std::atomic<int> pending{ 1 };
+	std::atomic<bool> done{ false };
+	std::mutex mutex;
+	std::vector<std::shared_ptr<Job>> continuations;
+};
+
+typedef std::shared_ptr<Job> JobHandle;
+
+//per thread scheduler counters, index 0 is the main thread
+struct JobStats {
+	unsigned long long jobs;
+	unsigned long long steals;
+	//Wait() calls made on the thread
+	unsigned long long waits;
+	double idleMilliseconds;
+	size_t maxQueueDepth;
+};
+
+//Work-stealing job scheduler shared by import and per-frame work. Every thread owns a
+//deque: it pushes and pops its own jobs at the back, and threads that run out of work
+//steal from the front of the others. A job starts once all its dependencies finished, so
+//continuations are just jobs that depend on another one. Jobs scheduled with ScheduleMain()
+//only ever run on the main thread (the one that created the system), for GL calls. They
+//run inside Wait() or RunMainThreadJobs(). Waiting threads run other jobs meanwhile.
+class JobSystem
+{
+public:
+	//the shared instance, created by the first call, which must come from the main thread
+	static JobSystem& Get()
+	{
+		static JobSystem instance;
+		return instance;
+	}
+
+	//workerCount 0 starts one worker per hardware thread besides the main thread
+	explicit JobSystem(unsigned int workerCount = 0) : running(true), queued(0), mainQueued(0), mainThreadId(std::this_thread::get_id())
+	{
+		if (workerCount == 0)
+			workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		for (unsigned int i = 0; i <= workerCount; i++)
+			queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+		currentThread() = ThreadSlot{ this, 0 };
+		for (unsigned int i = 1; i <= workerCount; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			running = false;
+		}
+		sleeping.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	//runs work on any thread once every dependency finished
+	JobHandle Schedule(std::function<void()> work, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>())
+	{
+		return submit(std::move(work), false, dependencies);
+	}
+
+	//runs work on the main thread once every dependency finished
+	JobHandle ScheduleMain(std::function<void()> work, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>())
+	{
+		return submit(std::move(work), true, dependencies);
+	}
+
+	//splits [0, count) into chunks of at least grain items. the handle finishes with the last chunk
+	JobHandle ParallelFor(size_t count, size_t grain, std::function<void(size_t, size_t)> body, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>())
+	{
+		size_t threads = queues.size();
+		size_t chunk = std::max<size_t>(std::max<size_t>(grain, 1), (count + threads * 4 - 1) / (threads * 4));
+		std::shared_ptr<std::function<void(size_t, size_t)>> shared = std::make_shared<std::function<void(size_t, size_t)>>(std::move(body));
+		std::vector<JobHandle> chunks;
+		for (size_t begin = 0; begin < count; begin += chunk)
+		{
+			size_t end = std::min(count, begin + chunk);
+			chunks.push_back(Schedule([shared, begin, end]() { (*shared)(begin, end); }, dependencies));
+		}
+		return Schedule([]() {}, chunks.empty() ? dependencies : chunks);
+	}
+
+	//runs jobs until handle finished. the main thread also runs main-thread jobs here
+	void Wait(const JobHandle& handle)
+	{
+		ThreadSlot& slot = currentThread();
+		int index = slot.system == this ? slot.index : 0;
+		queues[index]->waits++;
+		bool onMain = std::this_thread::get_id() == mainThreadId;
+		while (handle && !handle->done)
+		{
+			if (onMain && runMainJob())
+				continue;
+			JobHandle job = findJob(index);
+			if (job)
+			{
+				execute(job, index);
+				continue;
+			}
+			//everything left is running on other threads, sleep until one of them finishes
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			{
+				std::unique_lock<std::mutex> lock(progressMutex);
+				progress.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+					return handle->done || queued > 0 || (onMain && mainQueued > 0);
+				});
+			}
+			queues[index]->idleMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+
+	//runs the main-thread jobs that are ready, call once per frame from the main thread
+	void RunMainThreadJobs()
+	{
+		while (runMainJob())
+			;
+	}
+
+	size_t ThreadCount() const { return queues.size(); }
+
+	std::vector<JobStats> Stats() const
+	{
+		std::vector<JobStats> stats;
+		for (const std::unique_ptr<WorkerQueue>& queue : queues)
+		{
+			JobStats entry = { queue->executed.load(), queue->steals.load(), queue->waits.load(), queue->idleMicroseconds.load() / 1000.0, queue->maxDepth.load() };
+			stats.push_back(entry);
+		}
+		return stats;
+	}
+
+	size_t MaxMainQueueDepth() const { return maxMainDepth; }
+
+	void ResetStats()
+	{
+		for (std::unique_ptr<WorkerQueue>& queue : queues)
+		{
+			queue->executed = 0;
+			queue->steals = 0;
+			queue->waits = 0;
+			queue->idleMicroseconds = 0;
+			queue->maxDepth = 0;
+		}
+		maxMainDepth = 0;
+	}
+
+	void PrintStats(const std::string& label) const
+	{
+		std::vector<JobStats> stats = Stats();
+		unsigned long long jobs = 0, steals = 0, waits = 0;
+		double idle = 0.0;
+		size_t depth = 0;
+		for (const JobStats& entry : stats)
+		{
+			jobs += entry.jobs;
+			steals += entry.steals;
+			waits += entry.waits;
+			idle += entry.idleMilliseconds;
+			depth = std::max(depth, entry.maxQueueDepth);
+		}
+		std::cout << "JOBS::" << label << " " << stats.size() << " threads, " << jobs << " jobs, " << steals << " steals, " << waits << " waits, " << idle
+			<< " ms idle, max queue depth " << depth << ", max main queue depth " << maxMainDepth << std::endl;
+	}
+
+private:
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<JobHandle> deque;
+		std::atomic<unsigned long long> executed{ 0 };
+		std::atomic<unsigned long long> steals{ 0 };
+		std::atomic<unsigned long long> waits{ 0 };
+		std::atomic<unsigned long long> idleMicroseconds{ 0 };
+		std::atomic<size_t> maxDepth{ 0 };
+	};
+
+	struct ThreadSlot {
+		JobSystem* system;
+		int index;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+	bool running;
+	std::atomic<int> queued;
+	std::atomic<int> mainQueued;
+	std::thread::id mainThreadId;
+
+	std::mutex mainMutex;
+	std::deque<JobHandle> mainJobs;
+	std::atomic<size_t> maxMainDepth{ 0 };
+
+	//idle workers sleep here until a job is queued
+	std::mutex sleepMutex;
+	std::condition_variable sleeping;
+	//waiting threads sleep here until a job finishes or is queued
+	std::mutex progressMutex;
+	std::condition_variable progress;
+
+	static ThreadSlot& currentThread()
+	{
+		thread_local ThreadSlot slot = { NULL, 0 };
+		return slot;
+	}
+
+	static void raise(std::atomic<size_t>& maximum, size_t value)
+	{
+		size_t current = maximum.load();
+		while (value > current && !maximum.compare_exchange_weak(current, value))
+			;
+	}
+
+	JobHandle submit(std::function<void()> work, bool mainThread, const std::vector<JobHandle>& dependencies)
+	{
+		JobHandle job = std::make_shared<Job>();
+		job->work = std::move(work);
+		job->mainThread = mainThread;
+		//pending starts at one so the job cannot start before every dependency is registered
+		for (const JobHandle& dependency : dependencies)
+		{
+			if (!dependency)
+				continue;
+			std::lock_guard<std::mutex> lock(dependency->mutex);
+			if (!dependency->done)
+			{
+				job->pending++;
+				dependency->continuations.push_back(job);
+			}
+		}
+		if (--job->pending == 0)
+			enqueue(job);
+		return job;
+	}
+
+	void enqueue(const JobHandle& job)
+	{
+		if (job->mainThread)
+		{
+			std::lock_guard<std::mutex> lock(mainMutex);
+			mainJobs.push_back(job);
+			mainQueued++;
+			raise(maxMainDepth, mainJobs.size());
+		}
+		else
+		{
+			//a worker keeps what it spawns, other threads hand work to the main thread's deque
+			ThreadSlot& slot = currentThread();
+			WorkerQueue& queue = *queues[slot.system == this ? slot.index : 0];
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.deque.push_back(job);
+				raise(queue.maxDepth, queue.deque.size());
+			}
+			queued++;
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			sleeping.notify_one();
+		}
+		{
+			std::lock_guard<std::mutex> lock(progressMutex);
+		}
+		progress.notify_all();
+	}
+
+	//own deque newest first, then the oldest job of another thread
+	JobHandle findJob(int index)
+	{
+		if (queued == 0)
+			return JobHandle();
+		{
+			WorkerQueue& own = *queues[index];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.deque.empty())
+			{
+				JobHandle job = own.deque.back();
+				own.deque.pop_back();
+				queued--;
+				return job;
+			}
+		}
+		for (size_t offset = 1; offset < queues.size(); offset++)
+		{
+			WorkerQueue& victim = *queues[(index + offset) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.deque.empty())
+			{
+				JobHandle job = victim.deque.front();
+				victim.deque.pop_front();
+				queued--;
+				queues[index]->steals++;
+				return job;
+			}
+		}
+		return JobHandle();
+	}
+
+	bool runMainJob()
+	{
+		JobHandle job;
+		{
+			std::lock_guard<std::mutex> lock(mainMutex);
+			if (mainJobs.empty())
+				return false;
+			job = mainJobs.front();
+			mainJobs.pop_front();
+			mainQueued--;
+		}
+		execute(job, 0);
+		return true;
+	}
+
+	void execute(const JobHandle& job, int index)
+	{
+		job->work();
+		job->work = nullptr;
+		queues[index]->executed++;
+		std::vector<JobHandle> continuations;
+		{
+			std::lock_guard<std::mutex> lock(job->mutex);
+			job->done = true;
+			continuations.swap(job->continuations);
+		}
+		for (const JobHandle& continuation : continuations)
+		{
+			if (--continuation->pending == 0)
+				enqueue(continuation);
+		}
+		{
+			std::lock_guard<std::mutex> lock(progressMutex);
+		}
+		progress.notify_all();
+	}
+
+	void workerLoop(int index)
+	{
+		currentThread() = ThreadSlot{ this, index };
+		WorkerQueue& queue = *queues[index];
+		while (true)
+		{
+			JobHandle job = findJob(index);
+			if (job)
+			{
+				execute(job, index);
+				continue;
+			}
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			{
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleeping.wait(lock, [&]() { return !running || queued > 0; });
+				if (!running)
+					return;
+			}
+			queue.idleMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+};
+
+#endif
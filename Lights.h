@@ -0,0 +1,112 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//Light descriptions shared by the forward shader and the deferred renderer, so both
+//paths light the scene from the same data
+
+struct DirectionalLightSource {
+	glm::vec3 direction;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+};
+
+struct PointLightSource {
+	glm::vec3 position;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	float constant;
+	float linear;
+	float quadratic;
+};
+
+struct SpotLightSource {
+	bool enabled;
+	glm::vec3 position;
+	glm::vec3 direction;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	float constant;
+	float linear;
+	float quadratic;
+	float cutOff;
+	float outerCutOff;
+};
+
+//std140 layout of one entry of shader.fs's PointLights uniform block
+struct PointLightBlock {
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float padding;
+};
+
+inline PointLightBlock ToBlock(const PointLightSource& light)
+{
+	PointLightBlock block = { light.position, light.constant, light.ambient, light.linear, light.diffuse, light.quadratic, light.specular, 0.0f };
+	return block;
+}
+
+struct SceneLights {
+	DirectionalLightSource dirLight;
+	SpotLightSource spotLight;
+	std::vector<PointLightSource> pointLights;
+};
+
+//distance at which a point light's brightest channel drops below one 8-bit step,
+//past it the light contributes nothing visible, which bounds its light volume
+inline float PointLightRadius(const PointLightSource& light)
+{
+	float brightest = std::max(std::max(light.diffuse.x, light.diffuse.y), light.diffuse.z);
+	brightest = std::max(brightest, std::max(std::max(light.specular.x, light.specular.y), light.specular.z));
+	brightest = std::max(brightest, std::max(std::max(light.ambient.x, light.ambient.y), light.ambient.z));
+	float target = brightest * 256.0f;
+	if (target <= light.constant)
+		return 0.0f;
+	if (light.quadratic <= 0.0f)
+		return light.linear > 0.0f ? (target - light.constant) / light.linear : 1.0e6f;
+	return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * (light.constant - target))) / (2.0f * light.quadratic);
+}
+
+//count colored point lights spread over a few rings around the model. deterministic,
+//so light-count benchmarks render the same frames on every run
+inline std::vector<PointLightSource> MakeLightRing(size_t count, glm::vec3 center, float radius)
+{
+	std::vector<PointLightSource> lights;
+	lights.reserve(count);
+	radius = radius > 0.0f ? radius : 1.0f;
+	//each light reaches about half the model, a couple of hundred lights still overlap well
+	float reach = radius * 0.6f;
+	for (size_t i = 0; i < count; i++)
+	{
+		float t = (float)i / (float)std::max<size_t>(count, 1);
+		float angle = t * 6.2831853f * 7.0f;
+		float height = (std::fmod(t * 5.0f, 1.0f) - 0.5f) * radius * 1.6f;
+		float ring = radius * (0.9f + 0.4f * std::fmod(t * 3.0f, 1.0f));
+		glm::vec3 color = glm::vec3(0.5f + 0.5f * std::cos(angle), 0.5f + 0.5f * std::cos(angle + 2.094f), 0.5f + 0.5f * std::cos(angle + 4.189f));
+		PointLightSource light;
+		light.position = center + glm::vec3(std::cos(angle) * ring, height, std::sin(angle) * ring);
+		light.ambient = glm::vec3(0.0f);
+		light.diffuse = color * 0.8f;
+		light.specular = color;
+		light.constant = 1.0f;
+		light.linear = 0.0f;
+		light.quadratic = 255.0f / (reach * reach);
+		lights.push_back(light);
+	}
+	return lights;
+}
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef MEMORY_REGISTRY_H
+#define MEMORY_REGISTRY_H
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//what an allocation holds. the GPU side is counted as the bytes the driver was asked to
+//store (width * height * bytes per texel per level, buffer sizes), not what it really
+//reserves with padding and alignment
+enum MemoryCategory {
+	MEMORY_VERTEX_BUFFERS,
+	MEMORY_INDEX_BUFFERS,
+	MEMORY_TEXTURES,
+	MEMORY_RENDER_TARGETS,
+	MEMORY_STREAMING_BUFFERS,
+	//CPU copies of geometry kept after upload, for picking, culling and reloads
+	MEMORY_MESH_DATA,
+	MEMORY_CATEGORY_COUNT
+};
+
+inline const char* MemoryCategoryName(MemoryCategory category)
+{
+	static const char* names[MEMORY_CATEGORY_COUNT] = { "vertex_buffers", "index_buffers", "textures", "render_targets", "streaming_buffers", "mesh_data" };
+	return names[category];
+}
+
+//Live bytes of every GPU object and long-lived CPU buffer, by category and by owner (the
+//model path, or the subsystem for render targets and the like). Allocations are added and
+//removed through MemoryAllocation, which GlObject holds, so whatever is still registered
+//when the owners are gone was never released. Thread-safe, texture decodes register from
+//workers.
+class MemoryRegistry
+{
+public:
+	static MemoryRegistry& Get()
+	{
+		static MemoryRegistry instance;
+		return instance;
+	}
+
+	//0 is never returned, it stands for no allocation
+	unsigned long long Add(MemoryCategory category, const std::string& owner, size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned long long id = nextId++;
+		Record record = { category, owner, 0 };
+		records.emplace(id, record);
+		resize(records[id], bytes);
+		return id;
+	}
+
+	void Resize(unsigned long long id, size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<unsigned long long, Record>::iterator itr = records.find(id);
+		if (itr != records.end())
+			resize(itr->second, bytes);
+	}
+
+	void Remove(unsigned long long id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<unsigned long long, Record>::iterator itr = records.find(id);
+		if (itr == records.end())
+			return;
+		resize(itr->second, 0);
+		records.erase(itr);
+	}
+
+	//prints a warning each time the live total goes above bytes, 0 turns it off
+	void SetLimit(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		limit = bytes;
+		overLimit = false;
+	}
+
+	size_t LiveBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return live;
+	}
+
+	size_t LiveBytes(MemoryCategory category) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return categoryLive[category];
+	}
+
+	size_t PeakBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return peak;
+	}
+
+	size_t AllocationCount() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return records.size();
+	}
+
+	//live bytes per owner, largest first
+	std::vector<std::pair<std::string, size_t>> OwnerBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, size_t> owners;
+		for (const std::pair<const unsigned long long, Record>& entry : records)
+			owners[entry.second.owner] += entry.second.bytes;
+		std::vector<std::pair<std::string, size_t>> sorted(owners.begin(), owners.end());
+		std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) {
+			return a.second > b.second;
+		});
+		return sorted;
+	}
+
+	void PrintStats(const std::string& label) const
+	{
+		std::vector<std::pair<std::string, size_t>> owners = OwnerBytes();
+		std::lock_guard<std::mutex> lock(mutex);
+		std::cout << label << "::MEMORY live " << live << " bytes in " << records.size() << " allocations, peak " << peak << std::endl;
+		for (int category = 0; category < MEMORY_CATEGORY_COUNT; category++)
+		{
+			std::cout << label << "::MEMORY " << std::left << std::setw(18) << MemoryCategoryName((MemoryCategory)category) << std::right
+				<< " live " << std::setw(10) << categoryLive[category] << " peak " << std::setw(10) << categoryPeak[category] << std::endl;
+		}
+		for (const std::pair<std::string, size_t>& owner : owners)
+			std::cout << label << "::MEMORY owner " << owner.first << " " << owner.second << std::endl;
+	}
+
+	//to be called once every owner released what it had, prints each allocation that is
+	//still registered and returns their count
+	size_t ReportLeaks() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::pair<unsigned long long, Record>> leaks(records.begin(), records.end());
+		std::sort(leaks.begin(), leaks.end(), [](const std::pair<unsigned long long, Record>& a, const std::pair<unsigned long long, Record>& b) {
+			return a.first < b.first;
+		});
+		for (const std::pair<unsigned long long, Record>& leak : leaks)
+		{
+			std::cout << "MEMORY::LEAK " << MemoryCategoryName(leak.second.category) << " " << leak.second.owner << " " << leak.second.bytes
+				<< " bytes" << std::endl;
+		}
+		std::cout << "MEMORY::SHUTDOWN " << leaks.size() << " leaked allocations, " << live << " bytes, peak " << peak << std::endl;
+		return leaks.size();
+	}
+
+private:
+	struct Record {
+		MemoryCategory category;
+		std::string owner;
+		size_t bytes;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<unsigned long long, Record> records;
+	unsigned long long nextId = 1;
+	size_t live = 0;
+	size_t peak = 0;
+	size_t categoryLive[MEMORY_CATEGORY_COUNT] = {};
+	size_t categoryPeak[MEMORY_CATEGORY_COUNT] = {};
+	size_t limit = 0;
+	bool overLimit = false;
+
+	void resize(Record& record, size_t bytes)
+	{
+		live = live - record.bytes + bytes;
+		categoryLive[record.category] = categoryLive[record.category] - record.bytes + bytes;
+		record.bytes = bytes;
+		peak = std::max(peak, live);
+		categoryPeak[record.category] = std::max(categoryPeak[record.category], categoryLive[record.category]);
+		//warn on the way up only, once per crossing
+		if (limit > 0 && live > limit && !overLimit)
+			std::cout << "WARNING::MEMORY::OVER_LIMIT " << live << " of " << limit << " bytes, " << record.owner << " grew to " << bytes << std::endl;
+		overLimit = limit > 0 && live > limit;
+	}
+};
+
+//one registry entry that goes away with the object holding it. move-only
+class MemoryAllocation
+{
+public:
+	MemoryAllocation() : id(0) {}
+	MemoryAllocation(MemoryCategory category, const std::string& owner, size_t bytes) : id(MemoryRegistry::Get().Add(category, owner, bytes)) {}
+	MemoryAllocation(MemoryAllocation&& other) noexcept : id(other.id) { other.id = 0; }
+	MemoryAllocation& operator=(MemoryAllocation&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			id = other.id;
+			other.id = 0;
+		}
+		return *this;
+	}
+	MemoryAllocation(const MemoryAllocation&) = delete;
+	MemoryAllocation& operator=(const MemoryAllocation&) = delete;
+	~MemoryAllocation() { Reset(); }
+
+	bool Active() const { return id != 0; }
+
+	void Resize(size_t bytes)
+	{
+		if (id != 0)
+			MemoryRegistry::Get().Resize(id, bytes);
+	}
+
+	void Reset()
+	{
+		if (id != 0)
+			MemoryRegistry::Get().Remove(id);
+		id = 0;
+	}
+
+private:
+	unsigned long long id;
+};
+
+#endif
@@ -6,14 +6,18 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "Bvh.h"
+#include "GlObject.h"
+#include "MemoryRegistry.h"
 #include "Shader.h"
 #include <vector>
 #include <iostream>
 #include <string>
+#include <utility>
 
 struct Vertex {
 	glm::vec3 Position;
-	glm::vec2 Normal;
+	glm::vec3 Normal;
 	glm::vec2 TexCoords;
 };
 
@@ -24,21 +28,39 @@ struct Texture {
 };
 
 
+//owns its VAO and buffers, and registers them and its CPU copy of the geometry under
+//owner (the model's path). move-only: moving hands the GL objects over, copies are not
+//allowed since two Meshes deleting the same names would break the survivor
 class Mesh {
 public:
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	std::vector<Texture> textures;
+	//object space bounds, for culling
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, const std::string& owner = "meshes")
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		boundsMin = this->vertices.empty() ? glm::vec3(0.0f) : this->vertices[0].Position;
+		boundsMax = boundsMin;
+		for (const Vertex& vertex : this->vertices)
+		{
+			boundsMin = glm::min(boundsMin, vertex.Position);
+			boundsMax = glm::max(boundsMax, vertex.Position);
+		}
 
-		setupMesh();
+		setupMesh(owner);
 	}
 
+	Mesh(Mesh&&) = default;
+	Mesh& operator=(Mesh&&) = default;
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
 	void Draw(Shader& shader)
 	{
 		unsigned int diffuseNr = 1;
@@ -58,27 +80,42 @@ public:
 		}
 		glActiveTexture(GL_TEXTURE0);
 
-		glBindVertexArray(VAO);
+		glBindVertexArray(VAO.Id());
 		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
 		glBindVertexArray(0);
 	}
 
+	//object space triangle BVH for picking and overlap queries, built on first use
+	const MeshBvh& Bvh()
+	{
+		if (!bvh.Built())
+			bvh.Build(vertices, indices);
+		return bvh;
+	}
+
 private:
-	unsigned int VAO, VBO, EBO;
+	GlVertexArray VAO;
+	GlBuffer VBO, EBO;
+	MemoryAllocation cpuMemory;
+	MeshBvh bvh;
 
-	void setupMesh() 
+	void setupMesh(const std::string& owner)
 	{
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
+		VAO = GlVertexArray::Create();
+		VBO = GlBuffer::Create();
+		EBO = GlBuffer::Create();
 
-		glBindVertexArray(VAO);
+		glBindVertexArray(VAO.Id());
 
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO.Id());
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+		VBO.Track(MEMORY_VERTEX_BUFFERS, owner, vertices.size() * sizeof(Vertex));
 
-		glBindBuffer(GL_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		//bound while the VAO is, so the VAO keeps it as its index buffer
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.Id());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		EBO.Track(MEMORY_INDEX_BUFFERS, owner, indices.size() * sizeof(unsigned int));
+		cpuMemory = MemoryAllocation(MEMORY_MESH_DATA, owner, vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int));
 
 		//vertex positions
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
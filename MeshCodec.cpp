@@ -0,0 +1,957 @@
+#include "MeshCodec.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char MAGIC[4] = { 'O', 'B', 'J', 'Z' };
+const uint32_t VERSION = 1;
+const uint32_t FLAG_TANGENTS = 1;
+
+//16-bit channels per quantized vertex: position xyz, octahedral normal, texture coordinates
+//and one unused. tangents use the same layout: octahedral direction, then the sign
+const int CHANNELS = 8;
+const int PLANES = CHANNELS * 2;
+
+enum BlockMode : uint8_t { BLOCK_RAW = 0, BLOCK_CONSTANT = 1, BLOCK_RANS = 2 };
+
+//rANS with 12-bit frequencies, four interleaved 32-bit states renormalized a byte at a time
+const uint32_t PROB_BITS = 12;
+const uint32_t PROB_SCALE = 1u << PROB_BITS;
+const uint32_t RANS_LOW = 1u << 23;
+
+void put32(std::vector<unsigned char>& out, uint32_t value)
+{
+	unsigned char bytes[4];
+	memcpy(bytes, &value, 4);
+	out.insert(out.end(), bytes, bytes + 4);
+}
+
+void put64(std::vector<unsigned char>& out, uint64_t value)
+{
+	unsigned char bytes[8];
+	memcpy(bytes, &value, 8);
+	out.insert(out.end(), bytes, bytes + 8);
+}
+
+void putFloat(std::vector<unsigned char>& out, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	put32(out, bits);
+}
+
+void putVec3(std::vector<unsigned char>& out, const glm::vec3& value)
+{
+	putFloat(out, value.x);
+	putFloat(out, value.y);
+	putFloat(out, value.z);
+}
+
+void putString(std::vector<unsigned char>& out, const std::string& value)
+{
+	put32(out, (uint32_t)value.size());
+	out.insert(out.end(), value.begin(), value.end());
+}
+
+//bounds-checked reads over the container, ok turns false at the first read past the end
+struct Reader {
+	const unsigned char* p;
+	const unsigned char* end;
+	bool ok;
+
+	bool need(size_t bytes)
+	{
+		ok = ok && (size_t)(end - p) >= bytes;
+		return ok;
+	}
+	uint32_t get32()
+	{
+		uint32_t value = 0;
+		if (need(4))
+		{
+			memcpy(&value, p, 4);
+			p += 4;
+		}
+		return value;
+	}
+	uint64_t get64()
+	{
+		uint64_t value = 0;
+		if (need(8))
+		{
+			memcpy(&value, p, 8);
+			p += 8;
+		}
+		return value;
+	}
+	float getFloat()
+	{
+		uint32_t bits = get32();
+		float value;
+		memcpy(&value, &bits, 4);
+		return value;
+	}
+	glm::vec3 getVec3()
+	{
+		float x = getFloat(), y = getFloat();
+		return glm::vec3(x, y, getFloat());
+	}
+	std::string getString()
+	{
+		uint32_t length = get32();
+		if (!need(length))
+			return std::string();
+		std::string value((const char*)p, length);
+		p += length;
+		return value;
+	}
+};
+
+uint16_t quantize(float value, float minimum, float extent)
+{
+	if (!(extent > 0.0f))
+		return 0;
+	float q = (value - minimum) / extent * 65535.0f + 0.5f;
+	return (uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+}
+
+//unit vector to a point of the [-1, 1] square, the lower hemisphere folded over the diagonals
+glm::vec2 octEncode(glm::vec3 n)
+{
+	float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if (!(sum > 0.0f))
+		return glm::vec2(0.0f);
+	n /= sum;
+	if (n.z < 0.0f)
+		return glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+	return glm::vec2(n.x, n.y);
+}
+
+glm::vec3 octDecode(float x, float y)
+{
+	glm::vec3 n(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+	return length > 0.0f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f);
+}
+
+uint16_t octChannel(float value)
+{
+	return quantize(value, -1.0f, 2.0f);
+}
+
+//--- entropy stage ---
+
+void encodeRans(const uint8_t* in, size_t count, const uint32_t* counts, std::vector<unsigned char>& out)
+{
+	//frequencies summing to PROB_SCALE, every symbol present keeps at least 1
+	uint32_t freq[256], cum[257];
+	uint32_t total = 0;
+	for (int s = 0; s < 256; s++)
+	{
+		freq[s] = counts[s] == 0 ? 0 : std::max<uint32_t>(1, (uint32_t)((uint64_t)counts[s] * PROB_SCALE / count));
+		total += freq[s];
+	}
+	while (total != PROB_SCALE)
+	{
+		int largest = (int)(std::max_element(freq, freq + 256) - freq);
+		if (total < PROB_SCALE)
+		{
+			freq[largest] += PROB_SCALE - total;
+			total = PROB_SCALE;
+		}
+		else
+		{
+			//take from the largest one that can spare it
+			uint32_t spare = std::min(total - PROB_SCALE, freq[largest] - 1);
+			freq[largest] -= spare;
+			total -= spare;
+		}
+	}
+	cum[0] = 0;
+	int symbols = 0;
+	for (int s = 0; s < 256; s++)
+	{
+		cum[s + 1] = cum[s] + freq[s];
+		symbols += freq[s] > 0 ? 1 : 0;
+	}
+
+	out.push_back(BLOCK_RANS);
+	out.push_back((unsigned char)(symbols - 1));
+	for (int s = 0; s < 256; s++)
+	{
+		if (freq[s] == 0)
+			continue;
+		out.push_back((unsigned char)s);
+		out.push_back((unsigned char)(freq[s] & 0xff));
+		out.push_back((unsigned char)(freq[s] >> 8));
+	}
+
+	//symbols go in back to front, so the decoder reads the bytes front to back
+	std::vector<unsigned char> buffer(count * 2 + 16);
+	unsigned char* ptr = buffer.data() + buffer.size();
+	uint32_t state[4] = { RANS_LOW, RANS_LOW, RANS_LOW, RANS_LOW };
+	for (size_t i = count; i-- > 0;)
+	{
+		uint32_t& x = state[i & 3];
+		uint32_t f = freq[in[i]];
+		uint32_t limit = ((RANS_LOW >> PROB_BITS) << 8) * f;
+		while (x >= limit)
+		{
+			*--ptr = (unsigned char)(x & 0xff);
+			x >>= 8;
+		}
+		x = ((x / f) << PROB_BITS) + (x % f) + cum[in[i]];
+	}
+	for (int s = 3; s >= 0; s--)
+	{
+		ptr -= 4;
+		memcpy(ptr, &state[s], 4);
+	}
+	size_t length = buffer.data() + buffer.size() - ptr;
+	put32(out, (uint32_t)length);
+	out.insert(out.end(), ptr, ptr + length);
+}
+
+//the smallest of stored, constant and rANS
+void encodeBlock(const uint8_t* in, size_t count, std::vector<unsigned char>& out)
+{
+	uint32_t counts[256] = {};
+	for (size_t i = 0; i < count; i++)
+		counts[in[i]]++;
+	if (count == 0 || counts[in[0]] == count)
+	{
+		out.push_back(BLOCK_CONSTANT);
+		out.push_back(count == 0 ? 0 : in[0]);
+		return;
+	}
+	size_t start = out.size();
+	encodeRans(in, count, counts, out);
+	if (out.size() - start >= count + 1)
+	{
+		out.resize(start);
+		out.push_back(BLOCK_RAW);
+		out.insert(out.end(), in, in + count);
+	}
+}
+
+bool decodeBlock(Reader& reader, uint8_t* out, size_t count)
+{
+	if (!reader.need(1))
+		return false;
+	uint8_t mode = *reader.p++;
+	if (mode == BLOCK_CONSTANT)
+	{
+		if (!reader.need(1))
+			return false;
+		memset(out, *reader.p++, count);
+		return true;
+	}
+	if (mode == BLOCK_RAW)
+	{
+		if (!reader.need(count))
+			return false;
+		memcpy(out, reader.p, count);
+		reader.p += count;
+		return true;
+	}
+	if (mode != BLOCK_RANS || !reader.need(1))
+		return false;
+
+	//slot -> (frequency - 1) | cumulative << 12 | symbol << 24
+	uint32_t table[PROB_SCALE];
+	int symbols = *reader.p++ + 1;
+	if (!reader.need((size_t)symbols * 3))
+		return false;
+	uint32_t cum = 0;
+	for (int i = 0; i < symbols; i++)
+	{
+		uint32_t symbol = reader.p[0];
+		uint32_t freq = reader.p[1] | ((uint32_t)reader.p[2] << 8);
+		reader.p += 3;
+		if (freq == 0 || cum + freq > PROB_SCALE)
+			return false;
+		for (uint32_t slot = cum; slot < cum + freq; slot++)
+			table[slot] = (freq - 1) | (cum << 12) | (symbol << 24);
+		cum += freq;
+	}
+	if (cum != PROB_SCALE)
+		return false;
+	uint32_t length = reader.get32();
+	if (!reader.need(length) || length < 16)
+		return false;
+	const unsigned char* ptr = reader.p;
+	const unsigned char* end = reader.p + length;
+	uint32_t state[4];
+	memcpy(state, ptr, 16);
+	ptr += 16;
+	//the four states in registers, each step renormalizes by at most two bytes while the
+	//input lasts, so the bound check is hoisted out of the fast loop
+	uint32_t x0 = state[0], x1 = state[1], x2 = state[2], x3 = state[3];
+#define RANS_STEP(x, i) \
+	{ \
+		uint32_t entry = table[x & (PROB_SCALE - 1)]; \
+		out[i] = (uint8_t)(entry >> 24); \
+		x = ((entry & 0xfff) + 1) * (x >> PROB_BITS) + (x & (PROB_SCALE - 1)) - ((entry >> 12) & 0xfff); \
+	}
+#define RANS_RENORM_FAST(x) \
+	if (x < RANS_LOW) \
+	{ \
+		x = (x << 8) | *ptr++; \
+		if (x < RANS_LOW) \
+			x = (x << 8) | *ptr++; \
+	}
+	size_t i = 0;
+	for (; i + 4 <= count && end - ptr >= 8; i += 4)
+	{
+		RANS_STEP(x0, i);
+		RANS_STEP(x1, i + 1);
+		RANS_STEP(x2, i + 2);
+		RANS_STEP(x3, i + 3);
+		RANS_RENORM_FAST(x0);
+		RANS_RENORM_FAST(x1);
+		RANS_RENORM_FAST(x2);
+		RANS_RENORM_FAST(x3);
+	}
+	uint32_t* states[4] = { &x0, &x1, &x2, &x3 };
+	for (; i < count; i++)
+	{
+		uint32_t& x = *states[i & 3];
+		RANS_STEP(x, i);
+		while (x < RANS_LOW && ptr < end)
+			x = (x << 8) | *ptr++;
+	}
+#undef RANS_STEP
+#undef RANS_RENORM_FAST
+	reader.p = end;
+	return true;
+}
+
+//--- vertex streams ---
+
+//zigzagged deltas of records [begin, end), one byte plane after another
+void encodeRecords(const uint16_t* records, size_t count, std::vector<unsigned char>& out)
+{
+	std::vector<uint8_t> planes(count * PLANES);
+	uint16_t previous[CHANNELS] = {};
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			uint16_t value = records[i * CHANNELS + c];
+			int16_t delta = (int16_t)(uint16_t)(value - previous[c]);
+			uint16_t zigzag = (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+			planes[(c * 2) * count + i] = (uint8_t)(zigzag & 0xff);
+			planes[(c * 2 + 1) * count + i] = (uint8_t)(zigzag >> 8);
+			previous[c] = value;
+		}
+	}
+	for (int plane = 0; plane < PLANES; plane++)
+		encodeBlock(&planes[plane * count], count, out);
+}
+
+//planes back into records: interleave the byte pairs, transpose, undo zigzag and deltas
+void unfilterRecords(const uint8_t* planes, size_t count, uint16_t* records)
+{
+	size_t i = 0;
+#if SIMD_WIDTH > 1
+	__m128i sum = _mm_setzero_si128();
+	__m128i one = _mm_set1_epi16(1);
+	for (; i + 8 <= count; i += 8)
+	{
+		//w[c] holds channel c of the 8 vertices, t[v] all channels of vertex v
+		__m128i w[CHANNELS];
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			__m128i low = _mm_loadl_epi64((const __m128i*)(planes + (c * 2) * count + i));
+			__m128i high = _mm_loadl_epi64((const __m128i*)(planes + (c * 2 + 1) * count + i));
+			w[c] = _mm_unpacklo_epi8(low, high);
+		}
+		__m128i a0 = _mm_unpacklo_epi16(w[0], w[1]), a1 = _mm_unpackhi_epi16(w[0], w[1]);
+		__m128i a2 = _mm_unpacklo_epi16(w[2], w[3]), a3 = _mm_unpackhi_epi16(w[2], w[3]);
+		__m128i a4 = _mm_unpacklo_epi16(w[4], w[5]), a5 = _mm_unpackhi_epi16(w[4], w[5]);
+		__m128i a6 = _mm_unpacklo_epi16(w[6], w[7]), a7 = _mm_unpackhi_epi16(w[6], w[7]);
+		__m128i b0 = _mm_unpacklo_epi32(a0, a2), b1 = _mm_unpackhi_epi32(a0, a2);
+		__m128i b2 = _mm_unpacklo_epi32(a1, a3), b3 = _mm_unpackhi_epi32(a1, a3);
+		__m128i b4 = _mm_unpacklo_epi32(a4, a6), b5 = _mm_unpackhi_epi32(a4, a6);
+		__m128i b6 = _mm_unpacklo_epi32(a5, a7), b7 = _mm_unpackhi_epi32(a5, a7);
+		__m128i t[8] = {
+			_mm_unpacklo_epi64(b0, b4), _mm_unpackhi_epi64(b0, b4), _mm_unpacklo_epi64(b1, b5), _mm_unpackhi_epi64(b1, b5),
+			_mm_unpacklo_epi64(b2, b6), _mm_unpackhi_epi64(b2, b6), _mm_unpacklo_epi64(b3, b7), _mm_unpackhi_epi64(b3, b7)
+		};
+		for (int v = 0; v < 8; v++)
+		{
+			__m128i delta = _mm_xor_si128(_mm_srli_epi16(t[v], 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(t[v], one)));
+			sum = _mm_add_epi16(sum, delta);
+			_mm_storeu_si128((__m128i*)(records + (i + v) * CHANNELS), sum);
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			uint16_t zigzag = (uint16_t)(planes[(c * 2) * count + i] | (planes[(c * 2 + 1) * count + i] << 8));
+			uint16_t delta = (uint16_t)((zigzag >> 1) ^ (uint16_t)-(int)(zigzag & 1));
+			uint16_t previous = i == 0 ? 0 : records[(i - 1) * CHANNELS + c];
+			records[i * CHANNELS + c] = (uint16_t)(previous + delta);
+		}
+	}
+}
+
+//dequantizes records into vertices: the position and texture coordinate channels with a
+//multiply-add each, the octahedral pair with octDecode
+void dequantizeVertices(const uint16_t* records, size_t count, const MeshContainerInfo& info, ObjVertex* vertices)
+{
+	glm::vec3 extent = (info.boundsMax - info.boundsMin) / 65535.0f;
+	glm::vec2 texcoordExtent = (info.texcoordMax - info.texcoordMin) / 65535.0f;
+#if SIMD_WIDTH > 1
+	__m128 scale0 = _mm_setr_ps(extent.x, extent.y, extent.z, 2.0f / 65535.0f);
+	__m128 offset0 = _mm_setr_ps(info.boundsMin.x, info.boundsMin.y, info.boundsMin.z, -1.0f);
+	__m128 scale1 = _mm_setr_ps(2.0f / 65535.0f, texcoordExtent.x, texcoordExtent.y, 0.0f);
+	__m128 offset1 = _mm_setr_ps(-1.0f, info.texcoordMin.x, info.texcoordMin.y, 0.0f);
+	__m128i zero = _mm_setzero_si128();
+	for (size_t i = 0; i < count; i++)
+	{
+		__m128i q = _mm_loadu_si128((const __m128i*)(records + i * CHANNELS));
+		__m128 low = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(q, zero)), scale0), offset0);
+		__m128 high = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(q, zero)), scale1), offset1);
+		float lanes[8];
+		_mm_storeu_ps(lanes, low);
+		_mm_storeu_ps(lanes + 4, high);
+		ObjVertex& vertex = vertices[i];
+		vertex.Position = glm::vec3(lanes[0], lanes[1], lanes[2]);
+		vertex.Normal = octDecode(lanes[3], lanes[4]);
+		vertex.TexCoords = glm::vec2(lanes[5], lanes[6]);
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint16_t* q = records + i * CHANNELS;
+		ObjVertex& vertex = vertices[i];
+		vertex.Position = info.boundsMin + glm::vec3(q[0], q[1], q[2]) * extent;
+		vertex.Normal = octDecode(q[3] * (2.0f / 65535.0f) - 1.0f, q[4] * (2.0f / 65535.0f) - 1.0f);
+		vertex.TexCoords = info.texcoordMin + glm::vec2(q[5], q[6]) * texcoordExtent;
+	}
+#endif
+}
+
+void dequantizeTangents(const uint16_t* records, size_t count, glm::vec4* tangents)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint16_t* q = records + i * CHANNELS;
+		glm::vec3 direction = octDecode(q[0] * (2.0f / 65535.0f) - 1.0f, q[1] * (2.0f / 65535.0f) - 1.0f);
+		tangents[i] = glm::vec4(direction, q[2] ? -1.0f : 1.0f);
+	}
+}
+
+//--- index stream ---
+
+void encodeIndices(const unsigned int* indices, size_t count, std::vector<unsigned char>& out)
+{
+	std::vector<uint8_t> varints;
+	varints.reserve(count * 2);
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		int32_t delta = (int32_t)(indices[i] - previous);
+		uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+		while (zigzag >= 0x80)
+		{
+			varints.push_back((uint8_t)(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		varints.push_back((uint8_t)zigzag);
+		previous = indices[i];
+	}
+	put32(out, (uint32_t)varints.size());
+	encodeBlock(varints.data(), varints.size(), out);
+}
+
+bool decodeIndices(Reader& reader, unsigned int* indices, size_t count)
+{
+	uint32_t length = reader.get32();
+	if (!reader.ok || length > count * 5)
+		return false;
+	std::vector<uint8_t> varints(length);
+	if (!decodeBlock(reader, varints.data(), length))
+		return false;
+	const uint8_t* p = varints.data();
+	const uint8_t* end = p + length;
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		//most deltas fit in one byte
+		uint32_t zigzag = 0;
+		int shift = 0;
+		if (p != end && *p < 0x80)
+			zigzag = *p++;
+		else do
+		{
+			if (p == end || shift > 28)
+				return false;
+			zigzag |= (uint32_t)(*p & 0x7f) << shift;
+			shift += 7;
+		} while (*p++ & 0x80);
+		previous += (zigzag >> 1) ^ (uint32_t)-(int32_t)(zigzag & 1);
+		indices[i] = previous;
+	}
+	return p == end;
+}
+
+//--- container ---
+
+size_t chunkCount(size_t count, size_t perChunk)
+{
+	return (count + perChunk - 1) / perChunk;
+}
+
+//everything before the chunk table. materials, ranges and counts are skipped when NULL
+bool readHeader(Reader& reader, MeshContainerInfo& info, ObjMesh* mesh)
+{
+	if (!reader.need(4) || memcmp(reader.p, MAGIC, 4) != 0)
+	{
+		std::cout << "ERROR::MESHCODEC::NOT_A_MESH_CONTAINER" << std::endl;
+		return false;
+	}
+	reader.p += 4;
+	uint32_t version = reader.get32();
+	if (version != VERSION)
+	{
+		std::cout << "ERROR::MESHCODEC::UNSUPPORTED_VERSION " << version << std::endl;
+		return false;
+	}
+	info.vertexCount = reader.get32();
+	info.indexCount = reader.get32();
+	info.hasTangents = (reader.get32() & FLAG_TANGENTS) != 0;
+	info.boundsMin = reader.getVec3();
+	info.boundsMax = reader.getVec3();
+	info.texcoordMin.x = reader.getFloat();
+	info.texcoordMin.y = reader.getFloat();
+	info.texcoordMax.x = reader.getFloat();
+	info.texcoordMax.y = reader.getFloat();
+	uint64_t positionCount = reader.get64();
+	uint64_t faceCount = reader.get64();
+	uint32_t sourceCount = reader.get32();
+	info.sources.clear();
+	for (uint32_t i = 0; i < sourceCount && reader.ok; i++)
+	{
+		MeshSource source;
+		source.path = reader.getString();
+		source.size = (long long)reader.get64();
+		source.modified = (long long)reader.get64();
+		info.sources.push_back(source);
+	}
+	uint32_t materialCount = reader.get32();
+	for (uint32_t i = 0; i < materialCount && reader.ok; i++)
+	{
+		ObjMaterial material;
+		material.Name = reader.getString();
+		material.DiffuseMap = reader.getString();
+		material.SpecularMap = reader.getString();
+		material.NormalMap = reader.getString();
+		material.Ambient = reader.getVec3();
+		material.Diffuse = reader.getVec3();
+		material.Specular = reader.getVec3();
+		material.Shininess = reader.getFloat();
+		material.Defined = reader.get32() != 0;
+		if (mesh)
+			mesh->materials.push_back(material);
+	}
+	uint32_t rangeCount = reader.get32();
+	for (uint32_t i = 0; i < rangeCount && reader.ok; i++)
+	{
+		ObjMaterialRange range;
+		range.material = reader.get32();
+		range.indexOffset = reader.get32();
+		range.indexCount = reader.get32();
+		if (mesh)
+			mesh->ranges.push_back(range);
+	}
+	if (mesh)
+	{
+		mesh->positionCount = (size_t)positionCount;
+		mesh->faceCount = (size_t)faceCount;
+	}
+	if (!reader.ok)
+		std::cout << "ERROR::MESHCODEC::TRUNCATED_HEADER" << std::endl;
+	return reader.ok;
+}
+
+//where every chunk starts, checked against the data so a damaged count fails here rather
+//than in an allocation. the smallest vertex chunk is 16 constant planes, the smallest
+//index chunk a length and a constant block
+bool readChunkTable(Reader& reader, const MeshContainerInfo& info, std::vector<const unsigned char*>& chunkStart)
+{
+	size_t vertexChunks = chunkCount(info.vertexCount, MESH_CODEC_VERTEX_CHUNK);
+	size_t tangentChunks = info.hasTangents ? vertexChunks : 0;
+	size_t chunks = vertexChunks + tangentChunks + chunkCount(info.indexCount, MESH_CODEC_INDEX_CHUNK);
+	if (!reader.need(chunks * 4))
+	{
+		std::cout << "ERROR::MESHCODEC::TRUNCATED_CHUNK_TABLE" << std::endl;
+		return false;
+	}
+	chunkStart.resize(chunks + 1);
+	chunkStart[0] = reader.p + chunks * 4;
+	for (size_t i = 0; i < chunks; i++)
+	{
+		uint32_t chunkSize;
+		memcpy(&chunkSize, reader.p + i * 4, 4);
+		size_t minimum = i < vertexChunks + tangentChunks ? PLANES * 2 : 6;
+		if ((size_t)(reader.end - chunkStart[i]) < chunkSize || chunkSize < minimum)
+		{
+			std::cout << "ERROR::MESHCODEC::TRUNCATED_CHUNK " << i << std::endl;
+			return false;
+		}
+		chunkStart[i + 1] = chunkStart[i] + chunkSize;
+	}
+	return true;
+}
+
+}
+
+MeshSource StampSource(const std::string& path)
+{
+	MeshSource source = { path, -1, 0 };
+	std::error_code error;
+	std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+	if (error)
+		return source;
+	uintmax_t size = std::filesystem::file_size(path, error);
+	if (error)
+		return source;
+	source.size = (long long)size;
+	source.modified = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count();
+	return source;
+}
+
+bool SourcesCurrent(const std::vector<MeshSource>& sources)
+{
+	for (const MeshSource& source : sources)
+	{
+		MeshSource now = StampSource(source.path);
+		if (now.size != source.size || now.modified != source.modified)
+			return false;
+	}
+	return !sources.empty();
+}
+
+std::vector<MeshSource> ObjSources(const std::string& objPath, const ObjMesh& mesh)
+{
+	std::vector<MeshSource> sources;
+	sources.push_back(StampSource(objPath));
+	for (const std::string& library : mesh.libraries)
+		sources.push_back(StampSource(library));
+	return sources;
+}
+
+void EncodeMesh(const ObjMesh& mesh, const std::vector<MeshSource>& sources, std::vector<unsigned char>& out)
+{
+	PROFILE_ZONE("mesh.encode", "import");
+	MeshContainerInfo info;
+	info.vertexCount = (unsigned int)mesh.vertices.size();
+	info.indexCount = (unsigned int)mesh.indices.size();
+	info.hasTangents = !mesh.tangents.empty() && mesh.tangents.size() == mesh.vertices.size();
+	if (!mesh.vertices.empty())
+	{
+		info.boundsMin = info.boundsMax = mesh.vertices[0].Position;
+		info.texcoordMin = info.texcoordMax = mesh.vertices[0].TexCoords;
+	}
+	for (const ObjVertex& vertex : mesh.vertices)
+	{
+		info.boundsMin = glm::min(info.boundsMin, vertex.Position);
+		info.boundsMax = glm::max(info.boundsMax, vertex.Position);
+		info.texcoordMin = glm::min(info.texcoordMin, vertex.TexCoords);
+		info.texcoordMax = glm::max(info.texcoordMax, vertex.TexCoords);
+	}
+
+	out.insert(out.end(), MAGIC, MAGIC + 4);
+	put32(out, VERSION);
+	put32(out, info.vertexCount);
+	put32(out, info.indexCount);
+	put32(out, info.hasTangents ? FLAG_TANGENTS : 0);
+	putVec3(out, info.boundsMin);
+	putVec3(out, info.boundsMax);
+	putFloat(out, info.texcoordMin.x);
+	putFloat(out, info.texcoordMin.y);
+	putFloat(out, info.texcoordMax.x);
+	putFloat(out, info.texcoordMax.y);
+	put64(out, mesh.positionCount);
+	put64(out, mesh.faceCount);
+	put32(out, (uint32_t)sources.size());
+	for (const MeshSource& source : sources)
+	{
+		putString(out, source.path);
+		put64(out, (uint64_t)source.size);
+		put64(out, (uint64_t)source.modified);
+	}
+	put32(out, (uint32_t)mesh.materials.size());
+	for (const ObjMaterial& material : mesh.materials)
+	{
+		putString(out, material.Name);
+		putString(out, material.DiffuseMap);
+		putString(out, material.SpecularMap);
+		putString(out, material.NormalMap);
+		putVec3(out, material.Ambient);
+		putVec3(out, material.Diffuse);
+		putVec3(out, material.Specular);
+		putFloat(out, material.Shininess);
+		put32(out, material.Defined ? 1 : 0);
+	}
+	put32(out, (uint32_t)mesh.ranges.size());
+	for (const ObjMaterialRange& range : mesh.ranges)
+	{
+		put32(out, range.material);
+		put32(out, range.indexOffset);
+		put32(out, range.indexCount);
+	}
+
+	//vertex chunks, then tangent chunks, then index chunks, each encoded on its own
+	size_t vertexChunks = chunkCount(info.vertexCount, MESH_CODEC_VERTEX_CHUNK);
+	size_t tangentChunks = info.hasTangents ? vertexChunks : 0;
+	size_t indexChunks = chunkCount(info.indexCount, MESH_CODEC_INDEX_CHUNK);
+	std::vector<std::vector<unsigned char>> chunks(vertexChunks + tangentChunks + indexChunks);
+	glm::vec3 extent = info.boundsMax - info.boundsMin;
+	glm::vec2 texcoordExtent = info.texcoordMax - info.texcoordMin;
+	JobSystem& jobs = JobSystem::Get();
+	jobs.Wait(jobs.ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+		std::vector<uint16_t> records;
+		for (size_t chunk = begin; chunk < end; chunk++)
+		{
+			if (chunk >= vertexChunks + tangentChunks)
+			{
+				size_t first = (chunk - vertexChunks - tangentChunks) * MESH_CODEC_INDEX_CHUNK;
+				size_t count = std::min<size_t>(MESH_CODEC_INDEX_CHUNK, info.indexCount - first);
+				encodeIndices(mesh.indices.data() + first, count, chunks[chunk]);
+				continue;
+			}
+			bool tangents = chunk >= vertexChunks;
+			size_t first = (tangents ? chunk - vertexChunks : chunk) * MESH_CODEC_VERTEX_CHUNK;
+			size_t count = std::min<size_t>(MESH_CODEC_VERTEX_CHUNK, info.vertexCount - first);
+			records.assign(count * CHANNELS, 0);
+			for (size_t i = 0; i < count; i++)
+			{
+				uint16_t* q = &records[i * CHANNELS];
+				if (tangents)
+				{
+					const glm::vec4& tangent = mesh.tangents[first + i];
+					glm::vec2 oct = octEncode(glm::vec3(tangent));
+					q[0] = octChannel(oct.x);
+					q[1] = octChannel(oct.y);
+					q[2] = tangent.w < 0.0f ? 1 : 0;
+					continue;
+				}
+				const ObjVertex& vertex = mesh.vertices[first + i];
+				glm::vec2 oct = octEncode(vertex.Normal);
+				q[0] = quantize(vertex.Position.x, info.boundsMin.x, extent.x);
+				q[1] = quantize(vertex.Position.y, info.boundsMin.y, extent.y);
+				q[2] = quantize(vertex.Position.z, info.boundsMin.z, extent.z);
+				q[3] = octChannel(oct.x);
+				q[4] = octChannel(oct.y);
+				q[5] = quantize(vertex.TexCoords.x, info.texcoordMin.x, texcoordExtent.x);
+				q[6] = quantize(vertex.TexCoords.y, info.texcoordMin.y, texcoordExtent.y);
+			}
+			encodeRecords(records.data(), count, chunks[chunk]);
+		}
+	}));
+
+	for (const std::vector<unsigned char>& chunk : chunks)
+		put32(out, (uint32_t)chunk.size());
+	for (const std::vector<unsigned char>& chunk : chunks)
+		out.insert(out.end(), chunk.begin(), chunk.end());
+}
+
+bool ReadMeshInfo(const unsigned char* data, size_t size, MeshContainerInfo& info)
+{
+	Reader reader = { data, data + size, true };
+	return readHeader(reader, info, NULL);
+}
+
+bool DecodeMeshStreams(const unsigned char* data, size_t size, ObjVertex* vertices, unsigned int* indices, glm::vec4* tangents)
+{
+	PROFILE_ZONE("mesh.decode", "import");
+	Reader reader = { data, data + size, true };
+	MeshContainerInfo info;
+	if (!readHeader(reader, info, NULL))
+		return false;
+	size_t vertexChunks = chunkCount(info.vertexCount, MESH_CODEC_VERTEX_CHUNK);
+	size_t tangentChunks = info.hasTangents ? vertexChunks : 0;
+	size_t indexChunks = chunkCount(info.indexCount, MESH_CODEC_INDEX_CHUNK);
+	size_t chunks = vertexChunks + tangentChunks + indexChunks;
+	std::vector<const unsigned char*> chunkStart;
+	if (!readChunkTable(reader, info, chunkStart))
+		return false;
+
+	std::atomic<bool> valid(true);
+	JobSystem& jobs = JobSystem::Get();
+	jobs.Wait(jobs.ParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+		std::vector<uint8_t> planes;
+		std::vector<uint16_t> records;
+		for (size_t chunk = begin; chunk < end; chunk++)
+		{
+			Reader chunkReader = { chunkStart[chunk], chunkStart[chunk + 1], true };
+			if (chunk >= vertexChunks + tangentChunks)
+			{
+				size_t first = (chunk - vertexChunks - tangentChunks) * MESH_CODEC_INDEX_CHUNK;
+				size_t count = std::min<size_t>(MESH_CODEC_INDEX_CHUNK, info.indexCount - first);
+				if (!decodeIndices(chunkReader, indices + first, count))
+					valid = false;
+				continue;
+			}
+			bool isTangents = chunk >= vertexChunks;
+			if (isTangents && !tangents)
+				continue;
+			size_t first = (isTangents ? chunk - vertexChunks : chunk) * MESH_CODEC_VERTEX_CHUNK;
+			size_t count = std::min<size_t>(MESH_CODEC_VERTEX_CHUNK, info.vertexCount - first);
+			planes.resize(count * PLANES);
+			records.resize(count * CHANNELS);
+			bool ok = true;
+			for (int plane = 0; plane < PLANES && ok; plane++)
+				ok = decodeBlock(chunkReader, &planes[plane * count], count);
+			if (!ok)
+			{
+				valid = false;
+				continue;
+			}
+			unfilterRecords(planes.data(), count, records.data());
+			if (isTangents)
+				dequantizeTangents(records.data(), count, tangents + first);
+			else
+				dequantizeVertices(records.data(), count, info, vertices + first);
+		}
+	}));
+	if (!valid)
+		std::cout << "ERROR::MESHCODEC::CORRUPT_STREAM" << std::endl;
+	return valid;
+}
+
+bool DecodeMesh(const unsigned char* data, size_t size, ObjMesh& mesh, MeshContainerInfo* info)
+{
+	mesh.Clear();
+	MeshContainerInfo header;
+	Reader reader = { data, data + size, true };
+	std::vector<const unsigned char*> chunkStart;
+	if (!readHeader(reader, header, &mesh) || !readChunkTable(reader, header, chunkStart))
+		return false;
+	for (const ObjMaterialRange& range : mesh.ranges)
+	{
+		if (range.material >= mesh.materials.size() || (size_t)range.indexOffset + range.indexCount > header.indexCount)
+		{
+			std::cout << "ERROR::MESHCODEC::RANGE_OUT_OF_BOUNDS" << std::endl;
+			return false;
+		}
+	}
+	mesh.vertices.resize(header.vertexCount);
+	mesh.indices.resize(header.indexCount);
+	if (header.hasTangents)
+		mesh.tangents.resize(header.vertexCount);
+	if (!DecodeMeshStreams(data, size, mesh.vertices.data(), mesh.indices.data(), header.hasTangents ? mesh.tangents.data() : NULL))
+		return false;
+	for (unsigned int index : mesh.indices)
+	{
+		if (index >= header.vertexCount)
+		{
+			std::cout << "ERROR::MESHCODEC::INDEX_OUT_OF_BOUNDS" << std::endl;
+			return false;
+		}
+	}
+	if (info)
+		*info = header;
+	return true;
+}
+
+bool SaveMeshFile(const std::string& path, const ObjMesh& mesh, const std::vector<MeshSource>& sources)
+{
+	std::vector<unsigned char> bytes;
+	EncodeMesh(mesh, sources, bytes);
+	//written next to the target and renamed over it, so readers never see half a file
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		if (!file || !file.write((const char*)bytes.data(), bytes.size()))
+		{
+			std::cout << "ERROR::MESHCODEC::UNABLE_TO_WRITE " << path << std::endl;
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		std::cout << "ERROR::MESHCODEC::UNABLE_TO_WRITE " << path << ": " << error.message() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool LoadMeshFile(const std::string& path, ObjMesh& mesh, MeshContainerInfo* info)
+{
+	std::vector<unsigned char> bytes;
+	{
+		PROFILE_ZONE("mesh.read", "io");
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			std::cout << "ERROR::MESHCODEC::UNABLE_TO_OPEN_FILE: " << path << std::endl;
+			return false;
+		}
+		bytes.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read((char*)bytes.data(), bytes.size());
+	}
+	PROFILE_COUNTER("mesh.bytes", bytes.size());
+	return DecodeMesh(bytes.data(), bytes.size(), mesh, info);
+}
+
+bool LoadObjCached(const std::string& objPath, const std::string& cacheDirectory, ObjMesh& mesh)
+{
+	std::error_code error;
+	std::string absolute = std::filesystem::absolute(objPath, error).string();
+	//FNV-1a, the same hash the shader cache keys its entries with
+	unsigned long long key = 14695981039346656037ull;
+	for (unsigned char c : absolute)
+	{
+		key ^= c;
+		key *= 1099511628211ull;
+	}
+	std::ostringstream name;
+	name << cacheDirectory << "/" << std::hex << key << ".objz";
+	std::string cachePath = name.str();
+
+	std::ifstream file(cachePath, std::ios::binary | std::ios::ate);
+	if (file)
+	{
+		std::vector<unsigned char> bytes((size_t)file.tellg());
+		file.seekg(0);
+		file.read((char*)bytes.data(), bytes.size());
+		file.close();
+		MeshContainerInfo info;
+		if (ReadMeshInfo(bytes.data(), bytes.size(), info) && SourcesCurrent(info.sources) &&
+			!info.sources.empty() && info.sources[0].path == objPath && DecodeMesh(bytes.data(), bytes.size(), mesh))
+			return true;
+		mesh.Clear();
+	}
+
+	if (!LoadObjFile(objPath, mesh))
+		return false;
+	std::filesystem::create_directories(cacheDirectory, error);
+	SaveMeshFile(cachePath, mesh, ObjSources(objPath, mesh));
+	return true;
+}
@@ -0,0 +1,76 @@
+#ifndef MESH_CODEC_H
+#define MESH_CODEC_H
+
+#include "ObjLoader.h"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+//Compressed container for an imported ObjMesh, for the mesh cache and for shipping baked
+//models. Vertices are quantized to 16 bits per channel: positions and texture coordinates
+//over their bounds, normals and tangents as octahedral pairs. Each channel is stored as
+//zigzagged deltas between consecutive vertices, split into low and high byte planes.
+//Indices are zigzagged deltas written as varints. Every plane and index block then goes
+//through an order-0 rANS coder, or is stored as is or as a single repeated byte when that
+//is smaller. Streams are cut into chunks that decode independently, on the job system.
+//Quantization is the only loss: positions and texture coordinates land within half a
+//step (extent / 65535) of the original, indices and materials are exact.
+
+//vertices per chunk, every chunk restarts its deltas
+const unsigned int MESH_CODEC_VERTEX_CHUNK = 16384;
+//indices per chunk, whole triangles
+const unsigned int MESH_CODEC_INDEX_CHUNK = 3 * 16384;
+
+//an input file of a baked mesh with the size and modification time it had, size -1 when
+//it did not exist
+struct MeshSource {
+	std::string path;
+	long long size;
+	long long modified;
+};
+
+//what the container holds, readable without decoding anything
+struct MeshContainerInfo {
+	unsigned int vertexCount = 0;
+	unsigned int indexCount = 0;
+	bool hasTangents = false;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	glm::vec2 texcoordMin = glm::vec2(0.0f);
+	glm::vec2 texcoordMax = glm::vec2(0.0f);
+	std::vector<MeshSource> sources;
+};
+
+//the file as it is on disk now
+MeshSource StampSource(const std::string& path);
+
+//true when every source still has the recorded size and modification time
+bool SourcesCurrent(const std::vector<MeshSource>& sources);
+
+//the OBJ file and its MTL libraries, what a container made from mesh depends on
+std::vector<MeshSource> ObjSources(const std::string& objPath, const ObjMesh& mesh);
+
+//appends the container for mesh to out
+void EncodeMesh(const ObjMesh& mesh, const std::vector<MeshSource>& sources, std::vector<unsigned char>& out);
+
+//reads the header only, returns false (and prints why) for anything that is not a container
+bool ReadMeshInfo(const unsigned char* data, size_t size, MeshContainerInfo& info);
+
+//decodes the streams straight into caller memory, e.g. mapped GL buffers: info.vertexCount
+//vertices, info.indexCount indices and, if tangents is not NULL and the container has them,
+//info.vertexCount tangents
+bool DecodeMeshStreams(const unsigned char* data, size_t size, ObjVertex* vertices, unsigned int* indices, glm::vec4* tangents);
+
+//the whole mesh, materials and ranges included
+bool DecodeMesh(const unsigned char* data, size_t size, ObjMesh& mesh, MeshContainerInfo* info = NULL);
+
+bool SaveMeshFile(const std::string& path, const ObjMesh& mesh, const std::vector<MeshSource>& sources);
+bool LoadMeshFile(const std::string& path, ObjMesh& mesh, MeshContainerInfo* info = NULL);
+
+//imports objPath through a container in cacheDirectory, keyed by the absolute path. the OBJ
+//is parsed again, and the entry rewritten, when it or one of its MTL files changed
+bool LoadObjCached(const std::string& objPath, const std::string& cacheDirectory, ObjMesh& mesh);
+
+#endif
@@ -0,0 +1,464 @@
+#ifndef MESH_NORMALS_H
+#define MESH_NORMALS_H
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Simd.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+//edges between faces further apart than this stay hard when no angle is given
+const float DEFAULT_CREASE_ANGLE = 60.0f;
+
+namespace mesh_normals {
+
+const unsigned int NONE = 0xffffffffu;
+
+//per triangle unit normal (zero when degenerate) and the angle at each of its corners, SoA
+struct FaceData {
+	std::vector<float> nx, ny, nz;
+	std::vector<float> angle[3];
+};
+
+//runs kernel(lanes, firstTriangle) over all triangles on the job system, Lanes::Width
+//triangles per call and one triangle per call for the rest
+template <typename Kernel>
+void forTriangles(size_t triangles, Kernel kernel)
+{
+#if SIMD_WIDTH > 1
+	const size_t width = simd::Lanes::Width;
+#else
+	const size_t width = 1;
+#endif
+	size_t blocks = triangles / width;
+	JobSystem& jobs = JobSystem::Get();
+	JobHandle done = jobs.ParallelFor(blocks, 4096 / width, [&](size_t begin, size_t end) {
+		for (size_t block = begin; block < end; block++)
+		{
+#if SIMD_WIDTH > 1
+			kernel(simd::Lanes(), block * width);
+#else
+			kernel(simd::Scalar(), block * width);
+#endif
+		}
+	});
+	jobs.Wait(done);
+	for (size_t triangle = blocks * width; triangle < triangles; triangle++)
+		kernel(simd::Scalar(), triangle);
+}
+
+//corner positions of Width triangles from first, transposed to SoA: x y z of corner 0, 1, 2
+template <typename L, typename V>
+void gatherPositions(const V* vertices, const unsigned int* indices, size_t first, L corner[3][3])
+{
+	float lanes[3][3][L::Width];
+	for (int lane = 0; lane < L::Width; lane++)
+	{
+		const unsigned int* triangle = indices + (first + lane) * 3;
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec3& position = vertices[triangle[k]].Position;
+			lanes[k][0][lane] = position.x;
+			lanes[k][1][lane] = position.y;
+			lanes[k][2][lane] = position.z;
+		}
+	}
+	for (int k = 0; k < 3; k++)
+		for (int axis = 0; axis < 3; axis++)
+			corner[k][axis] = L::Load(lanes[k][axis]);
+}
+
+template <typename L>
+L clampUnit(L x)
+{
+	return simd::Max(L::Set(-1.0f), simd::Min(L::Set(1.0f), x));
+}
+
+//unit face normal and the three corner angles of Width triangles
+template <typename L, typename V>
+void faceKernel(const V* vertices, const unsigned int* indices, size_t first, FaceData& faces)
+{
+	L corner[3][3];
+	gatherPositions(vertices, indices, first, corner);
+	//edges a->b, b->c, c->a
+	L e[3][3];
+	for (int k = 0; k < 3; k++)
+		for (int axis = 0; axis < 3; axis++)
+			e[k][axis] = corner[(k + 1) % 3][axis] - corner[k][axis];
+
+	//cross(b - a, c - a) = cross(e0, -e2)
+	L nx = e[0][2] * e[2][1] - e[0][1] * e[2][2];
+	L ny = e[0][0] * e[2][2] - e[0][2] * e[2][0];
+	L nz = e[0][1] * e[2][0] - e[0][0] * e[2][1];
+	L tiny = L::Set(1e-30f);
+	L length = simd::Sqrt(nx * nx + ny * ny + nz * nz);
+	L inverse = simd::Select(simd::Less(tiny, length), L::Set(1.0f) / simd::Max(length, tiny), L::Set(0.0f));
+	(nx * inverse).Store(&faces.nx[first]);
+	(ny * inverse).Store(&faces.ny[first]);
+	(nz * inverse).Store(&faces.nz[first]);
+
+	L edgeLength[3];
+	for (int k = 0; k < 3; k++)
+		edgeLength[k] = simd::Max(simd::Sqrt(e[k][0] * e[k][0] + e[k][1] * e[k][1] + e[k][2] * e[k][2]), tiny);
+	//the angle at corner k lies between the outgoing edge k and the reversed incoming edge k-1
+	L cos0 = clampUnit(L::Set(0.0f) - (e[0][0] * e[2][0] + e[0][1] * e[2][1] + e[0][2] * e[2][2]) / (edgeLength[0] * edgeLength[2]));
+	L cos1 = clampUnit(L::Set(0.0f) - (e[1][0] * e[0][0] + e[1][1] * e[0][1] + e[1][2] * e[0][2]) / (edgeLength[1] * edgeLength[0]));
+	L angle0 = simd::Acos(cos0);
+	L angle1 = simd::Acos(cos1);
+	angle0.Store(&faces.angle[0][first]);
+	angle1.Store(&faces.angle[1][first]);
+	simd::Max(L::Set(0.0f), L::Set(3.14159265f) - angle0 - angle1).Store(&faces.angle[2][first]);
+}
+
+template <typename V>
+void computeFaces(const std::vector<V>& vertices, const std::vector<unsigned int>& indices, FaceData& faces)
+{
+	PROFILE_ZONE("normals.faces", "import");
+	size_t triangles = indices.size() / 3;
+	faces.nx.resize(triangles);
+	faces.ny.resize(triangles);
+	faces.nz.resize(triangles);
+	for (int k = 0; k < 3; k++)
+		faces.angle[k].resize(triangles);
+	forTriangles(triangles, [&](auto lanes, size_t first) {
+		faceKernel<decltype(lanes)>(vertices.data(), indices.data(), first, faces);
+	});
+}
+
+inline uint32_t floatBits(float value)
+{
+	value += 0.0f; //-0 and +0 weld
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+//one id per distinct position, returns the number of distinct positions
+template <typename V>
+unsigned int weldPositions(const std::vector<V>& vertices, std::vector<unsigned int>& ids)
+{
+	PROFILE_ZONE("normals.weld", "import");
+	size_t capacity = 16;
+	while (capacity < vertices.size() * 2)
+		capacity *= 2;
+	//open addressing, a slot holds the first vertex seen at a position
+	std::vector<unsigned int> slots(capacity, NONE);
+	ids.resize(vertices.size());
+	unsigned int count = 0;
+	for (size_t v = 0; v < vertices.size(); v++)
+	{
+		const glm::vec3& position = vertices[v].Position;
+		uint32_t x = floatBits(position.x), y = floatBits(position.y), z = floatBits(position.z);
+		size_t slot = (size_t)((x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u)) & (capacity - 1);
+		while (true)
+		{
+			unsigned int other = slots[slot];
+			if (other == NONE)
+			{
+				slots[slot] = (unsigned int)v;
+				ids[v] = count++;
+				break;
+			}
+			const glm::vec3& existing = vertices[other].Position;
+			if (floatBits(existing.x) == x && floatBits(existing.y) == y && floatBits(existing.z) == z)
+			{
+				ids[v] = ids[other];
+				break;
+			}
+			slot = (slot + 1) & (capacity - 1);
+		}
+	}
+	return count;
+}
+
+//corners grouped by key: the corners of key k are list[start[k]] to list[start[k + 1]]
+inline void groupCorners(const std::vector<unsigned int>& cornerKeys, unsigned int keyCount, std::vector<unsigned int>& start, std::vector<unsigned int>& list)
+{
+	PROFILE_ZONE("normals.group", "import");
+	start.assign(keyCount + 1, 0);
+	for (unsigned int key : cornerKeys)
+		start[key + 1]++;
+	for (unsigned int k = 0; k < keyCount; k++)
+		start[k + 1] += start[k];
+	std::vector<unsigned int> cursor(start.begin(), start.end() - 1);
+	list.resize(cornerKeys.size());
+	for (size_t corner = 0; corner < cornerKeys.size(); corner++)
+		list[cursor[cornerKeys[corner]]++] = (unsigned int)corner;
+}
+
+inline glm::vec3 faceNormal(const FaceData& faces, unsigned int triangle)
+{
+	return glm::vec3(faces.nx[triangle], faces.ny[triangle], faces.nz[triangle]);
+}
+
+//any unit vector perpendicular to n
+inline glm::vec3 perpendicular(const glm::vec3& n)
+{
+	glm::vec3 axis = fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(axis - n * glm::dot(n, axis));
+}
+
+}
+
+//Smooth normals for an indexed triangle list, in place. Each corner gets the sum of the
+//normals of the faces around its position that lie within creaseAngleDegrees of its own
+//face, weighted by their corner angle. Vertices whose corners end up with different
+//normals are split, so hard edges stay hard. With onlyMissing only vertices whose normal
+//is zero (an OBJ face without vn) are changed; all faces still count for the smoothing.
+//
+//Face normals and corner angles run in SoA SIMD batches. The accumulation is a gather:
+//corners are grouped by welded position and every position is summed by exactly one job,
+//so no atomics are needed. V needs Position and Normal. Returns the vertices added by splits.
+template <typename V>
+size_t GenerateNormals(std::vector<V>& vertices, std::vector<unsigned int>& indices, float creaseAngleDegrees = DEFAULT_CREASE_ANGLE, bool onlyMissing = true)
+{
+	using namespace mesh_normals;
+	PROFILE_ZONE("normals.generate", "import");
+	size_t corners = indices.size() / 3 * 3;
+	if (corners == 0)
+		return 0;
+
+	std::vector<uint8_t> needs(vertices.size());
+	bool any = false;
+	for (size_t v = 0; v < vertices.size(); v++)
+	{
+		needs[v] = !onlyMissing || vertices[v].Normal == glm::vec3(0.0f);
+		any = any || needs[v];
+	}
+	if (!any)
+		return 0;
+
+	FaceData faces;
+	computeFaces(vertices, indices, faces);
+
+	std::vector<unsigned int> positionIds;
+	unsigned int positions = weldPositions(vertices, positionIds);
+	std::vector<unsigned int> cornerPositions(corners);
+	for (size_t corner = 0; corner < corners; corner++)
+		cornerPositions[corner] = positionIds[indices[corner]];
+	std::vector<unsigned int> start, list;
+	groupCorners(cornerPositions, positions, start, list);
+
+	//one job owns a position: it sums and writes the normals of the vertices there and points
+	//its corners at the right copy. the copies are appended afterwards in position order
+	struct Split {
+		std::vector<V> copies;
+		std::vector<unsigned int> sources;
+		std::vector<std::pair<unsigned int, unsigned int>> corners;
+	};
+	float cosCrease = cosf(glm::radians(glm::clamp(creaseAngleDegrees, 0.0f, 180.0f)));
+	float cosHalfCrease = cosf(glm::radians(glm::clamp(creaseAngleDegrees, 0.0f, 180.0f) * 0.5f));
+	bool smoothAll = creaseAngleDegrees >= 180.0f;
+	std::vector<uint8_t> assigned(vertices.size(), 0);
+	std::mutex splitMutex;
+	std::map<size_t, Split> splits;
+	JobSystem& jobs = JobSystem::Get();
+	JobHandle summed = jobs.ParallelFor(positions, 1024, [&](size_t begin, size_t end) {
+		PROFILE_ZONE("normals.accumulate", "import");
+		//the face normals around one position, copied once so the crease test reads them contiguously
+		std::vector<glm::vec3> around, weighted;
+		Split split;
+		for (size_t position = begin; position < end; position++)
+		{
+			unsigned int first = start[position], last = start[position + 1];
+			size_t firstCopy = split.copies.size();
+			around.clear();
+			weighted.clear();
+			glm::vec3 all(0.0f);
+			for (unsigned int i = first; i < last; i++)
+			{
+				unsigned int triangle = list[i] / 3;
+				around.push_back(faceNormal(faces, triangle));
+				weighted.push_back(around.back() * faces.angle[list[i] % 3][triangle]);
+				all += weighted.back();
+			}
+			//faces all within half the crease angle of their mean are pairwise within the crease
+			//angle, so every corner gets the full sum without the pairwise test
+			bool smooth = smoothAll;
+			float allLength = glm::length(all);
+			glm::vec3 mean = allLength > 1e-20f ? all / allLength : glm::vec3(0.0f);
+			if (!smooth && allLength > 1e-20f)
+			{
+				smooth = true;
+				for (size_t j = 0; j < around.size() && smooth; j++)
+					smooth = around[j] == glm::vec3(0.0f) || glm::dot(mean, around[j]) >= cosHalfCrease;
+			}
+			for (unsigned int i = first; i < last; i++)
+			{
+				unsigned int corner = list[i];
+				unsigned int v = indices[corner];
+				if (!needs[v])
+					continue;
+				const glm::vec3& own = around[i - first];
+				glm::vec3 normal = mean;
+				//a degenerate face has no direction of its own and takes everything around it
+				if (!smooth && own != glm::vec3(0.0f))
+				{
+					glm::vec3 sum(0.0f);
+					for (size_t j = 0; j < around.size(); j++)
+					{
+						if (glm::dot(own, around[j]) >= cosCrease)
+							sum += weighted[j];
+					}
+					float length = glm::length(sum);
+					normal = length > 1e-20f ? sum / length : glm::vec3(0.0f);
+				}
+				if (normal == glm::vec3(0.0f))
+					normal = own == glm::vec3(0.0f) ? glm::vec3(0.0f, 1.0f, 0.0f) : own;
+
+				//the first corner of a vertex sets its normal, corners that disagree share a copy
+				if (!assigned[v])
+				{
+					vertices[v].Normal = normal;
+					assigned[v] = 1;
+					continue;
+				}
+				if (glm::dot(vertices[v].Normal, normal) >= 0.9999f)
+					continue;
+				size_t copy = firstCopy;
+				while (copy < split.copies.size() && (split.sources[copy] != v || glm::dot(split.copies[copy].Normal, normal) < 0.9999f))
+					copy++;
+				if (copy == split.copies.size())
+				{
+					split.copies.push_back(vertices[v]);
+					split.copies.back().Normal = normal;
+					split.sources.push_back(v);
+				}
+				split.corners.push_back(std::make_pair(corner, (unsigned int)copy));
+			}
+		}
+		if (!split.copies.empty())
+		{
+			std::lock_guard<std::mutex> lock(splitMutex);
+			splits[begin] = std::move(split);
+		}
+	});
+	jobs.Wait(summed);
+
+	PROFILE_ZONE("normals.split", "import");
+	size_t original = vertices.size();
+	for (std::pair<const size_t, Split>& entry : splits)
+	{
+		unsigned int base = (unsigned int)vertices.size();
+		vertices.insert(vertices.end(), entry.second.copies.begin(), entry.second.copies.end());
+		for (const std::pair<unsigned int, unsigned int>& corner : entry.second.corners)
+			indices[corner.first] = base + corner.second;
+	}
+	PROFILE_COUNTER("normals.split_vertices", vertices.size() - original);
+	return vertices.size() - original;
+}
+
+namespace mesh_normals {
+
+//unit tangent and bitangent directions of Width triangles from their texture coordinates,
+//zero where the mapping is degenerate
+template <typename L, typename V>
+void tangentKernel(const V* vertices, const unsigned int* indices, size_t first, std::vector<float>* out)
+{
+	L corner[3][3];
+	gatherPositions(vertices, indices, first, corner);
+	float uv[3][2][L::Width];
+	for (int lane = 0; lane < L::Width; lane++)
+	{
+		const unsigned int* triangle = indices + (first + lane) * 3;
+		for (int k = 0; k < 3; k++)
+		{
+			uv[k][0][lane] = vertices[triangle[k]].TexCoords.x;
+			uv[k][1][lane] = vertices[triangle[k]].TexCoords.y;
+		}
+	}
+	L s0 = L::Load(uv[0][0]), t0 = L::Load(uv[0][1]);
+	L s1 = L::Load(uv[1][0]) - s0, t1 = L::Load(uv[1][1]) - t0;
+	L s2 = L::Load(uv[2][0]) - s0, t2 = L::Load(uv[2][1]) - t0;
+	L determinant = s1 * t2 - s2 * t1;
+	L zero = L::Set(0.0f);
+	//only the directions matter, so the sign of the determinant replaces the division
+	L sign = simd::Select(simd::Less(determinant, zero), L::Set(-1.0f), L::Set(1.0f));
+	L valid = simd::Less(L::Set(1e-20f), simd::Abs(determinant));
+	L tangent[3], bitangent[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		L e1 = corner[1][axis] - corner[0][axis];
+		L e2 = corner[2][axis] - corner[0][axis];
+		tangent[axis] = (e1 * t2 - e2 * t1) * sign;
+		bitangent[axis] = (e2 * s1 - e1 * s2) * sign;
+	}
+	L tangentLength = simd::Sqrt(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+	L bitangentLength = simd::Sqrt(bitangent[0] * bitangent[0] + bitangent[1] * bitangent[1] + bitangent[2] * bitangent[2]);
+	L tangentScale = simd::Select(valid, L::Set(1.0f) / simd::Max(tangentLength, L::Set(1e-30f)), zero);
+	L bitangentScale = simd::Select(valid, L::Set(1.0f) / simd::Max(bitangentLength, L::Set(1e-30f)), zero);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		(tangent[axis] * tangentScale).Store(&out[axis][first]);
+		(bitangent[axis] * bitangentScale).Store(&out[3 + axis][first]);
+	}
+}
+
+}
+
+//Per-vertex tangents following the MikkTSpace conventions: each corner's face tangent is
+//projected onto the vertex normal and weighted by the corner angle, the sum is normalized,
+//and w holds the handedness so the shader rebuilds the bitangent as w * cross(N, T). Unlike
+//mikktspace.c vertices are not split where handedness flips inside one vertex; the mesh's
+//own vertex identity (position, uv, normal) decides what is shared. V needs Position,
+//Normal and TexCoords. tangents gets one entry per vertex.
+template <typename V>
+void GenerateTangents(const std::vector<V>& vertices, const std::vector<unsigned int>& indices, std::vector<glm::vec4>& tangents)
+{
+	using namespace mesh_normals;
+	PROFILE_ZONE("tangents.generate", "import");
+	size_t triangles = indices.size() / 3;
+	tangents.assign(vertices.size(), glm::vec4(0.0f));
+	if (triangles == 0)
+		return;
+
+	FaceData faces;
+	computeFaces(vertices, indices, faces);
+	std::vector<float> directions[6];
+	for (std::vector<float>& axis : directions)
+		axis.resize(triangles);
+	forTriangles(triangles, [&](auto lanes, size_t first) {
+		tangentKernel<decltype(lanes)>(vertices.data(), indices.data(), first, directions);
+	});
+
+	std::vector<unsigned int> cornerVertices(indices.begin(), indices.begin() + triangles * 3);
+	std::vector<unsigned int> start, list;
+	groupCorners(cornerVertices, (unsigned int)vertices.size(), start, list);
+
+	JobSystem& jobs = JobSystem::Get();
+	JobHandle summed = jobs.ParallelFor(vertices.size(), 1024, [&](size_t begin, size_t end) {
+		PROFILE_ZONE("tangents.accumulate", "import");
+		for (size_t v = begin; v < end; v++)
+		{
+			glm::vec3 normal = vertices[v].Normal;
+			float normalLength = glm::length(normal);
+			normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f, 0.0f, 1.0f);
+			glm::vec3 tangent(0.0f), bitangent(0.0f);
+			for (unsigned int i = start[v]; i < start[v + 1]; i++)
+			{
+				unsigned int triangle = list[i] / 3;
+				float weight = faces.angle[list[i] % 3][triangle];
+				glm::vec3 faceTangent(directions[0][triangle], directions[1][triangle], directions[2][triangle]);
+				glm::vec3 faceBitangent(directions[3][triangle], directions[4][triangle], directions[5][triangle]);
+				glm::vec3 projected = faceTangent - normal * glm::dot(normal, faceTangent);
+				float length = glm::length(projected);
+				if (length > 1e-20f)
+					tangent += projected * (weight / length);
+				bitangent += faceBitangent * weight;
+			}
+			float length = glm::length(tangent);
+			tangent = length > 1e-20f ? tangent / length : perpendicular(normal);
+			float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+			tangents[v] = glm::vec4(tangent, handedness);
+		}
+	});
+	jobs.Wait(summed);
+}
+
+#endif
@@ -12,66 +12,216 @@
 #include <vector>
 #include <iostream>
 #include <string>
+#include <unordered_set>
+#include "GlObject.h"
+#include "JobSystem.h"
 #include "Mesh.h"
+#include "MeshNormals.h"
+#include "Profiler.h"
+#include "RingBuffer.h"
+#include "StaticBatching.h"
+#include "TransformSystem.h"
 #include "stb_image.h"
 
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma);
+//pixels of one texture file, decoded off the GL thread
+struct DecodedTexture {
+	unsigned char* data;
+	int width;
+	int height;
+	int components;
+};
+
+GlTexture TextureFromFile(const char* path, const std::string& directory, bool gamma);
+DecodedTexture DecodeTexture(const char* path, const std::string& directory);
+GlTexture UploadTexture(DecodedTexture& decoded, const std::string& owner);
 
 class Model 
 {
 	public:
 		std::vector<Texture> textures_loaded;
+		//the GL textures of textures_loaded, in the same order. the Texture entries the
+		//meshes hold only borrow the ids
+		std::vector<GlTexture> textureObjects;
 		std::vector<Mesh> meshes;
+		//the node hierarchy, meshes[i] hangs off node meshNodes[i]. merged static batches
+		//are already in model space and have node -1
+		TransformSystem transforms;
+		std::vector<int> meshNodes;
 		std::string directory;
 		bool gammaCorrection;
+		//merge static meshes with the same textures into batches of up to STATIC_BATCH_MAX_VERTICES
+		bool staticBatching;
 		
-		Model(const char* path, bool gamma = false) : gammaCorrection(gamma)
+		Model(const char* path, bool gamma = false, bool batchStatic = false) : gammaCorrection(gamma), staticBatching(batchStatic)
 		{
 			loadModel(path);
 		}
-		void Draw(Shader& shader)
+		//ring bytes Draw() takes per frame, for FrameRingBuffer::Create/Reserve
+		size_t RingBytesPerFrame() const
+		{
+			//one Transforms block per mesh plus its alignment gap
+			return meshes.size() * (3 * sizeof(glm::mat4) + 256);
+		}
+
+		//draws every mesh with its own copy of shader.vs's Transforms block from ring, bound
+		//at transformsBinding: model times the mesh's node, or model alone for batches. meshes
+		//under a mirroring node are drawn with clockwise front faces. the last mesh's block
+		//stays bound
+		void Draw(Shader& shader, FrameRingBuffer& ring, unsigned int transformsBinding, const glm::mat4& projection, const glm::mat4& view,
+			const glm::mat4& model = glm::mat4(1.0f))
 		{
+			//the ring is write-only memory, the matrices are kept here for the winding test
+			std::vector<RingAllocation> blocks(meshes.size());
+			std::vector<glm::mat4> worlds(meshes.size());
 			for (unsigned int i = 0; i < meshes.size(); i++)
 			{
+				blocks[i] = ring.AllocateUniform(3 * sizeof(glm::mat4));
+				if (!blocks[i].Valid())
+					return;
+				worlds[i] = meshNodes[i] >= 0 ? model * transforms.World(meshNodes[i]) : model;
+				glm::mat4 matrices[3] = { projection, view, worlds[i] };
+				memcpy(blocks[i].Data, matrices, sizeof(matrices));
+			}
+			ring.Flush();
+			shader.setBlockBinding("Transforms", transformsBinding);
+			for (unsigned int i = 0; i < meshes.size(); i++)
+			{
+				bool mirrored = glm::determinant(glm::mat3(worlds[i])) < 0.0f;
+				glBindBufferRange(GL_UNIFORM_BUFFER, transformsBinding, ring.Buffer(), blocks[i].Offset, blocks[i].Size);
+				if (mirrored)
+					glFrontFace(GL_CW);
 				meshes[i].Draw(shader);
+				if (mirrored)
+					glFrontFace(GL_CCW);
 			}
 		}
 	private:
-		
+		//what the memory registry files the model's buffers and textures under
+		std::string owner;
 
+		//vertices and indices of one aiMesh, built on a worker
+		typedef StaticMeshData<Vertex> MeshData;
+
+		//Mesh building and texture decoding run as jobs, everything touching GL runs as
+		//main-thread jobs: one upload per texture as soon as it is decoded, and the Mesh
+		//objects once all of them are done. The calling thread helps until the import finished.
 		void loadModel(std::string path)
 		{
+			PROFILE_ZONE("model.load", "import");
+			owner = path;
 			Assimp::Importer import;
-			const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+			const aiScene* scene;
+			{
+				PROFILE_ZONE("assimp.ReadFile", "import");
+				scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+			}
 
-			if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || scene->mRootNode)
+			if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 			{
 				std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
 				return;
 			}
 			directory = path.substr(0, path.find_last_of('/'));
 
-			processNode(scene->mRootNode, scene);
+			//nodes an animation moves, their meshes and those below them are not static
+			std::unordered_set<std::string> animatedNodes;
+			for (unsigned int a = 0; a < scene->mNumAnimations; a++)
+			{
+				for (unsigned int c = 0; c < scene->mAnimations[a]->mNumChannels; c++)
+					animatedNodes.insert(scene->mAnimations[a]->mChannels[c]->mNodeName.C_Str());
+			}
+			std::vector<aiMesh*> sceneMeshes;
+			std::vector<bool> movable;
+			processNode(scene->mRootNode, scene, -1, false, animatedNodes, sceneMeshes, movable);
+			transforms.Update();
+
+			JobSystem& jobs = JobSystem::Get();
+			std::vector<MeshData> built(sceneMeshes.size());
+			std::vector<JobHandle> loaded;
+			JobHandle meshesBuilt = jobs.ParallelFor(sceneMeshes.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					built[i] = processMesh(sceneMeshes[i]);
+			});
+			std::vector<int> builtNodes = meshNodes;
+			if (staticBatching)
+			{
+				std::vector<std::string> textureSets;
+				for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+					textureSets.push_back(textureSetKey(scene->mMaterials[m]));
+				meshesBuilt = jobs.Schedule([&, textureSets]() { BatchStaticMeshes(built, builtNodes, movable, textureSets, transforms); }, { meshesBuilt });
+			}
+			loaded.push_back(meshesBuilt);
+
+			//every texture file once, textures_loaded stays the same size while the jobs write into it
+			size_t firstNew = textures_loaded.size();
+			for (aiMesh* mesh : sceneMeshes)
+			{
+				aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+				registerMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+				registerMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+			}
+			textureObjects.resize(textures_loaded.size());
+			for (size_t i = firstNew; i < textures_loaded.size(); i++)
+			{
+				std::shared_ptr<DecodedTexture> decoded = std::make_shared<DecodedTexture>();
+				std::string file = textures_loaded[i].path;
+				JobHandle decode = jobs.Schedule([this, decoded, file]() { *decoded = DecodeTexture(file.c_str(), directory); });
+				loaded.push_back(jobs.ScheduleMain([this, decoded, i]() {
+					textureObjects[i] = UploadTexture(*decoded, owner);
+					textures_loaded[i].id = textureObjects[i].Id();
+				}, { decode }));
+			}
+
+			JobHandle finished = jobs.ScheduleMain([&]() {
+				PROFILE_ZONE("model.upload", "gpu");
+				for (size_t i = 0; i < built.size(); i++)
+				{
+					aiMaterial* material = scene->mMaterials[built[i].material];
+					std::vector<Texture> textures = loadMaterialTextures(material, aiTextureType_DIFFUSE);
+					std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR);
+					textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+					meshes.push_back(Mesh(std::move(built[i].vertices), std::move(built[i].indices), std::move(textures), owner));
+				}
+				meshNodes = builtNodes;
+			}, loaded);
+			jobs.Wait(finished);
 		}
 
-		void processNode(aiNode* node, const aiScene* scene)
+		//walks the hierarchy into transforms, sceneMeshes collects the meshes in draw order and
+		//movable whether each one is skinned or below an animated node
+		void processNode(aiNode* node, const aiScene* scene, int parent, bool animated, const std::unordered_set<std::string>& animatedNodes,
+			std::vector<aiMesh*>& sceneMeshes, std::vector<bool>& movable)
 		{
+			animated = animated || animatedNodes.count(node->mName.C_Str()) > 0;
+			//the node's own transform, relative to its parent
+			aiVector3D scaling, position;
+			aiQuaternion rotation;
+			node->mTransformation.Decompose(scaling, rotation, position);
+			int index = transforms.Add(parent, glm::vec3(position.x, position.y, position.z), glm::quat(rotation.w, rotation.x, rotation.y, rotation.z),
+				glm::vec3(scaling.x, scaling.y, scaling.z));
+
 			//process all node meshes
 			for (unsigned int i = 0; i < node->mNumMeshes; i++) {
 				aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-				meshes.push_back(processMesh(mesh, scene));
+				sceneMeshes.push_back(mesh);
+				meshNodes.push_back(index);
+				movable.push_back(animated || mesh->HasBones());
 			}
 			//do the same for all the node's children
 			for (unsigned int i = 0; i < node->mNumChildren; i++) {
-				processNode(node->mChildren[i], scene);
+				processNode(node->mChildren[i], scene, index, animated, animatedNodes, sceneMeshes, movable);
 			}
 		}
 
-		Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+		MeshData processMesh(aiMesh* mesh)
 		{
-			std::vector<Vertex> vertices;
-			std::vector<unsigned int> indices;
-			std::vector<Texture> textures;
+			PROFILE_ZONE("model.processMesh", "import");
+			PROFILE_COUNTER("model.vertices", mesh->mNumVertices);
+			PROFILE_COUNTER("model.faces", mesh->mNumFaces);
+			MeshData data;
+			data.material = mesh->mMaterialIndex;
+			std::vector<Vertex>& vertices = data.vertices;
+			std::vector<unsigned int>& indices = data.indices;
 			
 			for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 			{
@@ -84,19 +234,26 @@ class Model
 				vector.z = mesh->mVertices[i].z;
 				vertex.Position = vector;
 
-				vector.x = mesh->mNormals[i].x;
-				vector.y = mesh->mNormals[i].y;
-				vector.z = mesh->mNormals[i].z;
-				vertex.Normal = vector;
-
-				vertices.push_back(vertex);
+				//files without normals get generated ones below
+				vertex.Normal = glm::vec3(0.0f);
+				if (mesh->HasNormals())
+				{
+					vector.x = mesh->mNormals[i].x;
+					vector.y = mesh->mNormals[i].y;
+					vector.z = mesh->mNormals[i].z;
+					vertex.Normal = vector;
+				}
 
+				vertex.TexCoords = glm::vec2(0.0f);
 				if (mesh->mTextureCoords[0])
 				{
 					glm::vec2 vec;
 					vec.x = mesh->mTextureCoords[0][i].x;
 					vec.y = mesh->mTextureCoords[0][i].y;
+					vertex.TexCoords = vec;
 				}
+
+				vertices.push_back(vertex);
 			}
 
 			for (unsigned int i = 0; i < mesh->mNumFaces; i++)
@@ -107,22 +264,32 @@ class Model
 					indices.push_back(face.mIndices[j]);
 				}
 			}
-			if (mesh->mMaterialIndex >= 0)
-			{
-				aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-				std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-				textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-				std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-				textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 
+			if (!mesh->HasNormals())
+				GenerateNormals(vertices, indices);
+			return data;
+		}
+
+		//meshes whose materials have the same diffuse and specular maps draw the same way
+		static std::string textureSetKey(aiMaterial* material)
+		{
+			std::string key;
+			aiTextureType types[2] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR };
+			for (aiTextureType type : types)
+			{
+				for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+				{
+					aiString path;
+					material->GetTexture(type, i, &path);
+					key += std::to_string((int)type) + ":" + path.C_Str() + "|";
+				}
 			}
-			
-			return Mesh(vertices, indices, textures);
+			return key;
 		}
 
-		std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
+		//adds the material's textures of this type that are not in textures_loaded yet, id 0 until uploaded
+		void registerMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
 		{
-			std::vector<Texture> textures;
 			for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 			{
 				aiString str;
@@ -132,7 +299,6 @@ class Model
 				{
 					if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
 					{
-						textures.push_back(textures_loaded[j]);
 						skip = true;
 						break;
 					}
@@ -140,25 +306,61 @@ class Model
 				if (!skip)
 				{
 					Texture texture;
-					texture.id = TextureFromFile(str.C_Str(), directory, false);
+					texture.id = 0;
 					texture.type = typeName;
 					texture.path = str.C_Str();
-					textures.push_back(texture);
 					textures_loaded.push_back(texture);
 				}
 			}
+		}
+
+		std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type)
+		{
+			std::vector<Texture> textures;
+			for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+			{
+				aiString str;
+				mat->GetTexture(type, i, &str);
+				for (unsigned int j = 0; j < textures_loaded.size(); j++)
+				{
+					if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+					{
+						textures.push_back(textures_loaded[j]);
+						break;
+					}
+				}
+			}
 			return textures;
 		}
 };
 
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma) {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
+//the texture is registered under directory
+GlTexture TextureFromFile(const char* path, const std::string& directory, bool gamma) {
+	DecodedTexture decoded = DecodeTexture(path, directory);
+	return UploadTexture(decoded, directory);
+}
 
+//file reading and decoding only, safe to run on any thread
+DecodedTexture DecodeTexture(const char* path, const std::string& directory) {
+	PROFILE_ZONE("texture.decode", "texture");
 	std::string filename = directory + '/' + std::string(path);
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+	DecodedTexture decoded;
+	{
+		PROFILE_ZONE("stbi_load", "texture");
+		decoded.data = stbi_load(filename.c_str(), &decoded.width, &decoded.height, &decoded.components, 0);
+	}
+	return decoded;
+}
+
+//creates the GL texture and frees the pixels, main thread only
+GlTexture UploadTexture(DecodedTexture& decoded, const std::string& owner) {
+	PROFILE_ZONE("texture.load", "texture");
+	GlTexture texture = GlTexture::Create();
+	unsigned int textureID = texture.Id();
+
+	int width = decoded.width, height = decoded.height, nrComponents = decoded.components;
+	unsigned char* data = decoded.data;
 
 	if (data) {
 		GLenum format = GL_RED;
@@ -168,9 +370,18 @@ unsigned int TextureFromFile(const char* path, const std::string& directory, boo
 			format = GL_RGB;
 		else if (nrComponents == 4)
 			format = GL_RGBA;
+		PROFILE_COUNTER("texture.count", 1);
+		PROFILE_COUNTER("texture.bytes", (size_t)width * height * nrComponents);
 		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		{
+			PROFILE_ZONE("glTexImage2D", "gpu");
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+		}
+		{
+			PROFILE_ZONE("glGenerateMipmap", "gpu");
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		texture.Track(MEMORY_TEXTURES, owner, TextureBytes(width, height, nrComponents, true));
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -183,7 +394,8 @@ unsigned int TextureFromFile(const char* path, const std::string& directory, boo
 		std::cout << "Failed to load texture" << std::endl;
 	}
 	stbi_image_free(data);
-	return textureID;
+	decoded.data = NULL;
+	return texture;
 }
 
 #endif // !MODEL_H
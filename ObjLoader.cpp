@@ -0,0 +1,546 @@
+#include "ObjLoader.h"
+#include "MeshNormals.h"
+#include "Profiler.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+//one resolved face corner: zero-based attribute indices, -1 where the corner has none
+struct FaceCorner {
+	int position;
+	int texture;
+	int normal;
+
+	bool operator==(const FaceCorner& rhs) const noexcept
+	{
+		return position == rhs.position && texture == rhs.texture && normal == rhs.normal;
+	}
+};
+
+struct FaceCornerHash {
+	size_t operator()(const FaceCorner& corner) const noexcept
+	{
+		size_t hash = (size_t)(unsigned int)corner.position * 73856093u;
+		hash ^= (size_t)(unsigned int)corner.texture * 19349663u;
+		hash ^= (size_t)(unsigned int)corner.normal * 83492791u;
+		return hash;
+	}
+};
+
+inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+inline void skipSpaces(const char*& p, const char* end)
+{
+	while (p < end && isSpace(*p))
+		p++;
+}
+
+//decimal float without locale or allocation: [+-]digits[.digits][(e|E)[+-]digits]
+bool parseFloat(const char*& p, const char* end, float& out)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+	skipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	while (p < end && isDigit(*p))
+	{
+		if (digits < 19)
+			mantissa = mantissa * 10 + (*p - '0');
+		else
+			exponent++;
+		digits++;
+		p++;
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && isDigit(*p))
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+			digits++;
+			p++;
+		}
+	}
+	if (digits == 0)
+		return false;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negativeExponent = *p++ == '-';
+		//saturates, anything past 9999 is zero or infinity for a float anyway
+		int value = 0;
+		while (p < end && isDigit(*p))
+		{
+			if (value < 10000)
+				value = value * 10 + (*p - '0');
+			p++;
+		}
+		exponent += negativeExponent ? -value : value;
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = exponent >= -18 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+	else if (exponent > 0)
+		result = exponent <= 18 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+	out = (float)(negative ? -result : result);
+	return true;
+}
+
+//fails on values outside +-INT_MAX, the line is then reported as malformed
+inline bool parseInt(const char*& p, const char* end, int& out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	if (p >= end || !isDigit(*p))
+		return false;
+	int value = 0;
+	while (p < end && isDigit(*p))
+	{
+		int digit = *p++ - '0';
+		if (value > (INT_MAX - digit) / 10)
+			return false;
+		value = value * 10 + digit;
+	}
+	out = negative ? -value : value;
+	return true;
+}
+
+//OBJ indices are 1-based, negative ones count back from the last element defined so far
+inline int resolveIndex(int index, size_t count)
+{
+	if (index > 0)
+		return index <= (int)count ? index - 1 : -2;
+	if (index < 0)
+		return -index <= (int)count ? (int)count + index : -2;
+	return -2;
+}
+
+//decodes one corner in any of the forms v, v/vt, v//vn, v/vt/vn
+bool parseCorner(const char*& p, const char* end, size_t positions, size_t texcoords, size_t normals, FaceCorner& corner)
+{
+	int value;
+	corner.texture = -1;
+	corner.normal = -1;
+	if (!parseInt(p, end, value))
+		return false;
+	corner.position = resolveIndex(value, positions);
+	if (p < end && *p == '/')
+	{
+		p++;
+		if (p < end && *p != '/')
+		{
+			if (!parseInt(p, end, value))
+				return false;
+			corner.texture = resolveIndex(value, texcoords);
+		}
+		if (p < end && *p == '/')
+		{
+			p++;
+			if (!parseInt(p, end, value))
+				return false;
+			corner.normal = resolveIndex(value, normals);
+		}
+	}
+	return corner.position >= 0 && corner.texture != -2 && corner.normal != -2;
+}
+
+//matches a keyword followed by whitespace and moves past both
+inline bool keyword(const char*& p, const char* end, const char* word)
+{
+	size_t length = strlen(word);
+	if ((size_t)(end - p) <= length || memcmp(p, word, length) != 0 || !isSpace(p[length]))
+		return false;
+	p += length;
+	skipSpaces(p, end);
+	return true;
+}
+
+inline std::string restOfLine(const char* p, const char* end)
+{
+	skipSpaces(p, end);
+	while (end > p && isSpace(end[-1]))
+		end--;
+	return std::string(p, end);
+}
+
+//texture statements may carry options (map_Kd -s 1 1 1 file.png), the file name comes last
+inline std::string texturePath(const char* p, const char* end)
+{
+	std::string value = restOfLine(p, end);
+	if (value.empty() || value[0] != '-')
+		return value;
+	size_t split = value.find_last_of(" \t");
+	return split == std::string::npos ? value : value.substr(split + 1);
+}
+
+bool readTextFile(const std::string& path, std::string& text)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	text = buffer.str();
+	return true;
+}
+
+//first defined entry that looks like material, or the table size when there is none
+unsigned int findSameMaterial(const ObjMesh& mesh, const ObjMaterial& material, unsigned int skip)
+{
+	for (unsigned int i = 0; i < mesh.materials.size(); i++)
+	{
+		if (i != skip && mesh.materials[i].Defined && mesh.materials[i].SameAs(material))
+			return i;
+	}
+	return (unsigned int)mesh.materials.size();
+}
+
+//table index for a material, reusing an existing entry when one looks the same. a name
+//usemtl met before the library defining it holds a placeholder, the definition replaces it
+//in place so the faces already bucketed under it keep their index. when the definition
+//looks like an entry already in the table, the placeholder is folded into that entry
+//instead: its faces join that bucket and the entries after it move down one, with current
+//(the bucket faces are going into, -1 for none) following along. placeholders all look
+//the same and are never shared, each undefined name keeps its own entry
+unsigned int addMaterial(ObjMesh& mesh, std::unordered_map<std::string, unsigned int>& byName, std::vector<std::vector<unsigned int>>& buckets, int& current, const ObjMaterial& material)
+{
+	std::unordered_map<std::string, unsigned int>::iterator itr = byName.find(material.Name);
+	if (itr != byName.end())
+	{
+		unsigned int placeholder = itr->second;
+		if (!material.Defined || mesh.materials[placeholder].Defined)
+			return placeholder;
+		unsigned int same = findSameMaterial(mesh, material, placeholder);
+		if (same == mesh.materials.size())
+		{
+			mesh.materials[placeholder] = material;
+			return placeholder;
+		}
+		if (placeholder < buckets.size())
+		{
+			if (same < buckets.size())
+				buckets[same].insert(buckets[same].end(), buckets[placeholder].begin(), buckets[placeholder].end());
+			buckets.erase(buckets.begin() + placeholder);
+		}
+		mesh.materials.erase(mesh.materials.begin() + placeholder);
+		for (std::pair<const std::string, unsigned int>& named : byName)
+		{
+			if (named.second == placeholder)
+				named.second = same;
+			if (named.second > placeholder)
+				named.second--;
+		}
+		if (current == (int)placeholder)
+			current = (int)same;
+		if (current > (int)placeholder)
+			current--;
+		return byName[material.Name];
+	}
+	unsigned int index = material.Defined ? findSameMaterial(mesh, material, (unsigned int)mesh.materials.size()) : (unsigned int)mesh.materials.size();
+	if (index == mesh.materials.size())
+		mesh.materials.push_back(material);
+	byName.emplace(material.Name, index);
+	return index;
+}
+
+}
+
+bool ParseMtl(const std::string& text, std::vector<ObjMaterial>& materials)
+{
+	const char* p = text.data();
+	const char* end = p + text.size();
+	ObjMaterial* current = nullptr;
+	while (p < end)
+	{
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (!lineEnd)
+			lineEnd = end;
+		const char* next = lineEnd + 1;
+		if (lineEnd > p && lineEnd[-1] == '\r')
+			lineEnd--;
+		skipSpaces(p, lineEnd);
+
+		if (keyword(p, lineEnd, "newmtl"))
+		{
+			materials.push_back(ObjMaterial());
+			current = &materials.back();
+			current->Name = restOfLine(p, lineEnd);
+			current->Defined = true;
+		}
+		else if (current)
+		{
+			if (keyword(p, lineEnd, "Ka"))
+				parseFloat(p, lineEnd, current->Ambient.x) && parseFloat(p, lineEnd, current->Ambient.y) && parseFloat(p, lineEnd, current->Ambient.z);
+			else if (keyword(p, lineEnd, "Kd"))
+				parseFloat(p, lineEnd, current->Diffuse.x) && parseFloat(p, lineEnd, current->Diffuse.y) && parseFloat(p, lineEnd, current->Diffuse.z);
+			else if (keyword(p, lineEnd, "Ks"))
+				parseFloat(p, lineEnd, current->Specular.x) && parseFloat(p, lineEnd, current->Specular.y) && parseFloat(p, lineEnd, current->Specular.z);
+			else if (keyword(p, lineEnd, "Ns"))
+				parseFloat(p, lineEnd, current->Shininess);
+			else if (keyword(p, lineEnd, "map_Kd"))
+				current->DiffuseMap = texturePath(p, lineEnd);
+			else if (keyword(p, lineEnd, "map_Ks"))
+				current->SpecularMap = texturePath(p, lineEnd);
+			else if (keyword(p, lineEnd, "map_Bump") || keyword(p, lineEnd, "map_bump") || keyword(p, lineEnd, "bump") || keyword(p, lineEnd, "norm"))
+				current->NormalMap = texturePath(p, lineEnd);
+		}
+		p = next;
+	}
+	return true;
+}
+
+bool ParseObj(const std::string& text, ObjMesh& mesh, const std::string& directory)
+{
+	PROFILE_ZONE("obj.parse", "parse");
+	mesh.Clear();
+
+	std::vector<glm::vec3> point_vertex;
+	std::vector<glm::vec3> normal_vertex;
+	std::vector<glm::vec2> texture_vertex;
+
+	//guess capacities from the file size, typical lines are 25-40 bytes
+	point_vertex.reserve(text.size() / 96);
+	mesh.vertices.reserve(text.size() / 96);
+	std::unordered_map<FaceCorner, unsigned int, FaceCornerHash> unique;
+	unique.reserve(text.size() / 96);
+
+	//faces are appended to their material's bucket as they are read, the buckets
+	//are then laid out back to back, so each material ends up with one range
+	std::unordered_map<std::string, unsigned int> materialByName;
+	std::vector<std::vector<unsigned int>> buckets;
+	std::vector<unsigned int>* target = nullptr;
+	int current = -1;
+	bool missingNormals = false;
+	bool hasTexCoords = false;
+	auto selectBucket = [&](unsigned int material) {
+		buckets.resize(mesh.materials.size());
+		target = &buckets[material];
+		current = (int)material;
+		//the first material in the table usually holds most of the faces
+		if (material == 0 && target->capacity() == 0)
+			target->reserve(text.size() / 16);
+	};
+
+	const char* p = text.data();
+	const char* end = p + text.size();
+	size_t lineNumber = 0;
+	while (p < end)
+	{
+		lineNumber++;
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (!lineEnd)
+			lineEnd = end;
+		const char* next = lineEnd + 1;
+		if (lineEnd > p && lineEnd[-1] == '\r')
+			lineEnd--;
+
+		skipSpaces(p, lineEnd);
+		const char* lineStart = p;
+		bool valid = true;
+		if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+		{
+			p += 2;
+			glm::vec3 temp;
+			valid = parseFloat(p, lineEnd, temp.x) && parseFloat(p, lineEnd, temp.y) && parseFloat(p, lineEnd, temp.z);
+			point_vertex.push_back(temp);
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+		{
+			p += 3;
+			glm::vec3 temp;
+			valid = parseFloat(p, lineEnd, temp.x) && parseFloat(p, lineEnd, temp.y) && parseFloat(p, lineEnd, temp.z);
+			normal_vertex.push_back(temp);
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+		{
+			p += 3;
+			glm::vec2 temp;
+			valid = parseFloat(p, lineEnd, temp.x) && parseFloat(p, lineEnd, temp.y);
+			texture_vertex.push_back(temp);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+		{
+			p += 2;
+			if (!target)
+			{
+				ObjMaterial fallback;
+				fallback.Name = "default";
+				selectBucket(addMaterial(mesh, materialByName, buckets, current, fallback));
+			}
+			//fan-triangulate as corners arrive: (first, previous, current)
+			unsigned int first = 0, previous = 0;
+			int corners = 0;
+			skipSpaces(p, lineEnd);
+			while (valid && p < lineEnd)
+			{
+				FaceCorner corner;
+				if (!parseCorner(p, lineEnd, point_vertex.size(), texture_vertex.size(), normal_vertex.size(), corner))
+				{
+					valid = false;
+					break;
+				}
+
+				unsigned int index;
+				std::unordered_map<FaceCorner, unsigned int, FaceCornerHash>::iterator itr = unique.find(corner);
+				if (itr != unique.end())
+				{
+					index = itr->second;
+				}
+				else
+				{
+					ObjVertex point = {};
+					point.Position = point_vertex[corner.position];
+					if (corner.texture >= 0)
+						point.TexCoords = texture_vertex[corner.texture];
+					hasTexCoords = hasTexCoords || corner.texture >= 0;
+					if (corner.normal >= 0)
+						point.Normal = normal_vertex[corner.normal];
+					else
+						missingNormals = true;
+					index = (unsigned int)mesh.vertices.size();
+					unique.emplace(corner, index);
+					mesh.vertices.push_back(point);
+				}
+
+				if (corners == 0)
+					first = index;
+				else if (corners >= 2)
+				{
+					target->push_back(first);
+					target->push_back(previous);
+					target->push_back(index);
+				}
+				previous = index;
+				corners++;
+				skipSpaces(p, lineEnd);
+			}
+			if (valid && corners >= 3)
+				mesh.faceCount++;
+		}
+		else if (keyword(p, lineEnd, "usemtl"))
+		{
+			ObjMaterial named;
+			named.Name = restOfLine(p, lineEnd);
+			selectBucket(addMaterial(mesh, materialByName, buckets, current, named));
+		}
+		else if (keyword(p, lineEnd, "mtllib"))
+		{
+			//one statement can name several libraries. one that is missing or unreadable leaves
+			//its materials undefined, it does not fail the import
+			while (p < lineEnd)
+			{
+				const char* nameEnd = p;
+				while (nameEnd < lineEnd && !isSpace(*nameEnd))
+					nameEnd++;
+				std::string mtlText;
+				std::string path = (directory.empty() ? "" : directory + "/") + std::string(p, nameEnd);
+				p = nameEnd;
+				skipSpaces(p, lineEnd);
+				mesh.libraries.push_back(path);
+				std::vector<ObjMaterial> library;
+				if (readTextFile(path, mtlText) && ParseMtl(mtlText, library))
+				{
+					for (const ObjMaterial& material : library)
+						addMaterial(mesh, materialByName, buckets, current, material);
+					//resizing and folding move the buckets, including the one faces are going into
+					if (current >= 0)
+						selectBucket((unsigned int)current);
+					else
+						buckets.resize(mesh.materials.size());
+				}
+				else
+				{
+					std::cout << "ERROR::OBJ::UNABLE_TO_READ_MTL: " << path << std::endl;
+				}
+			}
+		}
+
+		if (!valid)
+		{
+			std::cout << "ERROR::OBJ::MALFORMED_LINE " << lineNumber << ": " << std::string(lineStart, lineEnd) << std::endl;
+			return false;
+		}
+		p = next;
+	}
+
+	//lay the buckets out back to back, a single material simply takes its bucket over
+	if (buckets.size() == 1)
+	{
+		mesh.indices.swap(buckets[0]);
+		mesh.ranges.push_back({ 0, 0, (unsigned int)mesh.indices.size() });
+	}
+	else
+	{
+		size_t total = 0;
+		for (const std::vector<unsigned int>& bucket : buckets)
+			total += bucket.size();
+		mesh.indices.reserve(total);
+		for (unsigned int material = 0; material < buckets.size(); material++)
+		{
+			if (buckets[material].empty())
+				continue;
+			mesh.ranges.push_back({ material, (unsigned int)mesh.indices.size(), (unsigned int)buckets[material].size() });
+			mesh.indices.insert(mesh.indices.end(), buckets[material].begin(), buckets[material].end());
+		}
+	}
+
+	//faces written without vn would render black, give them smooth normals with hard creases
+	if (missingNormals)
+		GenerateNormals(mesh.vertices, mesh.indices);
+	bool normalMapped = false;
+	for (const ObjMaterial& material : mesh.materials)
+		normalMapped = normalMapped || (material.Defined && !material.NormalMap.empty());
+	if (normalMapped && hasTexCoords)
+		GenerateTangents(mesh.vertices, mesh.indices, mesh.tangents);
+
+	mesh.positionCount = point_vertex.size();
+	PROFILE_COUNTER("obj.vertices", point_vertex.size());
+	PROFILE_COUNTER("obj.faces", mesh.faceCount);
+	PROFILE_COUNTER("obj.indices", mesh.indices.size());
+	return true;
+}
+
+bool LoadObjFile(const std::string& path, ObjMesh& mesh)
+{
+	//read the whole file up front so disk time is separated from tokenizing
+	std::string objText;
+	{
+		PROFILE_ZONE("obj.read", "io");
+		if (!readTextFile(path, objText))
+		{
+			std::cout << "ERROR::OBJ::UNABLE_TO_OPEN_FILE: " << path << std::endl;
+			return false;
+		}
+	}
+	PROFILE_COUNTER("obj.bytes", objText.size());
+	size_t split = path.find_last_of("/\\");
+	return ParseObj(objText, mesh, split == std::string::npos ? "" : path.substr(0, split));
+}
@@ -0,0 +1,82 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+//interleaved vertex as uploaded to the GPU: position, normal, texture coordinates
+struct ObjVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+};
+
+//one entry of the material table, texture paths are relative to the OBJ file
+struct ObjMaterial {
+	std::string Name;
+	glm::vec3 Ambient = glm::vec3(0.2f);
+	glm::vec3 Diffuse = glm::vec3(0.8f);
+	glm::vec3 Specular = glm::vec3(0.5f);
+	float Shininess = 32.0f;
+	std::string DiffuseMap;
+	std::string SpecularMap;
+	std::string NormalMap;
+	//false for names used by usemtl but missing from every loaded MTL file
+	bool Defined = false;
+
+	//same look, ignoring the name: exporters often write one copy per object
+	bool SameAs(const ObjMaterial& rhs) const
+	{
+		return Defined == rhs.Defined && Ambient == rhs.Ambient && Diffuse == rhs.Diffuse && Specular == rhs.Specular && Shininess == rhs.Shininess
+			&& DiffuseMap == rhs.DiffuseMap && SpecularMap == rhs.SpecularMap && NormalMap == rhs.NormalMap;
+	}
+};
+
+//contiguous slice of ObjMesh::indices drawn with one material
+struct ObjMaterialRange {
+	unsigned int material;
+	unsigned int indexOffset;
+	unsigned int indexCount;
+};
+
+//triangle list with unique (position, texcoord, normal) combinations deduplicated,
+//indices grouped so that every material owns exactly one contiguous range. faces
+//without vn get generated normals. tangents has one entry per vertex (xyz tangent,
+//w bitangent sign) when a material has a normal map, and is empty otherwise
+struct ObjMesh {
+	std::vector<ObjVertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec4> tangents;
+	std::vector<ObjMaterial> materials;
+	std::vector<ObjMaterialRange> ranges;
+	//MTL files named by mtllib, as opened, whether or not they could be read
+	std::vector<std::string> libraries;
+	size_t positionCount = 0;
+	size_t faceCount = 0;
+
+	void Clear()
+	{
+		vertices.clear();
+		indices.clear();
+		tangents.clear();
+		materials.clear();
+		ranges.clear();
+		libraries.clear();
+		positionCount = 0;
+		faceCount = 0;
+	}
+};
+
+//parse OBJ text already in memory, returns false (and prints why) on malformed input.
+//mtllib paths are resolved against directory
+bool ParseObj(const std::string& text, ObjMesh& mesh, const std::string& directory = "");
+
+//parse MTL text, appending one ObjMaterial per newmtl
+bool ParseMtl(const std::string& text, std::vector<ObjMaterial>& materials);
+
+//read a file from disk and parse it
+bool LoadObjFile(const std::string& path, ObjMesh& mesh);
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Compile-time switch for the trace zones. Release builds (NDEBUG) compile every
+//PROFILE_* macro down to nothing unless PROFILING_ENABLED is set explicitly.
+#ifndef PROFILING_ENABLED
+#ifdef NDEBUG
+#define PROFILING_ENABLED 0
+#else
+#define PROFILING_ENABLED 1
+#endif
+#endif
+
+//one completed zone, times in microseconds since the profiler was created
+struct TraceEvent {
+	const char* name;
+	const char* category;
+	long long start;
+	long long duration;
+	unsigned int threadId;
+};
+
+//one counter update, emitted as a Chrome trace "C" event
+struct CounterSample {
+	std::string name;
+	long long time;
+	unsigned long long value;
+};
+
+//Collects trace zones and per-stage counters and writes them as Chrome trace JSON
+//(load the file in chrome://tracing or https://ui.perfetto.dev)
+class Profiler
+{
+public:
+	static Profiler& Get()
+	{
+		static Profiler instance;
+		return instance;
+	}
+
+	long long Now() const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	void AddEvent(const char* name, const char* category, long long start, long long duration)
+	{
+		unsigned int threadId = currentThreadId();
+		std::lock_guard<std::mutex> lock(mutex);
+		events.push_back({ name, category, start, duration, threadId });
+	}
+
+	//counters accumulate, so stages that run more than once (e.g. one per texture) add up
+	void AddCounter(const std::string& name, unsigned long long value)
+	{
+		long long time = Now();
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned long long& total = counters[name];
+		total += value;
+		samples.push_back({ name, time, total });
+	}
+
+	unsigned long long GetCounter(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, unsigned long long>::iterator itr = counters.find(name);
+		return itr == counters.end() ? 0 : itr->second;
+	}
+
+	bool WriteChromeTrace(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::ofstream out(path);
+		if (!out)
+		{
+			std::cout << "ERROR::PROFILER::UNABLE_TO_WRITE_TRACE: " << path << std::endl;
+			return false;
+		}
+
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		for (const TraceEvent& event : events)
+		{
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" << escape(event.category)
+				<< "\",\"ph\":\"X\",\"ts\":" << event.start << ",\"dur\":" << event.duration
+				<< ",\"pid\":1,\"tid\":" << event.threadId << "}";
+		}
+		for (const CounterSample& sample : samples)
+		{
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":\"" << escape(sample.name) << "\",\"ph\":\"C\",\"ts\":" << sample.time
+				<< ",\"pid\":1,\"args\":{\"value\":" << sample.value << "}}";
+		}
+		out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		return true;
+	}
+
+	//total time per zone name plus the final counter values
+	void PrintSummary()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, long long> totals;
+		for (const TraceEvent& event : events)
+			totals[event.name] += event.duration;
+
+		for (const std::pair<const std::string, long long>& total : totals)
+			std::cout << "PROFILE::ZONE " << total.first << " " << total.second / 1000.0 << " ms" << std::endl;
+		for (const std::pair<const std::string, unsigned long long>& counter : counters)
+			std::cout << "PROFILE::COUNTER " << counter.first << " " << counter.second << std::endl;
+	}
+
+private:
+	std::chrono::steady_clock::time_point origin;
+	std::mutex mutex;
+	std::vector<TraceEvent> events;
+	std::vector<CounterSample> samples;
+	std::map<std::string, unsigned long long> counters;
+
+	Profiler() : origin(std::chrono::steady_clock::now()) {}
+
+	//small sequential ids read better in the trace viewer than hashed std::thread::id values
+	static unsigned int currentThreadId()
+	{
+		static std::mutex idMutex;
+		static unsigned int nextId = 0;
+		thread_local unsigned int id = 0;
+		thread_local bool assigned = false;
+		if (!assigned)
+		{
+			std::lock_guard<std::mutex> lock(idMutex);
+			id = nextId++;
+			assigned = true;
+		}
+		return id;
+	}
+
+	static std::string escape(const std::string& text)
+	{
+		std::string result;
+		result.reserve(text.size());
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				result.push_back('\\');
+			result.push_back(c);
+		}
+		return result;
+	}
+};
+
+//scoped trace zone, records its lifetime when it goes out of scope
+class ProfileZone
+{
+public:
+	ProfileZone(const char* name, const char* category) : name(name), category(category), start(Profiler::Get().Now()) {}
+	~ProfileZone()
+	{
+		Profiler& profiler = Profiler::Get();
+		profiler.AddEvent(name, category, start, profiler.Now() - start);
+	}
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	const char* category;
+	long long start;
+};
+
+#if PROFILING_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name, category) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name, category)
+#define PROFILE_COUNTER(name, value) Profiler::Get().AddCounter(name, static_cast<unsigned long long>(value))
+#define PROFILE_WRITE_TRACE(path) Profiler::Get().WriteChromeTrace(path)
+#define PROFILE_PRINT_SUMMARY() Profiler::Get().PrintSummary()
+#else
+#define PROFILE_ZONE(name, category) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_WRITE_TRACE(path) ((void)0)
+#define PROFILE_PRINT_SUMMARY() ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "MemoryRegistry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+//a piece of this frame's section: write through Data, bind the buffer at Offset
+struct RingAllocation {
+	void* Data;
+	GLintptr Offset;
+	GLsizeiptr Size;
+
+	bool Valid() const { return Data != NULL; }
+};
+
+//One buffer object split into frameCount sections, one per frame in flight. A frame
+//suballocates uniforms, instance data and indirect commands from its own section, and
+//a fence placed at EndFrame() keeps the CPU off that section until the GPU has read it.
+//With three sections the wait only happens when the CPU runs two frames ahead.
+//
+//With ARB_buffer_storage (GL 4.4) the buffer is mapped once, persistent and coherent,
+//and allocations point straight into it. Without it allocations go to a CPU copy and
+//Flush() sends the new bytes with glBufferSubData, the fences still keep that write off
+//sections the GPU may be reading.
+class FrameRingBuffer
+{
+public:
+	//frames that had to wait for the GPU, and how long they waited in total
+	unsigned long long Stalls;
+	double StallMilliseconds;
+	//bytes handed to the GPU over all frames
+	unsigned long long Bytes;
+
+	FrameRingBuffer() : Stalls(0), StallMilliseconds(0.0), Bytes(0), buffer(0), mapped(NULL), persistent(false), frameCount(0), sectionSize(0),
+		section(0), head(0), flushed(0), uniformAlignment(256) {}
+
+	bool Create(size_t bytesPerFrame, unsigned int frames = 3)
+	{
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		uniformAlignment = std::max<size_t>(alignment, 16);
+		frameCount = std::max(1u, frames);
+		sectionSize = alignUp(bytesPerFrame, uniformAlignment);
+		fences.assign(frameCount, (GLsync)0);
+		size_t total = sectionSize * frameCount;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)total, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)total, flags);
+			if (!mapped)
+			{
+				std::cout << "ERROR::RING::PERSISTENT_MAP_FAILED, using buffer updates" << std::endl;
+				glDeleteBuffers(1, &buffer);
+				glGenBuffers(1, &buffer);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+				persistent = false;
+			}
+		}
+		if (!persistent)
+		{
+			glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)total, NULL, GL_STREAM_DRAW);
+			staging.resize(total);
+			mapped = staging.data();
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		memory = MemoryAllocation(MEMORY_STREAMING_BUFFERS, "ring", total);
+		section = 0;
+		head = flushed = 0;
+		return buffer != 0;
+	}
+
+	//grows every section to at least bytesPerFrame. growing waits for all frames in flight
+	//once, so call it at load or reload time rather than mid-frame
+	bool Reserve(size_t bytesPerFrame)
+	{
+		if (buffer != 0 && bytesPerFrame <= sectionSize)
+			return true;
+		unsigned int frames = frameCount > 0 ? frameCount : 3;
+		Destroy();
+		return Create(bytesPerFrame, frames);
+	}
+
+	//moves to the next section, waiting only if the GPU still reads it from frameCount frames ago
+	void BeginFrame()
+	{
+		section = (section + 1) % frameCount;
+		head = flushed = 0;
+		GLsync& fence = fences[section];
+		if (!fence)
+			return;
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			do
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			while (status == GL_TIMEOUT_EXPIRED);
+			Stalls++;
+			StallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	//size bytes from this frame's section at the given alignment, invalid when the section is full
+	RingAllocation Allocate(size_t size, size_t alignment)
+	{
+		size_t offset = alignUp(head, std::max<size_t>(alignment, 4));
+		if (offset + size > sectionSize)
+		{
+			std::cout << "ERROR::RING::OUT_OF_SPACE: " << size << " bytes, " << sectionSize - head << " left this frame" << std::endl;
+			RingAllocation none = { NULL, 0, 0 };
+			return none;
+		}
+		head = offset + size;
+		size_t position = section * sectionSize + offset;
+		RingAllocation allocation = { mapped + position, (GLintptr)position, (GLsizeiptr)size };
+		return allocation;
+	}
+
+	RingAllocation AllocateUniform(size_t size)
+	{
+		return Allocate(size, uniformAlignment);
+	}
+
+	//makes everything allocated since the last call visible to the GPU. a coherent
+	//persistent mapping needs nothing, the fallback uploads the new bytes
+	void Flush()
+	{
+		if (!persistent && head > flushed)
+		{
+			size_t position = section * sectionSize + flushed;
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)position, (GLsizeiptr)(head - flushed), staging.data() + position);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		Bytes += head - flushed;
+		flushed = head;
+	}
+
+	//after the last command reading this frame's section
+	void EndFrame()
+	{
+		Flush();
+		fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	unsigned int Buffer() const { return buffer; }
+	bool Persistent() const { return persistent; }
+	size_t SectionSize() const { return sectionSize; }
+
+	//waits for the frames still in flight, must run while the GL context is current
+	void Destroy()
+	{
+		for (GLsync& fence : fences)
+		{
+			if (!fence)
+				continue;
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		if (buffer != 0 && persistent)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+		mapped = NULL;
+		staging.clear();
+		sectionSize = 0;
+		memory.Reset();
+	}
+
+private:
+	unsigned int buffer;
+	unsigned char* mapped;
+	bool persistent;
+	std::vector<unsigned char> staging;
+	std::vector<GLsync> fences;
+	MemoryAllocation memory;
+	unsigned int frameCount;
+	size_t sectionSize;
+	unsigned int section;
+	size_t head;
+	size_t flushed;
+	size_t uniformAlignment;
+
+	static size_t alignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+};
+
+#endif
@@ -5,70 +5,68 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "Profiler.h"
+
+#include <chrono>
 #include <string>
+#include <filesystem>
 #include <fstream>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly. defines are #define lines
+    // placed right after #version in both stages
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "") : ID(0), vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        readSources(vertexCode, fragmentCode);
+        sourceTime = newestSourceTime();
+        ID = buildProgram(vertexCode, fragmentCode);
+    }
+    // linked programs are stored here, keyed by the sources and the driver. each program
+    // and define set keeps only its newest entry
+    // ------------------------------------------------------------------------
+    static std::string& CacheDirectory()
+    {
+        static std::string directory = "shader_cache";
+        return directory;
+    }
+    // rebuilds the program when either source file changed on disk. the old program stays
+    // in use when the new sources fail to compile, so a typo does not blank the screen.
+    // returns true when ID changed: uniforms that are only set once must be set again
+    // ------------------------------------------------------------------------
+    bool ReloadIfChanged()
+    {
+        //stat the files a few times a second at most, this is called every frame
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - lastCheck < std::chrono::milliseconds(250))
+            return false;
+        lastCheck = now;
+        std::filesystem::file_time_type newest = newestSourceTime();
+        if (newest == sourceTime)
+            return false;
+        sourceTime = newest;
+
+        std::string vertexCode;
+        std::string fragmentCode;
+        if (!readSources(vertexCode, fragmentCode))
+            return false;
+        unsigned int program = buildProgram(vertexCode, fragmentCode);
+        if (program == 0)
+            return false;
+        glDeleteProgram(ID);
+        ID = program;
+        std::cout << "SHADER::RELOADED " << vertexPath << " + " << fragmentPath << std::endl;
+        return true;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -130,15 +128,253 @@ public:
         glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
+    //uniform blocks are matched to buffer binding points per program, GLSL 330 has no binding layout
+    void setBlockBinding(const std::string& name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+    // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string defines;
+    std::filesystem::file_time_type sourceTime;
+    std::chrono::steady_clock::time_point lastCheck;
+
+    // retrieve the vertex/fragment source code from filePath
+    // ------------------------------------------------------------------------
+    bool readSources(std::string& vertexCode, std::string& fragmentCode)
+    {
+        std::ifstream vShaderFile;
+        std::ifstream fShaderFile;
+        // ensure ifstream objects can throw exceptions:
+        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            // open files
+            vShaderFile.open(vertexPath);
+            fShaderFile.open(fragmentPath);
+            std::stringstream vShaderStream, fShaderStream;
+            // read file's buffer contents into streams
+            vShaderStream << vShaderFile.rdbuf();
+            fShaderStream << fShaderFile.rdbuf();
+            // close file handlers
+            vShaderFile.close();
+            fShaderFile.close();
+            // convert stream into string
+            vertexCode = vShaderStream.str();
+            fragmentCode = fShaderStream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    std::filesystem::file_time_type newestSourceTime() const
+    {
+        std::error_code error;
+        std::filesystem::file_time_type vertexTime = std::filesystem::last_write_time(vertexPath, error);
+        std::filesystem::file_time_type fragmentTime = std::filesystem::last_write_time(fragmentPath, error);
+        return vertexTime > fragmentTime ? vertexTime : fragmentTime;
+    }
+    // a program from the binary cache when a valid entry exists, otherwise compile and link
+    // and store the result. returns 0 when compiling or linking failed
+    // ------------------------------------------------------------------------
+    unsigned int buildProgram(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        PROFILE_ZONE("shader.build", "shader");
+        std::string vertexCode = injectDefines(vertexSource);
+        std::string fragmentCode = injectDefines(fragmentSource);
+        //program binaries are only valid for the driver that produced them, so the driver is part of the key
+        bool binarySupported = (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary) && binaryFormatCount() > 0;
+        std::string cachePath;
+        if (binarySupported)
+        {
+            std::string driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+            unsigned long long key = hashString(vertexCode, 14695981039346656037ull);
+            key = hashString(std::string(1, '\0') + fragmentCode, key);
+            key = hashString(std::string(1, '\0') + driver, key);
+            //entries are named <program>-<key>.bin, the program part covers the file paths and
+            //defines, so an edit leaves an older entry of the same program behind to remove
+            std::stringstream name;
+            name << CacheDirectory() << "/" << std::hex << programHash() << "-" << key << ".bin";
+            cachePath = name.str();
+
+            unsigned int program = loadBinary(cachePath);
+            if (program != 0)
+            {
+                PROFILE_COUNTER("shader.cache_hits", 1);
+                return program;
+            }
+            PROFILE_COUNTER("shader.cache_misses", 1);
+        }
+
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        // compile shaders
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        bool compiled = checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        compiled = checkCompileErrors(fragment, "FRAGMENT") && compiled;
+        // shader Program
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        if (binarySupported)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        bool linked = checkCompileErrors(program, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if (!compiled || !linked)
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+        if (binarySupported)
+            saveBinary(program, cachePath);
+        return program;
+    }
+    // ------------------------------------------------------------------------
+    std::string injectDefines(const std::string& source) const
+    {
+        if (defines.empty())
+            return source;
+        size_t position = 0;
+        if (source.compare(0, 8, "#version") == 0)
+        {
+            position = source.find('\n');
+            position = position == std::string::npos ? source.size() : position + 1;
+        }
+        return source.substr(0, position) + defines + source.substr(position);
+    }
+    // a program created from a cache file, 0 when there is no entry or the driver rejects it
+    // ------------------------------------------------------------------------
+    unsigned int loadBinary(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return 0;
+        GLenum format = 0;
+        file.read((char*)&format, sizeof(format));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+        if (binary.empty())
+            return 0;
+
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            //stale entry, e.g. after a driver update that kept the version string
+            glDeleteProgram(program);
+            std::error_code error;
+            std::filesystem::remove(path, error);
+            return 0;
+        }
+        return program;
+    }
+    // ------------------------------------------------------------------------
+    void saveBinary(unsigned int program, const std::string& path)
+    {
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(CacheDirectory(), error);
+        //write under a temporary name so a crash never leaves a truncated entry behind
+        std::string temporary = path + ".tmp";
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::UNABLE_TO_WRITE_CACHE: " << path << std::endl;
+            return;
+        }
+        file.write((const char*)&format, sizeof(format));
+        file.write(binary.data(), binary.size());
+        file.close();
+        std::filesystem::rename(temporary, path, error);
+        removeStaleBinaries(path);
+    }
+    // deletes the other entries of this program, which belong to sources or drivers it no
+    // longer uses. without this every shader edit leaves a file behind for good
+    // ------------------------------------------------------------------------
+    void removeStaleBinaries(const std::string& current) const
+    {
+        std::stringstream prefix;
+        prefix << std::hex << programHash() << "-";
+        std::string currentName = std::filesystem::path(current).filename().string();
+        std::error_code error;
+        std::vector<std::filesystem::path> stale;
+        for (std::filesystem::directory_iterator itr(CacheDirectory(), error), end; !error && itr != end; itr.increment(error))
+        {
+            std::string name = itr->path().filename().string();
+            if (name != currentName && name.compare(0, prefix.str().size(), prefix.str()) == 0)
+                stale.push_back(itr->path());
+        }
+        for (const std::filesystem::path& path : stale)
+            std::filesystem::remove(path, error);
+    }
+    // ------------------------------------------------------------------------
+    unsigned long long programHash() const
+    {
+        unsigned long long hash = hashString(vertexPath, 14695981039346656037ull);
+        hash = hashString(std::string(1, '\0') + fragmentPath, hash);
+        return hashString(std::string(1, '\0') + defines, hash);
+    }
+    // ------------------------------------------------------------------------
+    static int binaryFormatCount()
+    {
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats;
+    }
+    // ------------------------------------------------------------------------
+    static std::string glString(GLenum name)
+    {
+        const GLubyte* value = glGetString(name);
+        return value ? std::string((const char*)value) : std::string();
+    }
+    // FNV-1a, the same hash the headless frame check uses
+    // ------------------------------------------------------------------------
+    static unsigned long long hashString(const std::string& text, unsigned long long hash)
+    {
+        for (unsigned char c : text)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(unsigned int shader, std::string type)
+    bool checkCompileErrors(unsigned int shader, std::string type)
     {
         int success;
         char infoLog[1024];
@@ -160,6 +396,67 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
+
+// compile-time switches for shader.fs. every distinct combination is its own program, so
+// disabled lights and missing maps cost nothing in the fragment shader
+struct ShaderPermutation
+{
+    int pointLights = 4;
+    bool dirLight = true;
+    bool spotLight = true;
+    bool specularMap = true;
+    bool normalMap = false;
+
+    std::string Defines() const
+    {
+        std::stringstream defines;
+        defines << "#define NR_POINT_LIGHTS " << pointLights << "\n"
+            << "#define HAS_DIR_LIGHT " << (dirLight ? 1 : 0) << "\n"
+            << "#define HAS_SPOT_LIGHT " << (spotLight ? 1 : 0) << "\n"
+            << "#define HAS_SPECULAR_MAP " << (specularMap ? 1 : 0) << "\n"
+            << "#define HAS_NORMAL_MAP " << (normalMap ? 1 : 0) << "\n";
+        return defines.str();
+    }
+};
+
+// all permutations of one vertex/fragment pair. a variant is compiled the first
+// time it is asked for and kept for the rest of the run
+class ShaderVariants
+{
+public:
+    ShaderVariants(const char* vertexPath, const char* fragmentPath) : vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+
+    Shader& Get(const ShaderPermutation& permutation)
+    {
+        std::string key = permutation.Defines();
+        std::map<std::string, std::unique_ptr<Shader>>::iterator itr = variants.find(key);
+        if (itr != variants.end())
+            return *itr->second;
+        PROFILE_COUNTER("shader.variants", 1);
+        std::unique_ptr<Shader>& shader = variants[key];
+        shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), key));
+        return *shader;
+    }
+    // reloads every variant built so far, true when any program changed
+    bool ReloadIfChanged()
+    {
+        bool reloaded = false;
+        for (std::pair<const std::string, std::unique_ptr<Shader>>& variant : variants)
+            reloaded = variant.second->ReloadIfChanged() || reloaded;
+        return reloaded;
+    }
+
+    size_t Count() const
+    {
+        return variants.size();
+    }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::map<std::string, std::unique_ptr<Shader>> variants;
+};
 #endif
\ No newline at end of file
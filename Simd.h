@@ -0,0 +1,91 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#else
+#define SIMD_WIDTH 1
+#endif
+
+namespace simd {
+
+//a register of floats, one lane per item, so SoA kernels are written once for AVX, SSE
+//and plain scalar code. the width is picked at compile time (-mavx for AVX). comparisons
+//return a mask of the same type for Select()
+#if SIMD_WIDTH == 8
+struct Lanes {
+	__m256 v;
+	static const int Width = 8;
+	static Lanes Load(const float* p) { Lanes r; r.v = _mm256_loadu_ps(p); return r; }
+	static Lanes Set(float s) { Lanes r; r.v = _mm256_set1_ps(s); return r; }
+	void Store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+inline Lanes operator+(Lanes a, Lanes b) { a.v = _mm256_add_ps(a.v, b.v); return a; }
+inline Lanes operator-(Lanes a, Lanes b) { a.v = _mm256_sub_ps(a.v, b.v); return a; }
+inline Lanes operator*(Lanes a, Lanes b) { a.v = _mm256_mul_ps(a.v, b.v); return a; }
+inline Lanes operator/(Lanes a, Lanes b) { a.v = _mm256_div_ps(a.v, b.v); return a; }
+inline Lanes Sqrt(Lanes a) { a.v = _mm256_sqrt_ps(a.v); return a; }
+inline Lanes Min(Lanes a, Lanes b) { a.v = _mm256_min_ps(a.v, b.v); return a; }
+inline Lanes Max(Lanes a, Lanes b) { a.v = _mm256_max_ps(a.v, b.v); return a; }
+inline Lanes Abs(Lanes a) { a.v = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); return a; }
+inline Lanes Less(Lanes a, Lanes b) { a.v = _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); return a; }
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) { mask.v = _mm256_blendv_ps(b.v, a.v, mask.v); return mask; }
+#elif SIMD_WIDTH == 4
+struct Lanes {
+	__m128 v;
+	static const int Width = 4;
+	static Lanes Load(const float* p) { Lanes r; r.v = _mm_loadu_ps(p); return r; }
+	static Lanes Set(float s) { Lanes r; r.v = _mm_set1_ps(s); return r; }
+	void Store(float* p) const { _mm_storeu_ps(p, v); }
+};
+inline Lanes operator+(Lanes a, Lanes b) { a.v = _mm_add_ps(a.v, b.v); return a; }
+inline Lanes operator-(Lanes a, Lanes b) { a.v = _mm_sub_ps(a.v, b.v); return a; }
+inline Lanes operator*(Lanes a, Lanes b) { a.v = _mm_mul_ps(a.v, b.v); return a; }
+inline Lanes operator/(Lanes a, Lanes b) { a.v = _mm_div_ps(a.v, b.v); return a; }
+inline Lanes Sqrt(Lanes a) { a.v = _mm_sqrt_ps(a.v); return a; }
+inline Lanes Min(Lanes a, Lanes b) { a.v = _mm_min_ps(a.v, b.v); return a; }
+inline Lanes Max(Lanes a, Lanes b) { a.v = _mm_max_ps(a.v, b.v); return a; }
+inline Lanes Abs(Lanes a) { a.v = _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); return a; }
+inline Lanes Less(Lanes a, Lanes b) { a.v = _mm_cmplt_ps(a.v, b.v); return a; }
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) { mask.v = _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); return mask; }
+#endif
+
+struct Scalar {
+	float v;
+	static const int Width = 1;
+	static Scalar Load(const float* p) { Scalar r; r.v = *p; return r; }
+	static Scalar Set(float s) { Scalar r; r.v = s; return r; }
+	void Store(float* p) const { *p = v; }
+};
+inline Scalar operator+(Scalar a, Scalar b) { a.v += b.v; return a; }
+inline Scalar operator-(Scalar a, Scalar b) { a.v -= b.v; return a; }
+inline Scalar operator*(Scalar a, Scalar b) { a.v *= b.v; return a; }
+inline Scalar operator/(Scalar a, Scalar b) { a.v /= b.v; return a; }
+inline Scalar Sqrt(Scalar a) { a.v = std::sqrt(a.v); return a; }
+inline Scalar Min(Scalar a, Scalar b) { a.v = a.v < b.v ? a.v : b.v; return a; }
+inline Scalar Max(Scalar a, Scalar b) { a.v = a.v > b.v ? a.v : b.v; return a; }
+inline Scalar Abs(Scalar a) { a.v = std::fabs(a.v); return a; }
+inline Scalar Less(Scalar a, Scalar b) { a.v = a.v < b.v ? 1.0f : 0.0f; return a; }
+inline Scalar Select(Scalar mask, Scalar a, Scalar b) { return mask.v != 0.0f ? a : b; }
+
+//acos with at most 7e-5 radians of error (Abramowitz and Stegun 4.4.45), x in [-1, 1]
+template <typename V>
+inline V Acos(V x)
+{
+	V a = Abs(x);
+	V r = V::Set(-0.0187293f) * a + V::Set(0.0742610f);
+	r = r * a - V::Set(0.2121144f);
+	r = r * a + V::Set(1.5707288f);
+	r = r * Sqrt(V::Set(1.0f) - a);
+	return Select(Less(x, V::Set(0.0f)), V::Set(3.14159265f) - r, r);
+}
+
+}
+
+#endif
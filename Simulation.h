@@ -0,0 +1,232 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+//held keys the simulation reacts to. GLFW input can only be read on the main thread,
+//so it samples them and hands them over with PushInput()
+enum SimulationKey {
+	SIM_CAMERA_FORWARD,
+	SIM_CAMERA_BACKWARD,
+	SIM_CAMERA_LEFT,
+	SIM_CAMERA_RIGHT,
+	SIM_MODEL_UP,
+	SIM_MODEL_DOWN,
+	SIM_MODEL_LEFT,
+	SIM_MODEL_RIGHT,
+	SIM_MODEL_AWAY,
+	SIM_MODEL_TOWARDS,
+	SIM_MODEL_SPIN,
+	SIM_KEY_COUNT
+};
+
+struct SimulationInput {
+	bool keys[SIM_KEY_COUNT] = {};
+	//mouse and scroll movement since the last PushInput()
+	glm::vec2 mouseOffset = glm::vec2(0.0f);
+	float scrollOffset = 0.0f;
+};
+
+//everything the renderer needs from one tick
+struct SimulationState {
+	double time;
+	glm::vec3 modelTranslation;
+	float modelAngle;
+	glm::vec3 cameraPosition;
+	float cameraYaw;
+	float cameraPitch;
+	float cameraZoom;
+};
+
+//model movement per second, the old per-frame 0.01 at 60 frames per second
+const float MODEL_SPEED = 0.6f;
+const float MODEL_SPIN_SPEED = 0.6f;
+
+//Runs the camera and model motion at a fixed timestep on its own thread. Each frame the
+//render thread publishes its clock with Advance() and gets back the state at the clock it
+//published the frame before, interpolated between the two ticks around it. So the renderer
+//draws one frame behind the simulation: while frame N is submitted, the update thread
+//already steps towards the time of frame N+1. The render thread only waits when the
+//simulation has not reached the previous frame's time yet.
+//
+//Ticks are a pure function of the input and the step, so motion speed no longer depends
+//on the frame rate, and a fixed render clock (headless runs) gives the same frames every run.
+class SimulationLoop
+{
+public:
+	//ticks simulated, and how often and how long the render thread had to wait for them
+	std::atomic<unsigned long long> Ticks;
+	unsigned long long Waits;
+	double WaitMilliseconds;
+
+	SimulationLoop() : Ticks(0), Waits(0), WaitMilliseconds(0.0), step(1.0 / 120.0), target(0.0), sampleTime(0.0), running(false) {}
+	~SimulationLoop() { Stop(); }
+
+	//starts ticking from camera and the model transform at render clock startTime
+	void Start(const Camera& camera, glm::vec3 modelTranslation, float modelAngle, double startTime, double stepSeconds = 1.0 / 120.0)
+	{
+		Stop();
+		step = stepSeconds;
+		simCamera = camera;
+		SimulationState initial = { startTime, modelTranslation, modelAngle, camera.Position, camera.Yaw, camera.Pitch, camera.Zoom };
+		history.assign(1, initial);
+		target = sampleTime = startTime;
+		input = SimulationInput();
+		Ticks = 0;
+		running = true;
+		worker = std::thread(&SimulationLoop::run, this);
+	}
+
+	void Stop()
+	{
+		if (!running)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+			running = false;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+
+	//held keys replace the previous ones, mouse and scroll movement add up until a tick takes them
+	void PushInput(const SimulationInput& frameInput)
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		glm::vec2 mouseOffset = input.mouseOffset + frameInput.mouseOffset;
+		float scrollOffset = input.scrollOffset + frameInput.scrollOffset;
+		input = frameInput;
+		input.mouseOffset = mouseOffset;
+		input.scrollOffset = scrollOffset;
+	}
+
+	//publishes the render clock and returns the state for the clock published last time
+	SimulationState Advance(double now)
+	{
+		std::unique_lock<std::mutex> lock(stateMutex);
+		double sample = sampleTime;
+		sampleTime = now;
+		target = std::max(target, now);
+		wake.notify_all();
+
+		if (history.back().time < sample)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			ticked.wait(lock, [&]() { return history.back().time >= sample || !running; });
+			Waits++;
+			WaitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		//the two ticks around sample, older ones are not needed again
+		while (history.size() > 2 && history[1].time <= sample)
+			history.pop_front();
+		if (history.size() == 1)
+			return history[0];
+		float alpha = (float)glm::clamp((sample - history[0].time) / step, 0.0, 1.0);
+		return interpolate(history[0], history[1], alpha);
+	}
+
+	double Step() const { return step; }
+
+private:
+	double step;
+	Camera simCamera;
+	std::deque<SimulationState> history;
+	SimulationInput input;
+	double target;
+	double sampleTime;
+	bool running;
+	std::thread worker;
+	std::mutex stateMutex;
+	std::condition_variable wake;
+	std::condition_variable ticked;
+
+	static SimulationState interpolate(const SimulationState& a, const SimulationState& b, float alpha)
+	{
+		SimulationState state;
+		state.time = a.time + (b.time - a.time) * alpha;
+		state.modelTranslation = glm::mix(a.modelTranslation, b.modelTranslation, alpha);
+		state.modelAngle = glm::mix(a.modelAngle, b.modelAngle, alpha);
+		state.cameraPosition = glm::mix(a.cameraPosition, b.cameraPosition, alpha);
+		state.cameraYaw = glm::mix(a.cameraYaw, b.cameraYaw, alpha);
+		state.cameraPitch = glm::mix(a.cameraPitch, b.cameraPitch, alpha);
+		state.cameraZoom = glm::mix(a.cameraZoom, b.cameraZoom, alpha);
+		return state;
+	}
+
+	//one fixed step from previous, the only place motion happens
+	SimulationState tick(const SimulationState& previous, const SimulationInput& tickInput)
+	{
+		float dt = (float)step;
+		simCamera.ProcessMouseMovement(tickInput.mouseOffset.x, tickInput.mouseOffset.y);
+		if (tickInput.scrollOffset != 0.0f)
+			simCamera.ProcessMouseScroll(tickInput.scrollOffset);
+		if (tickInput.keys[SIM_CAMERA_FORWARD])
+			simCamera.ProcessKeyBoard(FORWARD, dt);
+		if (tickInput.keys[SIM_CAMERA_BACKWARD])
+			simCamera.ProcessKeyBoard(BACKWARD, dt);
+		if (tickInput.keys[SIM_CAMERA_LEFT])
+			simCamera.ProcessKeyBoard(LEFT, dt);
+		if (tickInput.keys[SIM_CAMERA_RIGHT])
+			simCamera.ProcessKeyBoard(RIGHT, dt);
+
+		SimulationState next = previous;
+		next.time = previous.time + step;
+		glm::vec3 move(0.0f);
+		if (tickInput.keys[SIM_MODEL_UP])
+			move.y += 1.0f;
+		if (tickInput.keys[SIM_MODEL_DOWN])
+			move.y -= 1.0f;
+		if (tickInput.keys[SIM_MODEL_LEFT])
+			move.x -= 1.0f;
+		if (tickInput.keys[SIM_MODEL_RIGHT])
+			move.x += 1.0f;
+		if (tickInput.keys[SIM_MODEL_AWAY])
+			move.z -= 1.0f;
+		if (tickInput.keys[SIM_MODEL_TOWARDS])
+			move.z += 1.0f;
+		next.modelTranslation += move * MODEL_SPEED * dt;
+		if (tickInput.keys[SIM_MODEL_SPIN])
+			next.modelAngle += MODEL_SPIN_SPEED * dt;
+		next.cameraPosition = simCamera.Position;
+		next.cameraYaw = simCamera.Yaw;
+		next.cameraPitch = simCamera.Pitch;
+		next.cameraZoom = simCamera.Zoom;
+		return next;
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(stateMutex);
+		while (running)
+		{
+			//tick until the latest state reaches the published clock, so the next Advance()
+			//finds both ticks around the time it samples
+			wake.wait(lock, [&]() { return !running || history.back().time < target; });
+			while (running && history.back().time < target)
+			{
+				SimulationState previous = history.back();
+				SimulationInput tickInput = input;
+				input.mouseOffset = glm::vec2(0.0f);
+				input.scrollOffset = 0.0f;
+				lock.unlock();
+				SimulationState next = tick(previous, tickInput);
+				lock.lock();
+				history.push_back(next);
+				Ticks++;
+				ticked.notify_all();
+			}
+		}
+		ticked.notify_all();
+	}
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef STATIC_BATCHING_H
+#define STATIC_BATCHING_H
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "TransformSystem.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+//largest mesh static batching merges into, in vertices
+const unsigned int STATIC_BATCH_MAX_VERTICES = 65536;
+
+//vertices and indices of one imported mesh before it becomes a Mesh. V needs Position and
+//Normal members
+template <typename V>
+struct StaticMeshData {
+	std::vector<V> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int material;
+};
+
+namespace static_batching {
+
+//spreads the low 10 bits of v three bits apart, for a 30 bit Morton code
+inline unsigned int spreadBits(unsigned int v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+}
+
+//Static batching: meshes that no animation moves are moved into model space and merged
+//with the others sharing their texture set (textureSets[material], equal strings draw the
+//same way). Inside a texture set the meshes are sorted along a Morton curve through their
+//centers and cut into runs of at most STATIC_BATCH_MAX_VERTICES, so every batch covers one
+//compact region and can still be culled on its own. Meshes under a mirroring transform get
+//their triangles' winding swapped, so they face the same way as before once merged.
+//
+//nodes[i] is the node built[i] hangs off in transforms, which has to be up to date. On
+//return built starts with the movable (and empty) meshes as they were, with their nodes,
+//followed by the batches, which have node -1. Returns how many meshes were kept as they were.
+template <typename V>
+size_t BatchStaticMeshes(std::vector<StaticMeshData<V>>& built, std::vector<int>& nodes, const std::vector<bool>& movable,
+	const std::vector<std::string>& textureSets, const TransformSystem& transforms)
+{
+	PROFILE_ZONE("model.batch", "import");
+	std::vector<StaticMeshData<V>> batched;
+	std::vector<int> batchedNodes;
+	std::map<std::string, std::vector<unsigned int>> groups;
+	std::vector<glm::vec3> centers(built.size());
+	for (size_t i = 0; i < built.size(); i++)
+	{
+		if (movable[i] || built[i].vertices.empty())
+		{
+			batched.push_back(std::move(built[i]));
+			batchedNodes.push_back(nodes[i]);
+			continue;
+		}
+		glm::vec3 low = built[i].vertices[0].Position, high = low;
+		for (const V& vertex : built[i].vertices)
+		{
+			low = glm::min(low, vertex.Position);
+			high = glm::max(high, vertex.Position);
+		}
+		centers[i] = glm::vec3(transforms.World(nodes[i]) * glm::vec4((low + high) * 0.5f, 1.0f));
+		groups[textureSets[built[i].material]].push_back((unsigned int)i);
+	}
+
+	std::vector<std::vector<unsigned int>> plans;
+	for (std::pair<const std::string, std::vector<unsigned int>>& group : groups)
+	{
+		std::vector<unsigned int>& members = group.second;
+		glm::vec3 low = centers[members[0]], high = low;
+		for (unsigned int i : members)
+		{
+			low = glm::min(low, centers[i]);
+			high = glm::max(high, centers[i]);
+		}
+		glm::vec3 scale = 1023.0f / glm::max(high - low, glm::vec3(1e-20f));
+		std::vector<std::pair<unsigned int, unsigned int>> order;
+		for (unsigned int i : members)
+		{
+			glm::vec3 cell = (centers[i] - low) * scale;
+			unsigned int code = static_batching::spreadBits((unsigned int)cell.x) | (static_batching::spreadBits((unsigned int)cell.y) << 1)
+				| (static_batching::spreadBits((unsigned int)cell.z) << 2);
+			order.push_back(std::make_pair(code, i));
+		}
+		std::sort(order.begin(), order.end());
+		size_t vertexCount = 0;
+		for (const std::pair<unsigned int, unsigned int>& entry : order)
+		{
+			size_t size = built[entry.second].vertices.size();
+			if (plans.empty() || plans.back().empty() || vertexCount + size > STATIC_BATCH_MAX_VERTICES)
+			{
+				plans.push_back(std::vector<unsigned int>());
+				vertexCount = 0;
+			}
+			plans.back().push_back(entry.second);
+			vertexCount += size;
+		}
+		//the next texture set starts a batch of its own
+		plans.push_back(std::vector<unsigned int>());
+	}
+	plans.erase(std::remove_if(plans.begin(), plans.end(), [](const std::vector<unsigned int>& plan) { return plan.empty(); }), plans.end());
+
+	size_t first = batched.size();
+	batched.resize(first + plans.size());
+	batchedNodes.resize(first + plans.size(), -1);
+	JobSystem& jobs = JobSystem::Get();
+	jobs.Wait(jobs.ParallelFor(plans.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; p++)
+		{
+			StaticMeshData<V>& merged = batched[first + p];
+			merged.material = built[plans[p][0]].material;
+			for (unsigned int i : plans[p])
+			{
+				const StaticMeshData<V>& source = built[i];
+				const glm::mat4& world = transforms.World(nodes[i]);
+				glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+				unsigned int base = (unsigned int)merged.vertices.size();
+				for (V vertex : source.vertices)
+				{
+					vertex.Position = glm::vec3(world * glm::vec4(vertex.Position, 1.0f));
+					glm::vec3 normal = normalMatrix * vertex.Normal;
+					float length = glm::length(normal);
+					vertex.Normal = length > 0.0f ? normal / length : normal;
+					merged.vertices.push_back(vertex);
+				}
+				//a mirroring transform turns counter-clockwise triangles clockwise
+				bool mirrored = glm::determinant(glm::mat3(world)) < 0.0f;
+				for (size_t t = 0; t + 2 < source.indices.size(); t += 3)
+				{
+					merged.indices.push_back(base + source.indices[t]);
+					merged.indices.push_back(base + source.indices[t + (mirrored ? 2 : 1)]);
+					merged.indices.push_back(base + source.indices[t + (mirrored ? 1 : 2)]);
+				}
+			}
+		}
+	}));
+	PROFILE_COUNTER("model.batch_meshes", built.size());
+	PROFILE_COUNTER("model.batch_draws", batched.size());
+	built = std::move(batched);
+	nodes = std::move(batchedNodes);
+	return first;
+}
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "MemoryRegistry.h"
+#include "ObjLoader.h"
+#include "Profiler.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//levels at most this many texels wide stay resident from load to exit
+const int TEXTURE_TAIL_SIZE = 64;
+//file decodes for streamed mips running at once, each holds a full-size image
+const size_t MAX_TEXTURE_LOADS = 4;
+
+//how densely a material range's texture coordinates cover its surface, with its
+//object-space bounds. a range drawn d units away needs about
+//texcoordsPerUnit * d / focalPixels texture coordinates per pixel
+struct TextureFootprint {
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	float texcoordsPerUnit;
+
+	//texture coordinates per screen pixel at the range's nearest point, focalPixels is the
+	//viewport height over 2 tan(fovy / 2). the model matrix is assumed to carry no scale
+	float TexcoordsPerPixel(const glm::mat4& model, const glm::vec3& eye, float focalPixels) const
+	{
+		glm::vec3 worldMin(FLT_MAX), worldMax(-FLT_MAX);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+			glm::vec3 world = glm::vec3(model * glm::vec4(point, 1.0f));
+			worldMin = glm::min(worldMin, world);
+			worldMax = glm::max(worldMax, world);
+		}
+		glm::vec3 outside = glm::max(glm::max(worldMin - eye, eye - worldMax), glm::vec3(0.0f));
+		//inside the box the surface can be as close as the near plane
+		float distance = std::max(glm::length(outside), 0.1f);
+		return texcoordsPerUnit * distance / focalPixels;
+	}
+};
+
+//one footprint per material range: texture area over surface area of its triangles
+inline void MeasureFootprints(const ObjMesh& mesh, std::vector<TextureFootprint>& footprints)
+{
+	PROFILE_ZONE("textures.footprints", "import");
+	footprints.clear();
+	for (const ObjMaterialRange& range : mesh.ranges)
+	{
+		TextureFootprint footprint = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), 0.0f };
+		double area = 0.0, texcoordArea = 0.0;
+		for (unsigned int i = 0; i + 2 < range.indexCount; i += 3)
+		{
+			const ObjVertex& a = mesh.vertices[mesh.indices[range.indexOffset + i]];
+			const ObjVertex& b = mesh.vertices[mesh.indices[range.indexOffset + i + 1]];
+			const ObjVertex& c = mesh.vertices[mesh.indices[range.indexOffset + i + 2]];
+			footprint.boundsMin = glm::min(glm::min(footprint.boundsMin, a.Position), glm::min(b.Position, c.Position));
+			footprint.boundsMax = glm::max(glm::max(footprint.boundsMax, a.Position), glm::max(b.Position, c.Position));
+			area += 0.5 * glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+			glm::vec2 du = b.TexCoords - a.TexCoords, dv = c.TexCoords - a.TexCoords;
+			texcoordArea += 0.5 * std::fabs(du.x * dv.y - du.y * dv.x);
+		}
+		if (area > 0.0)
+			footprint.texcoordsPerUnit = (float)std::sqrt(texcoordArea / area);
+		else
+			footprint.boundsMin = footprint.boundsMax = glm::vec3(0.0f);
+		footprints.push_back(footprint);
+	}
+}
+
+//Keeps textures within a fixed GPU memory budget by mip level. Load() uploads only the
+//levels at most TEXTURE_TAIL_SIZE texels wide. Every frame the renderer asks for the level
+//each visible material needs, and Update() decodes the missing finer levels on the job
+//system. They are uploaded by a main-thread job, which first makes room by dropping the
+//finest level of whichever texture went longest without needing it. Levels needed in the
+//latest frame are never dropped, so a load that does not fit is cut to the levels that do.
+//The tails always stay, so the budget can be exceeded by them alone. Sizes are counted as
+//width * height * components per level, like texture.bytes.
+class TextureStreamer
+{
+public:
+	size_t Budget = 0;
+	size_t PeakBytes = 0;
+	size_t StreamedBytes = 0;
+	size_t LoadedLevels = 0;
+	size_t EvictedLevels = 0;
+
+	void SetBudget(size_t bytes) { Budget = bytes; }
+	bool Active() const { return Budget > 0; }
+	size_t ResidentBytes() const { return residentBytes; }
+	size_t TextureCount() const { return textures.size(); }
+
+	//decodes the file and uploads its tail, returns the GL texture, which keeps its id until
+	//Destroy(). its resident levels are registered under owner
+	unsigned int Load(const std::string& path, const std::string& owner)
+	{
+		PROFILE_ZONE("texture.load", "texture");
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		int width, height, components;
+		unsigned char* data;
+		{
+			PROFILE_ZONE("stbi_load", "texture");
+			data = stbi_load(path.c_str(), &width, &height, &components, 0);
+		}
+		if (!data)
+		{
+			std::cout << "Failed to load texture" << std::endl;
+			return textureID;
+		}
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		StreamedTexture texture;
+		texture.path = path;
+		texture.id = textureID;
+		texture.memory = MemoryAllocation(MEMORY_TEXTURES, owner, 0);
+		textures.push_back(std::move(texture));
+		byId[textureID] = textures.size() - 1;
+		uploadTail(textures.back(), data, width, height, components);
+		stbi_image_free(data);
+		PROFILE_COUNTER("texture.count", 1);
+		return textureID;
+	}
+
+	//true for textures created by Load()
+	bool Streams(unsigned int id) const { return byId.count(id) > 0; }
+
+	//new pixels for a streamed texture, the id stays and its finer levels stream in again
+	void Reload(unsigned int id, const unsigned char* pixels, int width, int height, int components)
+	{
+		std::unordered_map<unsigned int, size_t>::iterator itr = byId.find(id);
+		if (itr == byId.end())
+			return;
+		StreamedTexture& texture = textures[itr->second];
+		texture.generation++;
+		glBindTexture(GL_TEXTURE_2D, id);
+		for (int level = texture.base; level < texture.levels; level++)
+			glTexImage2D(GL_TEXTURE_2D, level, texture.format(), 0, 0, 0, texture.format(), GL_UNSIGNED_BYTE, NULL);
+		residentBytes -= texture.bytesFrom(texture.base);
+		uploadTail(texture, pixels, width, height, components);
+	}
+
+	//the texture is sampled this frame at about texcoordsPerPixel texture coordinates per pixel
+	void Request(unsigned int id, float texcoordsPerPixel)
+	{
+		std::unordered_map<unsigned int, size_t>::iterator itr = byId.find(id);
+		if (itr == byId.end())
+			return;
+		StreamedTexture& texture = textures[itr->second];
+		float texels = texcoordsPerPixel * (float)std::max(texture.width, texture.height);
+		int level = texels > 1.0f ? (int)std::floor(std::log2(texels)) : 0;
+		level = std::min(level, texture.tail);
+		texture.wanted = std::min(texture.wanted, level);
+		for (int l = level; l < texture.tail; l++)
+			texture.levelUsed[l] = frame;
+	}
+
+	//starts loads for the textures missing the most levels, called once the frame's requests are in
+	void Update()
+	{
+		std::vector<size_t> missing;
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].wanted < textures[i].base && !textures[i].loading)
+				missing.push_back(i);
+		}
+		std::sort(missing.begin(), missing.end(), [this](size_t a, size_t b) {
+			return textures[a].base - textures[a].wanted > textures[b].base - textures[b].wanted;
+		});
+		//room is what is free plus every level the latest requests did not need
+		size_t room = Budget > residentBytes ? Budget - residentBytes : 0;
+		for (const StreamedTexture& texture : textures)
+		{
+			for (int level = texture.base; level < texture.tail && texture.levelUsed[level] < frame; level++)
+				room += texture.levelBytes(level);
+		}
+		for (size_t i : missing)
+		{
+			if (inFlight.size() >= MAX_TEXTURE_LOADS)
+				break;
+			StreamedTexture& texture = textures[i];
+			//at least the next level has to fit, the upload trims the rest
+			size_t next = texture.levelBytes(texture.base - 1);
+			if (next > room)
+				continue;
+			room -= next;
+			startLoad(i);
+		}
+		for (StreamedTexture& texture : textures)
+			texture.wanted = texture.levels;
+		frame++;
+	}
+
+	//waits for every started load, including its upload. headless runs call it each frame
+	//so the same frames come out whatever the thread timing
+	void Finish()
+	{
+		JobSystem& jobs = JobSystem::Get();
+		while (!inFlight.empty())
+		{
+			JobHandle job = inFlight.begin()->second;
+			jobs.Wait(job);
+		}
+	}
+
+	//deletes every streamed texture once the loads in flight are done, with the context current
+	void Destroy()
+	{
+		Finish();
+		for (StreamedTexture& texture : textures)
+			glDeleteTextures(1, &texture.id);
+		textures.clear();
+		byId.clear();
+		residentBytes = 0;
+	}
+
+	void PrintStats() const
+	{
+		size_t tails = 0;
+		for (const StreamedTexture& texture : textures)
+			tails += texture.bytesFrom(texture.tail);
+		std::cout << "HEADLESS::TEXTURES " << textures.size() << " streamed, budget " << Budget << " bytes, resident " << residentBytes
+			<< " (tails " << tails << "), peak " << PeakBytes << ", " << LoadedLevels << " levels loaded (" << StreamedBytes << " bytes), "
+			<< EvictedLevels << " evicted" << std::endl;
+	}
+
+private:
+	//base is the finest level on the GPU, levels [base, levels) are resident. levelUsed[l]
+	//is the last frame that needed level l
+	struct StreamedTexture {
+		std::string path;
+		unsigned int id = 0;
+		int width = 0;
+		int height = 0;
+		int components = 0;
+		int levels = 0;
+		int tail = 0;
+		int base = 0;
+		int wanted = 0;
+		std::vector<unsigned long long> levelUsed;
+		unsigned int generation = 0;
+		bool loading = false;
+		MemoryAllocation memory;
+
+		GLenum format() const { return components == 1 ? GL_RED : components == 3 ? GL_RGB : GL_RGBA; }
+		int levelWidth(int level) const { return std::max(1, width >> level); }
+		int levelHeight(int level) const { return std::max(1, height >> level); }
+		size_t levelBytes(int level) const { return (size_t)levelWidth(level) * levelHeight(level) * components; }
+		size_t bytesFrom(int level) const
+		{
+			size_t bytes = 0;
+			for (; level < levels; level++)
+				bytes += levelBytes(level);
+			return bytes;
+		}
+	};
+
+	//pixels of levels [first, first + pixels.size()) of one texture, decoded by a worker
+	struct LevelData {
+		int first;
+		std::vector<std::vector<unsigned char>> pixels;
+	};
+
+	std::vector<StreamedTexture> textures;
+	std::unordered_map<unsigned int, size_t> byId;
+	std::unordered_map<size_t, JobHandle> inFlight;
+	size_t residentBytes = 0;
+	unsigned long long frame = 1;
+
+	//2x2 box filter to the next level, odd edges repeat their last texel
+	static std::vector<unsigned char> halve(const unsigned char* source, int width, int height, int components)
+	{
+		int halfWidth = std::max(1, width / 2), halfHeight = std::max(1, height / 2);
+		std::vector<unsigned char> half((size_t)halfWidth * halfHeight * components);
+		for (int y = 0; y < halfHeight; y++)
+		{
+			int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+			for (int x = 0; x < halfWidth; x++)
+			{
+				int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+				for (int c = 0; c < components; c++)
+				{
+					int sum = source[((size_t)y0 * width + x0) * components + c] + source[((size_t)y0 * width + x1) * components + c] +
+						source[((size_t)y1 * width + x0) * components + c] + source[((size_t)y1 * width + x1) * components + c];
+					half[((size_t)y * halfWidth + x) * components + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		return half;
+	}
+
+	//levels [first, last) of a full-size image
+	static LevelData buildLevels(const unsigned char* pixels, int width, int height, int components, int first, int last)
+	{
+		LevelData data;
+		data.first = first;
+		std::vector<unsigned char> current;
+		const unsigned char* source = pixels;
+		for (int level = 0; level < last; level++)
+		{
+			if (level >= first)
+				data.pixels.push_back(level == 0 ? std::vector<unsigned char>(pixels, pixels + (size_t)width * height * components) : current);
+			if (level + 1 < last)
+			{
+				current = halve(source, std::max(1, width >> level), std::max(1, height >> level), components);
+				source = current.data();
+			}
+		}
+		return data;
+	}
+
+	//specifies the texture from scratch: the tail level from the pixels, the ones below it by glGenerateMipmap
+	void uploadTail(StreamedTexture& texture, const unsigned char* pixels, int width, int height, int components)
+	{
+		texture.width = width;
+		texture.height = height;
+		texture.components = components;
+		texture.levels = 1;
+		while ((std::max(width, height) >> texture.levels) > 0)
+			texture.levels++;
+		texture.tail = 0;
+		while (std::max(texture.levelWidth(texture.tail), texture.levelHeight(texture.tail)) > TEXTURE_TAIL_SIZE)
+			texture.tail++;
+		texture.base = texture.tail;
+		texture.wanted = texture.levels;
+		texture.levelUsed.assign(texture.levels, 0);
+
+		LevelData tail = buildLevels(pixels, width, height, components, texture.tail, texture.tail + 1);
+		glBindTexture(GL_TEXTURE_2D, texture.id);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		{
+			PROFILE_ZONE("glTexImage2D", "gpu");
+			glTexImage2D(GL_TEXTURE_2D, texture.tail, texture.format(), texture.levelWidth(texture.tail), texture.levelHeight(texture.tail), 0,
+				texture.format(), GL_UNSIGNED_BYTE, tail.pixels[0].data());
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.tail);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+		{
+			PROFILE_ZONE("glGenerateMipmap", "gpu");
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		residentBytes += texture.bytesFrom(texture.tail);
+		PeakBytes = std::max(PeakBytes, residentBytes);
+		texture.memory.Resize(texture.bytesFrom(texture.base));
+		PROFILE_COUNTER("texture.bytes", texture.bytesFrom(texture.tail));
+	}
+
+	//decodes on a worker, uploads on the main thread. a reload in between makes the result stale
+	void startLoad(size_t index)
+	{
+		StreamedTexture& texture = textures[index];
+		texture.loading = true;
+		std::string path = texture.path;
+		int first = texture.wanted, last = texture.base;
+		unsigned int generation = texture.generation;
+		std::shared_ptr<LevelData> decoded = std::make_shared<LevelData>();
+		JobSystem& jobs = JobSystem::Get();
+		JobHandle decode = jobs.Schedule([path, first, last, decoded]() {
+			PROFILE_ZONE("texture.stream_decode", "texture");
+			int width, height, components;
+			unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 0);
+			if (!data)
+				return;
+			*decoded = buildLevels(data, width, height, components, first, last);
+			stbi_image_free(data);
+		});
+		inFlight[index] = jobs.ScheduleMain([this, index, generation, decoded]() {
+			StreamedTexture& texture = textures[index];
+			texture.loading = false;
+			if (texture.generation == generation)
+				upload(texture, *decoded);
+			inFlight.erase(index);
+		}, { decode });
+	}
+
+	//adds the decoded levels from the coarsest up, as far as room can be made for them
+	void upload(StreamedTexture& texture, const LevelData& data)
+	{
+		PROFILE_ZONE("texture.stream_upload", "gpu");
+		if (data.pixels.empty())
+			return;
+		glBindTexture(GL_TEXTURE_2D, texture.id);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (int level = data.first + (int)data.pixels.size() - 1; level >= data.first && level == texture.base - 1; level--)
+		{
+			size_t bytes = texture.levelBytes(level);
+			if (!makeRoom(bytes, texture.id))
+				break;
+			glTexImage2D(GL_TEXTURE_2D, level, texture.format(), texture.levelWidth(level), texture.levelHeight(level), 0,
+				texture.format(), GL_UNSIGNED_BYTE, data.pixels[level - data.first].data());
+			texture.base = level;
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+			residentBytes += bytes;
+			StreamedBytes += bytes;
+			LoadedLevels++;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		PeakBytes = std::max(PeakBytes, residentBytes);
+		texture.memory.Resize(texture.bytesFrom(texture.base));
+	}
+
+	//drops the least recently needed finest levels of other textures until bytes fit,
+	//false when only levels the latest frame needed are left
+	bool makeRoom(size_t bytes, unsigned int keep)
+	{
+		while (residentBytes + bytes > Budget)
+		{
+			StreamedTexture* oldest = NULL;
+			for (StreamedTexture& texture : textures)
+			{
+				if (texture.id == keep || texture.base >= texture.tail || texture.levelUsed[texture.base] + 1 >= frame)
+					continue;
+				if (!oldest || texture.levelUsed[texture.base] < oldest->levelUsed[oldest->base])
+					oldest = &texture;
+			}
+			if (!oldest)
+				return false;
+			evict(*oldest);
+		}
+		return true;
+	}
+
+	//zero-sized levels below the base release their storage, the id stays the same
+	void evict(StreamedTexture& texture)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture.id);
+		glTexImage2D(GL_TEXTURE_2D, texture.base, texture.format(), 0, 0, 0, texture.format(), GL_UNSIGNED_BYTE, NULL);
+		residentBytes -= texture.levelBytes(texture.base);
+		texture.base++;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.base);
+		texture.memory.Resize(texture.bytesFrom(texture.base));
+		EvictedLevels++;
+	}
+};
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Simd.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#define TRANSFORM_SIMD_WIDTH SIMD_WIDTH
+
+namespace transform_simd {
+
+//the TRS math below is written once against these, see Simd.h
+#if SIMD_WIDTH > 1
+using simd::Lanes;
+#endif
+using simd::Scalar;
+
+//out = a * b for column-major 4x4 matrices, b affine when affine is set
+inline void MultiplyMatrix(const float* a, const float* b, float* out, bool affine)
+{
+#if TRANSFORM_SIMD_WIDTH > 1
+	__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+	for (int column = 0; column < 4; column++)
+	{
+		const float* c = b + column * 4;
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(c[0])), _mm_mul_ps(a1, _mm_set1_ps(c[1]))), _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+		if (!affine)
+			r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+		else if (column == 3)
+			r = _mm_add_ps(r, a3);
+		_mm_storeu_ps(out + column * 4, r);
+	}
+#else
+	for (int column = 0; column < 4; column++)
+	{
+		const float* c = b + column * 4;
+		for (int row = 0; row < 4; row++)
+		{
+			float r = a[row] * c[0] + a[4 + row] * c[1] + a[8 + row] * c[2];
+			if (!affine)
+				r += a[12 + row] * c[3];
+			else if (column == 3)
+				r += a[12 + row];
+			out[column * 4 + row] = r;
+		}
+	}
+#endif
+}
+
+}
+
+//Translation/rotation/scale of many objects in structure-of-arrays form. Nodes are stored
+//parents first (Add() only accepts a parent that already exists), so one forward pass
+//sees every parent's world matrix before its children. Update() only touches nodes that
+//changed and the subtrees below them: local matrices are built several nodes at a time
+//from the SoA components, then multiplied into their parent's world matrix.
+class TransformSystem
+{
+public:
+	TransformSystem() : viewProjection(1.0f), viewProjectionSet(false), updatedCount(0) {}
+
+	//returns the new node's index, parent is -1 for roots
+	int Add(int parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		int node = (int)parents.size();
+		parents.push_back(parent >= 0 && parent < node ? parent : -1);
+		float values[COMPONENTS] = { translation.x, translation.y, translation.z, rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z };
+		for (int c = 0; c < COMPONENTS; c++)
+			components[c].push_back(values[c]);
+		for (int e = 0; e < LOCAL_ELEMENTS; e++)
+			local[e].push_back(0.0f);
+		world.push_back(glm::mat4(1.0f));
+		mvp.push_back(glm::mat4(1.0f));
+		dirty.push_back(1);
+		updated.push_back(0);
+		return node;
+	}
+
+	void Reserve(size_t count)
+	{
+		parents.reserve(count);
+		for (int c = 0; c < COMPONENTS; c++)
+			components[c].reserve(count);
+		for (int e = 0; e < LOCAL_ELEMENTS; e++)
+			local[e].reserve(count);
+		world.reserve(count);
+		mvp.reserve(count);
+		dirty.reserve(count);
+		updated.reserve(count);
+	}
+
+	void Clear()
+	{
+		parents.clear();
+		for (int c = 0; c < COMPONENTS; c++)
+			components[c].clear();
+		for (int e = 0; e < LOCAL_ELEMENTS; e++)
+			local[e].clear();
+		world.clear();
+		mvp.clear();
+		dirty.clear();
+		updated.clear();
+		viewProjectionSet = false;
+	}
+
+	//setters only mark the node, the matrices are rebuilt by the next Update()
+	void SetTranslation(int node, const glm::vec3& translation)
+	{
+		components[TX][node] = translation.x;
+		components[TY][node] = translation.y;
+		components[TZ][node] = translation.z;
+		dirty[node] = 1;
+	}
+
+	void SetRotation(int node, const glm::quat& rotation)
+	{
+		components[QX][node] = rotation.x;
+		components[QY][node] = rotation.y;
+		components[QZ][node] = rotation.z;
+		components[QW][node] = rotation.w;
+		dirty[node] = 1;
+	}
+
+	void SetScale(int node, const glm::vec3& scale)
+	{
+		components[SX][node] = scale.x;
+		components[SY][node] = scale.y;
+		components[SZ][node] = scale.z;
+		dirty[node] = 1;
+	}
+
+	glm::vec3 Translation(int node) const { return glm::vec3(components[TX][node], components[TY][node], components[TZ][node]); }
+	glm::quat Rotation(int node) const { return glm::quat(components[QW][node], components[QX][node], components[QY][node], components[QZ][node]); }
+	glm::vec3 Scale(int node) const { return glm::vec3(components[SX][node], components[SY][node], components[SZ][node]); }
+
+	int Parent(int node) const { return parents[node]; }
+	size_t Size() const { return parents.size(); }
+	const glm::mat4& World(int node) const { return world[node]; }
+	const glm::mat4& MVP(int node) const { return mvp[node]; }
+	const std::vector<glm::mat4>& Worlds() const { return world; }
+	const std::vector<glm::mat4>& MVPs() const { return mvp; }
+	//nodes whose world matrix the last Update() rebuilt
+	size_t UpdatedCount() const { return updatedCount; }
+	bool Updated(int node) const { return updated[node] != 0; }
+
+	//rebuilds the world matrices of changed nodes and their descendants
+	void Update()
+	{
+		size_t count = parents.size();
+		updatedCount = 0;
+		//a node changes when it was set or its parent changed, parents come first so one pass does it
+		for (size_t i = 0; i < count; i++)
+		{
+			int parent = parents[i];
+			updated[i] = dirty[i] | (parent >= 0 ? updated[parent] : 0);
+			dirty[i] = 0;
+		}
+
+		//local matrices in blocks of SIMD width, a block is skipped when none of its nodes changed
+		size_t i = 0;
+#if TRANSFORM_SIMD_WIDTH > 1
+		const size_t width = transform_simd::Lanes::Width;
+		for (; i + width <= count; i += width)
+		{
+			if (anyUpdated(i, width))
+				buildLocals<transform_simd::Lanes>(i);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			if (updated[i])
+				buildLocals<transform_simd::Scalar>(i);
+		}
+
+		for (size_t node = 0; node < count; node++)
+		{
+			if (!updated[node])
+				continue;
+			float matrix[16];
+			localMatrix(node, matrix);
+			int parent = parents[node];
+			if (parent < 0)
+				memcpy(&world[node][0][0], matrix, sizeof(matrix));
+			else
+				transform_simd::MultiplyMatrix(&world[parent][0][0], matrix, &world[node][0][0], true);
+			updatedCount++;
+		}
+	}
+
+	//projection * view * world for every node. with an unchanged viewProjection only the
+	//nodes rebuilt by the last Update() are redone
+	void UpdateMVP(const glm::mat4& newViewProjection)
+	{
+		bool cameraMoved = !viewProjectionSet || memcmp(&newViewProjection[0][0], &viewProjection[0][0], sizeof(glm::mat4)) != 0;
+		viewProjection = newViewProjection;
+		viewProjectionSet = true;
+		const float* vp = &viewProjection[0][0];
+		for (size_t node = 0; node < parents.size(); node++)
+		{
+			if (cameraMoved || updated[node])
+				transform_simd::MultiplyMatrix(vp, &world[node][0][0], &mvp[node][0][0], false);
+		}
+	}
+
+private:
+	enum Component { TX, TY, TZ, QX, QY, QZ, QW, SX, SY, SZ, COMPONENTS };
+	//the upper 3x4 of the local matrix, column-major: rotation*scale columns, then translation
+	enum { LOCAL_ELEMENTS = 12 };
+
+	std::vector<int> parents;
+	std::vector<float> components[COMPONENTS];
+	std::vector<float> local[LOCAL_ELEMENTS];
+	std::vector<glm::mat4> world;
+	std::vector<glm::mat4> mvp;
+	std::vector<uint8_t> dirty;
+	std::vector<uint8_t> updated;
+	glm::mat4 viewProjection;
+	bool viewProjectionSet;
+	size_t updatedCount;
+
+	bool anyUpdated(size_t first, size_t count) const
+	{
+		for (size_t i = first; i < first + count; i++)
+		{
+			if (updated[i])
+				return true;
+		}
+		return false;
+	}
+
+	//the same expansion as glm::mat4_cast, times the scale, for Lanes::Width nodes from first
+	template<typename L>
+	void buildLocals(size_t first)
+	{
+		L qx = L::Load(&components[QX][first]), qy = L::Load(&components[QY][first]), qz = L::Load(&components[QZ][first]), qw = L::Load(&components[QW][first]);
+		L sx = L::Load(&components[SX][first]), sy = L::Load(&components[SY][first]), sz = L::Load(&components[SZ][first]);
+		L one = L::Set(1.0f), two = L::Set(2.0f);
+		L xx = qx * qx, yy = qy * qy, zz = qz * qz;
+		L xy = qx * qy, xz = qx * qz, yz = qy * qz;
+		L wx = qw * qx, wy = qw * qy, wz = qw * qz;
+		(sx * (one - two * (yy + zz))).Store(&local[0][first]);
+		(sx * (two * (xy + wz))).Store(&local[1][first]);
+		(sx * (two * (xz - wy))).Store(&local[2][first]);
+		(sy * (two * (xy - wz))).Store(&local[3][first]);
+		(sy * (one - two * (xx + zz))).Store(&local[4][first]);
+		(sy * (two * (yz + wx))).Store(&local[5][first]);
+		(sz * (two * (xz + wy))).Store(&local[6][first]);
+		(sz * (two * (yz - wx))).Store(&local[7][first]);
+		(sz * (one - two * (xx + yy))).Store(&local[8][first]);
+		L::Load(&components[TX][first]).Store(&local[9][first]);
+		L::Load(&components[TY][first]).Store(&local[10][first]);
+		L::Load(&components[TZ][first]).Store(&local[11][first]);
+	}
+
+	void localMatrix(size_t node, float* matrix) const
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			for (int row = 0; row < 3; row++)
+				matrix[column * 4 + row] = local[column * 3 + row][node];
+			matrix[column * 4 + 3] = column == 3 ? 1.0f : 0.0f;
+		}
+	}
+};
+
+#endif
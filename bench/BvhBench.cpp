@@ -0,0 +1,417 @@
+//BVH benchmarks: build time, ray casts and overlap queries over one large mesh.
+//
+//Builds a MeshBvh over a UV sphere and over a random triangle soup, then casts coherent
+//rays (a 256x256 camera grid looking at the mesh) and incoherent ones (random origins around
+//the mesh towards random points inside it), and runs small box and sphere queries. The
+//brute-force loop over every triangle is the baseline the BVH replaces. Before any timing,
+//rays and queries on a 20k triangle sphere and soup are checked against that loop, and a
+//mismatch ends the run with exit code 1. Reports rays/s or queries/s.
+//
+//  BvhBench [--triangles N] [google benchmark flags]
+//
+//--triangles sets the mesh size (default 1M).
+
+#include "../Bvh.h"
+#include "../ObjLoader.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct TestMesh {
+	std::vector<ObjVertex> vertices;
+	std::vector<unsigned int> indices;
+	MeshBvh bvh;
+};
+
+ObjVertex vertexAt(const glm::vec3& position)
+{
+	ObjVertex vertex;
+	vertex.Position = position;
+	vertex.Normal = glm::vec3(0.0f);
+	vertex.TexCoords = glm::vec2(0.0f);
+	return vertex;
+}
+
+//unit sphere, a well shaped closed surface like most models
+void makeSphere(size_t triangles, TestMesh& mesh)
+{
+	size_t rows = std::max<size_t>(2, (size_t)std::sqrt(triangles / 4.0));
+	size_t columns = rows * 2;
+	for (size_t r = 0; r <= rows; r++)
+	{
+		float theta = 3.14159265f * r / rows;
+		for (size_t c = 0; c <= columns; c++)
+		{
+			float phi = 2.0f * 3.14159265f * c / columns;
+			mesh.vertices.push_back(vertexAt(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi))));
+		}
+	}
+	for (size_t r = 0; r < rows; r++)
+	{
+		for (size_t c = 0; c < columns; c++)
+		{
+			unsigned int a = (unsigned int)(r * (columns + 1) + c), b = a + 1;
+			unsigned int d = (unsigned int)(a + columns + 1), e = d + 1;
+			unsigned int quad[6] = { a, b, d, b, e, d };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+//small triangles scattered through the unit cube, the worst case for any hierarchy
+void makeSoup(size_t triangles, TestMesh& mesh)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	float size = 2.0f / std::cbrt((float)triangles);
+	for (size_t t = 0; t < triangles; t++)
+	{
+		glm::vec3 center(unit(rng), unit(rng), unit(rng));
+		for (int k = 0; k < 3; k++)
+		{
+			mesh.indices.push_back((unsigned int)mesh.vertices.size());
+			mesh.vertices.push_back(vertexAt(center + glm::vec3(unit(rng), unit(rng), unit(rng)) * size));
+		}
+	}
+}
+
+size_t triangleCount = 1000000;
+
+TestMesh& meshFor(bool soup)
+{
+	static TestMesh meshes[2];
+	TestMesh& mesh = meshes[soup ? 1 : 0];
+	if (mesh.indices.empty())
+	{
+		if (soup)
+			makeSoup(triangleCount, mesh);
+		else
+			makeSphere(triangleCount, mesh);
+		mesh.bvh.Build(mesh.vertices, mesh.indices);
+	}
+	return mesh;
+}
+
+struct Ray {
+	glm::vec3 origin, direction;
+};
+
+//a camera at distance 3 looking at the origin, one ray per pixel of a 256x256 image
+std::vector<Ray> coherentRays()
+{
+	std::vector<Ray> rays;
+	for (int y = 0; y < 256; y++)
+	{
+		for (int x = 0; x < 256; x++)
+		{
+			glm::vec3 target((x + 0.5f) / 128.0f - 1.0f, (y + 0.5f) / 128.0f - 1.0f, 0.0f);
+			Ray ray = { glm::vec3(0.0f, 0.0f, 3.0f), glm::normalize(target - glm::vec3(0.0f, 0.0f, 3.0f)) };
+			rays.push_back(ray);
+		}
+	}
+	return rays;
+}
+
+std::vector<Ray> incoherentRays(size_t count)
+{
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<Ray> rays;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 origin = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng))) * 3.0f;
+		glm::vec3 target(unit(rng) * 0.8f, unit(rng) * 0.8f, unit(rng) * 0.8f);
+		Ray ray = { origin, glm::normalize(target - origin) };
+		rays.push_back(ray);
+	}
+	return rays;
+}
+
+void setRate(benchmark::State& state, size_t perIteration, const char* name)
+{
+	state.counters[name] = benchmark::Counter((double)perIteration * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void runBuild(benchmark::State& state, bool soup)
+{
+	TestMesh& mesh = meshFor(soup);
+	MeshBvh bvh;
+	for (auto _ : state)
+	{
+		bvh.Build(mesh.vertices, mesh.indices);
+		benchmark::DoNotOptimize(bvh.NodeCount());
+	}
+	setRate(state, mesh.indices.size() / 3, "triangles/s");
+	state.counters["nodes"] = (double)bvh.NodeCount();
+}
+
+void runRays(benchmark::State& state, bool soup, const std::vector<Ray>& rays)
+{
+	TestMesh& mesh = meshFor(soup);
+	size_t hits = 0;
+	for (auto _ : state)
+	{
+		hits = 0;
+		for (const Ray& ray : rays)
+		{
+			RayHit hit;
+			hits += mesh.bvh.Raycast(ray.origin, ray.direction, hit) ? 1 : 0;
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	setRate(state, rays.size(), "rays/s");
+	state.counters["hit_ratio"] = (double)hits / rays.size();
+}
+
+//every triangle against the ray, what picking without a BVH costs
+bool bruteForceRaycast(const TestMesh& mesh, const Ray& ray, RayHit& hit)
+{
+	hit.distance = FLT_MAX;
+	bool found = false;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const glm::vec3& v0 = mesh.vertices[mesh.indices[i]].Position;
+		glm::vec3 e1 = mesh.vertices[mesh.indices[i + 1]].Position - v0;
+		glm::vec3 e2 = mesh.vertices[mesh.indices[i + 2]].Position - v0;
+		glm::vec3 p = glm::cross(ray.direction, e2);
+		float determinant = glm::dot(e1, p);
+		if (std::fabs(determinant) < 1e-20f)
+			continue;
+		float inverse = 1.0f / determinant;
+		glm::vec3 s = ray.origin - v0;
+		float u = glm::dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f)
+			continue;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(ray.direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+		float t = glm::dot(e2, q) * inverse;
+		if (t >= 0.0f && t < hit.distance)
+		{
+			hit.distance = t;
+			hit.triangle = (unsigned int)(i / 3);
+			hit.u = u;
+			hit.v = v;
+			found = true;
+		}
+	}
+	return found;
+}
+
+//every triangle tested on its own, with the same corner arithmetic as the BVH's leaves
+std::vector<unsigned int> bruteForceQuery(const TestMesh& mesh, const glm::vec3& center, float radius, bool sphere)
+{
+	std::vector<unsigned int> found;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const glm::vec3& v0 = mesh.vertices[mesh.indices[i]].Position;
+		glm::vec3 v1 = v0 + (mesh.vertices[mesh.indices[i + 1]].Position - v0);
+		glm::vec3 v2 = v0 + (mesh.vertices[mesh.indices[i + 2]].Position - v0);
+		bool matches;
+		if (sphere)
+		{
+			glm::vec3 offset = mesh_bvh::closestPointOnTriangle(center, v0, v1, v2) - center;
+			matches = glm::dot(offset, offset) <= radius * radius;
+		}
+		else
+			matches = mesh_bvh::triangleOverlapsBox(v0, v1, v2, center, glm::vec3(radius));
+		if (matches)
+			found.push_back((unsigned int)(i / 3));
+	}
+	return found;
+}
+
+//the BVH against the brute-force loops on a sphere and a soup small enough to test every
+//triangle: rays have to agree on hit or miss and on the distance within 1e-4 (ties between
+//triangles sharing an edge may pick either), and the hit point given by triangle and
+//barycentrics has to lie on the ray. Box and sphere queries have to return the same set
+bool checkAgainstBruteForce()
+{
+	auto fail = [](const std::string& what) {
+		std::cout << "BVH::CHECK_FAILED " << what << std::endl;
+		return false;
+	};
+	std::vector<Ray> rays = incoherentRays(512);
+	std::vector<Ray> grid = coherentRays();
+	for (size_t i = 0; i < grid.size(); i += 97)
+		rays.push_back(grid[i]);
+	std::mt19937 rng(13);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<glm::vec3> centers;
+	for (int i = 0; i < 256; i++)
+		centers.push_back(glm::vec3(unit(rng), unit(rng), unit(rng)));
+
+	const char* meshNames[2] = { "sphere", "soup" };
+	size_t hitCount = 0, foundCount = 0;
+	for (int soup = 0; soup < 2; soup++)
+	{
+		TestMesh mesh;
+		if (soup == 1)
+			makeSoup(20000, mesh);
+		else
+			makeSphere(20000, mesh);
+		mesh.bvh.Build(mesh.vertices, mesh.indices);
+		std::string name = meshNames[soup];
+		if (mesh.bvh.TriangleCount() != mesh.indices.size() / 3)
+			return fail(name + " triangle count");
+
+		for (size_t r = 0; r < rays.size(); r++)
+		{
+			const Ray& ray = rays[r];
+			RayHit expected, hit;
+			bool expectedFound = bruteForceRaycast(mesh, ray, expected);
+			bool found = mesh.bvh.Raycast(ray.origin, ray.direction, hit);
+			if (found != expectedFound)
+				return fail(name + " ray " + std::to_string(r) + (found ? " hit, expected a miss" : " missed"));
+			if (!found)
+				continue;
+			hitCount++;
+			if (std::fabs(hit.distance - expected.distance) > 1e-4f * std::max(1.0f, expected.distance))
+				return fail(name + " ray " + std::to_string(r) + " distance " + std::to_string(hit.distance) + ", expected " + std::to_string(expected.distance));
+			const glm::vec3* corners[3];
+			for (int k = 0; k < 3; k++)
+				corners[k] = &mesh.vertices[mesh.indices[hit.triangle * 3 + k]].Position;
+			glm::vec3 point = (1.0f - hit.u - hit.v) * *corners[0] + hit.u * *corners[1] + hit.v * *corners[2];
+			if (glm::length(point - (ray.origin + ray.direction * hit.distance)) > 1e-4f)
+				return fail(name + " ray " + std::to_string(r) + " triangle or barycentrics off the ray");
+		}
+
+		std::vector<unsigned int> found;
+		for (int sphere = 0; sphere < 2; sphere++)
+		{
+			for (size_t c = 0; c < centers.size(); c++)
+			{
+				//a few sizes, from a cursor to a tenth of the mesh
+				float radius = 0.01f * (float)(1 + c % 10);
+				found.clear();
+				if (sphere == 1)
+					mesh.bvh.QuerySphere(centers[c], radius, found);
+				else
+					mesh.bvh.QueryBox(centers[c] - glm::vec3(radius), centers[c] + glm::vec3(radius), found);
+				std::sort(found.begin(), found.end());
+				if (found != bruteForceQuery(mesh, centers[c], radius, sphere == 1))
+					return fail(name + (sphere == 1 ? " sphere" : " box") + " query " + std::to_string(c) + " found " + std::to_string(found.size()) + " triangles");
+				foundCount += found.size();
+			}
+		}
+	}
+	std::cout << "BVH::CHECK ok, " << hitCount << " hits and " << foundCount << " query results match" << std::endl;
+	return true;
+}
+
+void runBruteForce(benchmark::State& state, bool soup, const std::vector<Ray>& rays)
+{
+	TestMesh& mesh = meshFor(soup);
+	for (auto _ : state)
+	{
+		size_t hits = 0;
+		for (const Ray& ray : rays)
+		{
+			RayHit hit;
+			hits += bruteForceRaycast(mesh, ray, hit) ? 1 : 0;
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	setRate(state, rays.size(), "rays/s");
+}
+
+void runQueries(benchmark::State& state, bool soup, bool spheres)
+{
+	TestMesh& mesh = meshFor(soup);
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<glm::vec3> centers;
+	for (int i = 0; i < 4096; i++)
+		centers.push_back(glm::vec3(unit(rng), unit(rng), unit(rng)));
+	//about a hundredth of the mesh's extent, the size of a cursor or a character's reach
+	const float radius = 0.02f;
+	std::vector<unsigned int> found;
+	size_t total = 0;
+	for (auto _ : state)
+	{
+		total = 0;
+		for (const glm::vec3& center : centers)
+		{
+			found.clear();
+			if (spheres)
+				mesh.bvh.QuerySphere(center, radius, found);
+			else
+				mesh.bvh.QueryBox(center - glm::vec3(radius), center + glm::vec3(radius), found);
+			total += found.size();
+		}
+		benchmark::DoNotOptimize(total);
+	}
+	setRate(state, centers.size(), "queries/s");
+	state.counters["triangles_per_query"] = (double)total / centers.size();
+}
+
+void registerBenchmarks()
+{
+	std::string size = std::to_string(triangleCount);
+	static const std::vector<Ray> coherent = coherentRays();
+	static const std::vector<Ray> incoherent = incoherentRays(65536);
+	static const std::vector<Ray> fewRays = incoherentRays(16);
+	const char* meshNames[2] = { "sphere", "soup" };
+	for (int soup = 0; soup < 2; soup++)
+	{
+		std::string mesh = std::string(meshNames[soup]) + "/" + size;
+		bool isSoup = soup == 1;
+		benchmark::RegisterBenchmark(("Bvh/build/" + mesh).c_str(), [isSoup](benchmark::State& state) {
+			runBuild(state, isSoup);
+		})->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("Bvh/raycast_coherent/" + mesh).c_str(), [isSoup](benchmark::State& state) {
+			runRays(state, isSoup, coherent);
+		})->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("Bvh/raycast_incoherent/" + mesh).c_str(), [isSoup](benchmark::State& state) {
+			runRays(state, isSoup, incoherent);
+		})->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("Bvh/brute_force/" + mesh).c_str(), [isSoup](benchmark::State& state) {
+			runBruteForce(state, isSoup, fewRays);
+		})->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("Bvh/query_sphere/" + mesh).c_str(), [isSoup](benchmark::State& state) {
+			runQueries(state, isSoup, true);
+		})->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("Bvh/query_box/" + mesh).c_str(), [isSoup](benchmark::State& state) {
+			runQueries(state, isSoup, false);
+		})->Unit(benchmark::kMillisecond);
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	//pull out our own flags before google benchmark sees the command line
+	std::vector<char*> remaining;
+	remaining.push_back(argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--triangles") == 0 && i + 1 < argc)
+			triangleCount = std::stoull(argv[++i]);
+		else
+			remaining.push_back(argv[i]);
+	}
+
+	std::cout << "BVH::THREADS " << JobSystem::Get().ThreadCount() << std::endl;
+	if (!checkAgainstBruteForce())
+		return 1;
+	registerBenchmarks();
+
+	int remainingCount = (int)remaining.size();
+	benchmark::Initialize(&remainingCount, remaining.data());
+	if (benchmark::ReportUnrecognizedArguments(remainingCount, remaining.data()))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,305 @@
+//Mesh container benchmarks: size and decode speed against the OBJ text it replaces.
+//
+//Every mesh is parsed from OBJ text, encoded, decoded and checked first. Indices, ranges
+//and materials must come back exact, positions and texture coordinates within half a
+//quantization step and normals within 0.01 degrees. A failed check ends the run with exit
+//code 1 before any timing. Then it prints a size table (OBJ text, raw vertex and index
+//buffers, container) and times ParseObj on the text against DecodeMeshStreams into
+//preallocated buffers, which stand in for mapped GL buffers. Reports MB/s of OBJ text for
+//parsing and of raw buffers written for decoding.
+//
+//  MeshCodecBench [--triangles N] [--corpus DIR] [google benchmark flags]
+//
+//--triangles sets the generated sphere and terrain size (default 1M), --corpus adds every
+//.obj file found under DIR, e.g. the directory holding Aerospace.obj.
+
+#include "../MeshCodec.h"
+#include "../ObjLoader.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+size_t triangleCount = 1000000;
+std::string corpusDirectory;
+
+struct Corpus {
+	std::string name;
+	std::string text;
+	std::string directory;
+	ObjMesh mesh;
+	std::vector<unsigned char> container;
+};
+
+std::vector<Corpus> corpora;
+
+void vertexLine(std::string& text, float x, float y, float z, float u, float v, float nx, float ny, float nz)
+{
+	char line[192];
+	int n = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n", x, y, z, u, v, nx, ny, nz);
+	text.append(line, n);
+}
+
+void quadLines(std::string& text, unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+{
+	char line[192];
+	int n = snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\nf %u/%u/%u %u/%u/%u %u/%u/%u\n",
+		a + 1, a + 1, a + 1, b + 1, b + 1, b + 1, c + 1, c + 1, c + 1, a + 1, a + 1, a + 1, c + 1, c + 1, c + 1, d + 1, d + 1, d + 1);
+	text.append(line, n);
+}
+
+//a UV sphere, smooth and regular
+std::string generateSphere(size_t triangles)
+{
+	unsigned int stacks = (unsigned int)std::max(2.0, std::sqrt(triangles / 4.0));
+	unsigned int slices = stacks * 2;
+	std::string text;
+	text.reserve((size_t)stacks * slices * 160);
+	const float pi = 3.14159265358979f;
+	for (unsigned int i = 0; i <= stacks; i++)
+	{
+		float theta = pi * i / stacks;
+		for (unsigned int j = 0; j <= slices; j++)
+		{
+			float phi = 2.0f * pi * j / slices;
+			float x = std::sin(theta) * std::cos(phi), y = std::cos(theta), z = std::sin(theta) * std::sin(phi);
+			vertexLine(text, x, y, z, (float)j / slices, (float)i / stacks, x, y, z);
+		}
+	}
+	for (unsigned int i = 0; i < stacks; i++)
+	{
+		for (unsigned int j = 0; j < slices; j++)
+		{
+			unsigned int a = i * (slices + 1) + j, b = a + slices + 1;
+			quadLines(text, a, b, b + 1, a + 1);
+		}
+	}
+	return text;
+}
+
+//a height field with noisy heights and normals, closer to scanned or sculpted data
+std::string generateTerrain(size_t triangles)
+{
+	unsigned int side = (unsigned int)std::max(1.0, std::sqrt(triangles / 2.0));
+	std::string text;
+	text.reserve((size_t)side * side * 160);
+	unsigned int seed = 12345;
+	auto noise = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (float)(seed >> 8) / 16777216.0f - 0.5f;
+	};
+	for (unsigned int y = 0; y <= side; y++)
+	{
+		for (unsigned int x = 0; x <= side; x++)
+		{
+			float height = std::sin(x * 0.05f) * std::cos(y * 0.07f) * 10.0f + noise() * 0.3f;
+			glm::vec3 normal = glm::normalize(glm::vec3(noise() * 0.4f, 1.0f, noise() * 0.4f));
+			vertexLine(text, (float)x, height, (float)y, x / 16.0f, y / 16.0f, normal.x, normal.y, normal.z);
+		}
+	}
+	for (unsigned int y = 0; y < side; y++)
+	{
+		for (unsigned int x = 0; x < side; x++)
+		{
+			unsigned int i = y * (side + 1) + x;
+			quadLines(text, i, i + side + 1, i + side + 2, i + 1);
+		}
+	}
+	return text;
+}
+
+void addCorpus(const std::string& name, std::string text, const std::string& directory)
+{
+	Corpus corpus;
+	corpus.name = name;
+	corpus.text = std::move(text);
+	corpus.directory = directory;
+	if (!ParseObj(corpus.text, corpus.mesh, directory))
+	{
+		std::cout << "CODEC::SKIP " << name << ": unable to parse" << std::endl;
+		return;
+	}
+	EncodeMesh(corpus.mesh, std::vector<MeshSource>(), corpus.container);
+	corpora.push_back(std::move(corpus));
+}
+
+//decodes the container again and compares it with the parsed mesh
+bool roundTrip(const Corpus& corpus)
+{
+	ObjMesh decoded;
+	MeshContainerInfo info;
+	if (!DecodeMesh(corpus.container.data(), corpus.container.size(), decoded, &info))
+		return false;
+	const ObjMesh& mesh = corpus.mesh;
+	auto fail = [&corpus](const std::string& what) {
+		std::cout << "CODEC::ROUND_TRIP_FAILED " << corpus.name << ": " << what << std::endl;
+		return false;
+	};
+	if (decoded.vertices.size() != mesh.vertices.size() || decoded.indices != mesh.indices || decoded.tangents.size() != mesh.tangents.size())
+		return fail("counts or indices");
+	if (decoded.ranges.size() != mesh.ranges.size() || decoded.materials.size() != mesh.materials.size())
+		return fail("ranges or materials");
+	for (size_t i = 0; i < mesh.ranges.size(); i++)
+	{
+		if (decoded.ranges[i].material != mesh.ranges[i].material || decoded.ranges[i].indexOffset != mesh.ranges[i].indexOffset ||
+			decoded.ranges[i].indexCount != mesh.ranges[i].indexCount)
+			return fail("range " + std::to_string(i));
+	}
+	for (size_t i = 0; i < mesh.materials.size(); i++)
+	{
+		if (decoded.materials[i].Name != mesh.materials[i].Name || !decoded.materials[i].SameAs(mesh.materials[i]))
+			return fail("material " + std::to_string(i));
+	}
+	//half a step plus float rounding of the multiply-add
+	glm::vec3 positionError = (info.boundsMax - info.boundsMin) / 65535.0f * 0.5f + (glm::abs(info.boundsMin) + glm::abs(info.boundsMax)) * 1e-6f;
+	glm::vec2 texcoordError = (info.texcoordMax - info.texcoordMin) / 65535.0f * 0.5f + (glm::abs(info.texcoordMin) + glm::abs(info.texcoordMax)) * 1e-6f;
+	//chord length for 0.01 degrees, a dot product that close to 1 is below float precision
+	const float normalError = 0.01f * 3.14159265f / 180.0f;
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		const ObjVertex& a = mesh.vertices[i];
+		const ObjVertex& b = decoded.vertices[i];
+		glm::vec3 positionDelta = glm::abs(a.Position - b.Position);
+		glm::vec2 texcoordDelta = glm::abs(a.TexCoords - b.TexCoords);
+		if (positionDelta.x > positionError.x || positionDelta.y > positionError.y || positionDelta.z > positionError.z)
+			return fail("position of vertex " + std::to_string(i));
+		if (texcoordDelta.x > texcoordError.x || texcoordDelta.y > texcoordError.y)
+			return fail("texture coordinates of vertex " + std::to_string(i));
+		float length = glm::length(a.Normal);
+		if (length > 0.0f && glm::length(a.Normal / length - b.Normal) > normalError)
+			return fail("normal of vertex " + std::to_string(i));
+	}
+	for (size_t i = 0; i < mesh.tangents.size(); i++)
+	{
+		glm::vec3 a = glm::vec3(mesh.tangents[i]);
+		float length = glm::length(a);
+		if ((mesh.tangents[i].w < 0.0f) != (decoded.tangents[i].w < 0.0f) || (length > 0.0f && glm::length(a / length - glm::vec3(decoded.tangents[i])) > normalError))
+			return fail("tangent " + std::to_string(i));
+	}
+	return true;
+}
+
+size_t rawBytes(const ObjMesh& mesh)
+{
+	return mesh.vertices.size() * sizeof(ObjVertex) + mesh.indices.size() * sizeof(unsigned int) + mesh.tangents.size() * sizeof(glm::vec4);
+}
+
+void printSizes()
+{
+	std::cout << std::left << std::setw(28) << "mesh" << std::right << std::setw(14) << "obj bytes" << std::setw(14) << "raw bytes"
+		<< std::setw(14) << "container" << std::setw(10) << "vs obj" << std::setw(10) << "vs raw" << std::endl;
+	for (const Corpus& corpus : corpora)
+	{
+		size_t raw = rawBytes(corpus.mesh);
+		std::cout << std::left << std::setw(28) << corpus.name << std::right << std::setw(14) << corpus.text.size() << std::setw(14) << raw
+			<< std::setw(14) << corpus.container.size() << std::setw(9) << std::fixed << std::setprecision(1)
+			<< (double)corpus.text.size() / corpus.container.size() << "x" << std::setw(9) << (double)raw / corpus.container.size() << "x" << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+}
+
+void registerBenchmarks()
+{
+	for (size_t c = 0; c < corpora.size(); c++)
+	{
+		benchmark::RegisterBenchmark(("ParseObj/" + corpora[c].name).c_str(), [c](benchmark::State& state) {
+			const Corpus& corpus = corpora[c];
+			for (auto _ : state)
+			{
+				ObjMesh mesh;
+				ParseObj(corpus.text, mesh, corpus.directory);
+				benchmark::DoNotOptimize(mesh.vertices.data());
+			}
+			state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)corpus.text.size());
+		})->Unit(benchmark::kMillisecond);
+
+		benchmark::RegisterBenchmark(("Decode/" + corpora[c].name).c_str(), [c](benchmark::State& state) {
+			const Corpus& corpus = corpora[c];
+			const ObjMesh& mesh = corpus.mesh;
+			std::vector<ObjVertex> vertices(mesh.vertices.size());
+			std::vector<unsigned int> indices(mesh.indices.size());
+			std::vector<glm::vec4> tangents(mesh.tangents.size());
+			for (auto _ : state)
+			{
+				DecodeMeshStreams(corpus.container.data(), corpus.container.size(), vertices.data(), indices.data(), tangents.empty() ? NULL : tangents.data());
+				benchmark::DoNotOptimize(vertices.data());
+			}
+			state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)rawBytes(mesh));
+		})->Unit(benchmark::kMillisecond);
+
+		benchmark::RegisterBenchmark(("Encode/" + corpora[c].name).c_str(), [c](benchmark::State& state) {
+			const Corpus& corpus = corpora[c];
+			std::vector<unsigned char> container;
+			for (auto _ : state)
+			{
+				container.clear();
+				EncodeMesh(corpus.mesh, std::vector<MeshSource>(), container);
+				benchmark::DoNotOptimize(container.data());
+			}
+			state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)rawBytes(corpus.mesh));
+		})->Unit(benchmark::kMillisecond);
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	//pull out our own flags before google benchmark sees the command line
+	std::vector<char*> remaining;
+	remaining.push_back(argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--triangles") == 0 && i + 1 < argc)
+			triangleCount = std::stoull(argv[++i]);
+		else if (std::strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+			corpusDirectory = argv[++i];
+		else
+			remaining.push_back(argv[i]);
+	}
+
+	addCorpus("sphere", generateSphere(triangleCount), "");
+	addCorpus("terrain", generateTerrain(triangleCount), "");
+	if (!corpusDirectory.empty())
+	{
+		std::error_code error;
+		for (std::filesystem::recursive_directory_iterator itr(corpusDirectory, error), end; !error && itr != end; itr.increment(error))
+		{
+			if (!itr->is_regular_file() || itr->path().extension() != ".obj")
+				continue;
+			std::ifstream file(itr->path(), std::ios::binary);
+			std::stringstream buffer;
+			buffer << file.rdbuf();
+			addCorpus(itr->path().filename().string(), buffer.str(), itr->path().parent_path().string());
+		}
+	}
+
+	for (const Corpus& corpus : corpora)
+	{
+		if (!roundTrip(corpus))
+			return 1;
+	}
+	std::cout << "CODEC::ROUND_TRIP " << corpora.size() << " meshes ok" << std::endl;
+	printSizes();
+
+	registerBenchmarks();
+	int remainingCount = (int)remaining.size();
+	benchmark::Initialize(&remainingCount, remaining.data());
+	if (benchmark::ReportUnrecognizedArguments(remainingCount, remaining.data()))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,428 @@
+//Normal and tangent generation benchmarks on a large indexed sphere without normals.
+//
+//Runs GenerateNormals with the default crease angle and fully smooth (180 degrees),
+//GenerateTangents, and the plain scalar loop most loaders use (area weighted face normals
+//added per vertex, no crease handling) as a reference. Reports triangles/s.
+//
+//Before any timing, both generators are checked against a plain one-corner-at-a-time
+//version of what they document, on a fine and a coarse sphere and a cube with shared
+//corners, for crease angles of 30, 60 and 180 degrees. Every corner has to keep its
+//position and get a normal within 0.0002 (cosine) of the reference, which is the slack the
+//vertex split allows. Every well-defined tangent has to match within 0.0001 with the same
+//handedness, also with the texture mirrored. A failed check ends the run with exit code 1.
+//
+//  NormalsBench [--triangles N] [google benchmark flags]
+//
+//--triangles sets the mesh size (default 10M). Build with -mavx for the 8-wide kernels.
+//With -DWITH_ASSIMP and -lassimp it also times Assimp reading the same mesh from memory
+//with and without aiProcess_GenSmoothNormals; the difference is Assimp's normal cost.
+
+#include "../MeshNormals.h"
+#include "../ObjLoader.h"
+
+#include <benchmark/benchmark.h>
+
+#ifdef WITH_ASSIMP
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+struct TestMesh {
+	std::vector<ObjVertex> vertices;
+	std::vector<unsigned int> indices;
+};
+
+//uv sphere with twice as many columns as rows, the seam column is duplicated like an
+//exporter writes it, so welding by position matters
+TestMesh makeSphere(size_t triangles)
+{
+	size_t rows = std::max<size_t>(2, (size_t)std::sqrt(triangles / 4.0));
+	size_t columns = rows * 2;
+	TestMesh mesh;
+	mesh.vertices.reserve((rows + 1) * (columns + 1));
+	for (size_t r = 0; r <= rows; r++)
+	{
+		float theta = 3.14159265f * r / rows;
+		for (size_t c = 0; c <= columns; c++)
+		{
+			float phi = 2.0f * 3.14159265f * (c % columns) / columns;
+			ObjVertex vertex;
+			vertex.Position = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			vertex.Normal = glm::vec3(0.0f);
+			vertex.TexCoords = glm::vec2((float)c / columns, (float)r / rows);
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	mesh.indices.reserve(rows * columns * 6);
+	for (size_t r = 0; r < rows; r++)
+	{
+		for (size_t c = 0; c < columns; c++)
+		{
+			unsigned int a = (unsigned int)(r * (columns + 1) + c), b = a + 1;
+			unsigned int d = (unsigned int)(a + columns + 1), e = d + 1;
+			unsigned int quad[6] = { a, b, d, b, e, d };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+//unit cube, 8 vertices shared by all faces, so every corner sits on a 90 degree edge
+TestMesh makeCube()
+{
+	TestMesh mesh;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		ObjVertex vertex;
+		vertex.Position = glm::vec3(corner & 1 ? 0.5f : -0.5f, corner & 2 ? 0.5f : -0.5f, corner & 4 ? 0.5f : -0.5f);
+		vertex.Normal = glm::vec3(0.0f);
+		vertex.TexCoords = glm::vec2(vertex.Position.x + vertex.Position.z, vertex.Position.y);
+		mesh.vertices.push_back(vertex);
+	}
+	unsigned int faces[36] = { 0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 1, 5, 0, 5, 4, 2, 6, 7, 2, 7, 3, 0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5 };
+	mesh.indices.assign(faces, faces + 36);
+	return mesh;
+}
+
+size_t triangleCount = 10000000;
+
+//unit normal of a triangle, zero when degenerate
+glm::vec3 referenceFaceNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 normal = glm::cross(b - a, c - a);
+	float length = glm::length(normal);
+	return length > 0.0f ? normal / length : glm::vec3(0.0f);
+}
+
+//angle at a between the edges to b and c
+float referenceCornerAngle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 e1 = b - a, e2 = c - a;
+	float l1 = glm::length(e1), l2 = glm::length(e2);
+	if (l1 <= 0.0f || l2 <= 0.0f)
+		return 0.0f;
+	return std::acos(glm::clamp(glm::dot(e1, e2) / (l1 * l2), -1.0f, 1.0f));
+}
+
+//GenerateNormals as documented, one corner at a time, with no welding table, SIMD, jobs or
+//half-angle shortcut: every corner sums the angle weighted normals of the faces at its
+//position within the crease angle of its own face. the normal each corner should end up with
+std::vector<glm::vec3> referenceNormals(const TestMesh& mesh, float creaseAngle)
+{
+	size_t corners = mesh.indices.size() / 3 * 3;
+	std::vector<glm::vec3> faceNormals(corners / 3);
+	std::vector<float> angles(corners);
+	std::map<std::tuple<float, float, float>, std::vector<size_t>> atPosition;
+	for (size_t t = 0; t < corners / 3; t++)
+	{
+		glm::vec3 p[3];
+		for (int k = 0; k < 3; k++)
+			p[k] = mesh.vertices[mesh.indices[t * 3 + k]].Position;
+		faceNormals[t] = referenceFaceNormal(p[0], p[1], p[2]);
+		for (int k = 0; k < 3; k++)
+		{
+			angles[t * 3 + k] = referenceCornerAngle(p[k], p[(k + 1) % 3], p[(k + 2) % 3]);
+			atPosition[std::make_tuple(p[k].x + 0.0f, p[k].y + 0.0f, p[k].z + 0.0f)].push_back(t * 3 + k);
+		}
+	}
+	float cosCrease = std::cos(glm::radians(std::min(creaseAngle, 180.0f)));
+	std::vector<glm::vec3> normals(corners);
+	for (const std::pair<const std::tuple<float, float, float>, std::vector<size_t>>& group : atPosition)
+	{
+		for (size_t corner : group.second)
+		{
+			glm::vec3 own = faceNormals[corner / 3];
+			glm::vec3 sum(0.0f);
+			for (size_t other : group.second)
+			{
+				if (creaseAngle >= 180.0f || own == glm::vec3(0.0f) || glm::dot(own, faceNormals[other / 3]) >= cosCrease)
+					sum += faceNormals[other / 3] * angles[other];
+			}
+			float length = glm::length(sum);
+			normals[corner] = length > 1e-20f ? sum / length : (own == glm::vec3(0.0f) ? glm::vec3(0.0f, 1.0f, 0.0f) : own);
+		}
+	}
+	return normals;
+}
+
+//GenerateTangents as documented: per corner the uv tangent of its face projected onto the
+//vertex normal, angle weighted. w is 0 where the handedness is too close to call, and the
+//tangent is zero where the faces around the vertex do not define one
+std::vector<glm::vec4> referenceTangents(const TestMesh& mesh)
+{
+	std::vector<glm::vec3> tangents(mesh.vertices.size(), glm::vec3(0.0f)), bitangents(mesh.vertices.size(), glm::vec3(0.0f));
+	for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+	{
+		const ObjVertex* v[3];
+		for (int k = 0; k < 3; k++)
+			v[k] = &mesh.vertices[mesh.indices[t + k]];
+		glm::vec3 e1 = v[1]->Position - v[0]->Position, e2 = v[2]->Position - v[0]->Position;
+		glm::vec2 d1 = v[1]->TexCoords - v[0]->TexCoords, d2 = v[2]->TexCoords - v[0]->TexCoords;
+		float determinant = d1.x * d2.y - d2.x * d1.y;
+		if (std::fabs(determinant) <= 1e-20f)
+			continue;
+		glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) / determinant;
+		glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) / determinant;
+		float tangentLength = glm::length(tangent), bitangentLength = glm::length(bitangent);
+		tangent = tangentLength > 0.0f ? tangent / tangentLength : glm::vec3(0.0f);
+		bitangent = bitangentLength > 0.0f ? bitangent / bitangentLength : glm::vec3(0.0f);
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int index = mesh.indices[t + k];
+			float weight = referenceCornerAngle(v[k]->Position, v[(k + 1) % 3]->Position, v[(k + 2) % 3]->Position);
+			glm::vec3 normal = glm::normalize(v[k]->Normal);
+			glm::vec3 projected = tangent - normal * glm::dot(normal, tangent);
+			float length = glm::length(projected);
+			if (length > 1e-20f)
+				tangents[index] += projected * (weight / length);
+			bitangents[index] += bitangent * weight;
+		}
+	}
+	std::vector<glm::vec4> result(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		float length = glm::length(tangents[i]);
+		glm::vec3 tangent = length > 1e-3f ? tangents[i] / length : glm::vec3(0.0f);
+		float handedness = glm::dot(glm::cross(glm::normalize(mesh.vertices[i].Normal), tangent), bitangents[i]);
+		result[i] = glm::vec4(tangent, std::fabs(handedness) > 1e-3f ? (handedness < 0.0f ? -1.0f : 1.0f) : 0.0f);
+	}
+	return result;
+}
+
+bool checkNormals(const std::string& name, const TestMesh& source, float creaseAngle)
+{
+	std::vector<glm::vec3> expected = referenceNormals(source, creaseAngle);
+	TestMesh mesh = source;
+	GenerateNormals(mesh.vertices, mesh.indices, creaseAngle);
+	for (size_t corner = 0; corner < expected.size(); corner++)
+	{
+		const ObjVertex& vertex = mesh.vertices[mesh.indices[corner]];
+		const ObjVertex& original = source.vertices[source.indices[corner]];
+		if (vertex.Position != original.Position || vertex.TexCoords != original.TexCoords
+			|| std::fabs(glm::length(vertex.Normal) - 1.0f) > 1e-4f || glm::dot(vertex.Normal, expected[corner]) < 0.9998f)
+		{
+			std::cout << "NORMALS::CHECK_FAILED " << name << " crease " << creaseAngle << ": corner " << corner << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool checkTangents(const std::string& name, const TestMesh& source)
+{
+	TestMesh mesh = source;
+	GenerateNormals(mesh.vertices, mesh.indices);
+	std::vector<glm::vec4> expected = referenceTangents(mesh);
+	std::vector<glm::vec4> tangents;
+	GenerateTangents(mesh.vertices, mesh.indices, tangents);
+	for (size_t v = 0; v < expected.size(); v++)
+	{
+		if (expected[v].x == 0.0f && expected[v].y == 0.0f && expected[v].z == 0.0f)
+			continue;
+		if (glm::dot(glm::vec3(expected[v]), glm::vec3(tangents[v])) < 0.9999f || (expected[v].w != 0.0f && expected[v].w != tangents[v].w))
+		{
+			std::cout << "NORMALS::CHECK_FAILED " << name << " tangents: vertex " << v << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool checkAgainstReference()
+{
+	const float creases[3] = { 30.0f, 60.0f, 180.0f };
+	struct Case {
+		std::string name;
+		TestMesh mesh;
+	};
+	std::vector<Case> cases;
+	cases.push_back({ "sphere_20k", makeSphere(20000) });
+	cases.push_back({ "sphere_64", makeSphere(64) });
+	cases.push_back({ "cube", makeCube() });
+	for (const Case& c : cases)
+	{
+		for (float crease : creases)
+		{
+			if (!checkNormals(c.name, c.mesh, crease))
+				return false;
+		}
+	}
+	//u running the other way flips the handedness
+	TestMesh mirrored = cases[1].mesh;
+	for (ObjVertex& vertex : mirrored.vertices)
+		vertex.TexCoords.x = 1.0f - vertex.TexCoords.x;
+	if (!checkTangents("sphere_20k", cases[0].mesh) || !checkTangents("sphere_64", cases[1].mesh) || !checkTangents("sphere_64_mirrored_uv", mirrored))
+		return false;
+	std::cout << "NORMALS::CHECK " << cases.size() << " meshes ok" << std::endl;
+	return true;
+}
+
+const TestMesh& sphere()
+{
+	static TestMesh mesh = makeSphere(triangleCount);
+	return mesh;
+}
+
+void setRate(benchmark::State& state, const TestMesh& mesh)
+{
+	state.counters["triangles/s"] = benchmark::Counter((double)(mesh.indices.size() / 3) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void runGenerateNormals(benchmark::State& state, float creaseAngle)
+{
+	const TestMesh& source = sphere();
+	TestMesh mesh;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		mesh = source;
+		state.ResumeTiming();
+		size_t added = GenerateNormals(mesh.vertices, mesh.indices, creaseAngle);
+		benchmark::DoNotOptimize(added);
+	}
+	setRate(state, source);
+}
+
+//the loop Model::processMesh would need without generated normals: unnormalized face
+//normals (so area weighted) summed into every corner, then normalized
+void runScalarReference(benchmark::State& state)
+{
+	const TestMesh& source = sphere();
+	TestMesh mesh;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		mesh = source;
+		state.ResumeTiming();
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			ObjVertex& a = mesh.vertices[mesh.indices[i]];
+			ObjVertex& b = mesh.vertices[mesh.indices[i + 1]];
+			ObjVertex& c = mesh.vertices[mesh.indices[i + 2]];
+			glm::vec3 normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+			a.Normal += normal;
+			b.Normal += normal;
+			c.Normal += normal;
+		}
+		for (ObjVertex& vertex : mesh.vertices)
+		{
+			float length = glm::length(vertex.Normal);
+			if (length > 0.0f)
+				vertex.Normal /= length;
+		}
+		benchmark::DoNotOptimize(mesh.vertices.data());
+	}
+	setRate(state, source);
+}
+
+void runGenerateTangents(benchmark::State& state)
+{
+	TestMesh mesh = sphere();
+	GenerateNormals(mesh.vertices, mesh.indices);
+	std::vector<glm::vec4> tangents;
+	for (auto _ : state)
+	{
+		GenerateTangents(mesh.vertices, mesh.indices, tangents);
+		benchmark::DoNotOptimize(tangents.data());
+	}
+	setRate(state, mesh);
+}
+
+#ifdef WITH_ASSIMP
+//the sphere as OBJ text without vn, so Assimp has to make the normals itself
+const std::string& sphereObj()
+{
+	static std::string text;
+	if (text.empty())
+	{
+		const TestMesh& mesh = sphere();
+		std::ostringstream out;
+		for (const ObjVertex& vertex : mesh.vertices)
+			out << "v " << vertex.Position.x << " " << vertex.Position.y << " " << vertex.Position.z << "\n";
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			out << "f " << mesh.indices[i] + 1 << " " << mesh.indices[i + 1] + 1 << " " << mesh.indices[i + 2] + 1 << "\n";
+		text = out.str();
+	}
+	return text;
+}
+
+void runAssimp(benchmark::State& state, unsigned int flags)
+{
+	const std::string& text = sphereObj();
+	for (auto _ : state)
+	{
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFileFromMemory(text.data(), text.size(), flags, "obj");
+		if (!scene)
+		{
+			state.SkipWithError(importer.GetErrorString());
+			break;
+		}
+		benchmark::DoNotOptimize(scene->mMeshes[0]->mNormals);
+	}
+	setRate(state, sphere());
+}
+#endif
+
+void registerBenchmarks()
+{
+	std::string size = std::to_string(triangleCount);
+	benchmark::RegisterBenchmark(("Normals/scalar_reference/" + size).c_str(), runScalarReference)->Unit(benchmark::kMillisecond);
+	benchmark::RegisterBenchmark(("Normals/generate/crease60/" + size).c_str(), [](benchmark::State& state) {
+		runGenerateNormals(state, DEFAULT_CREASE_ANGLE);
+	})->Unit(benchmark::kMillisecond);
+	benchmark::RegisterBenchmark(("Normals/generate/smooth/" + size).c_str(), [](benchmark::State& state) {
+		runGenerateNormals(state, 180.0f);
+	})->Unit(benchmark::kMillisecond);
+	benchmark::RegisterBenchmark(("Tangents/generate/" + size).c_str(), runGenerateTangents)->Unit(benchmark::kMillisecond);
+#ifdef WITH_ASSIMP
+	benchmark::RegisterBenchmark(("Assimp/read/" + size).c_str(), [](benchmark::State& state) {
+		runAssimp(state, aiProcess_JoinIdenticalVertices);
+	})->Unit(benchmark::kMillisecond);
+	benchmark::RegisterBenchmark(("Assimp/read_gen_smooth_normals/" + size).c_str(), [](benchmark::State& state) {
+		runAssimp(state, aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals);
+	})->Unit(benchmark::kMillisecond);
+#endif
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	//pull out our own flags before google benchmark sees the command line
+	std::vector<char*> remaining;
+	remaining.push_back(argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--triangles") == 0 && i + 1 < argc)
+			triangleCount = std::stoull(argv[++i]);
+		else
+			remaining.push_back(argv[i]);
+	}
+
+	std::cout << "NORMALS::SIMD_WIDTH " << SIMD_WIDTH << " THREADS " << JobSystem::Get().ThreadCount() << std::endl;
+	if (!checkAgainstReference())
+		return 1;
+	registerBenchmarks();
+
+	int remainingCount = (int)remaining.size();
+	benchmark::Initialize(&remainingCount, remaining.data());
+	if (benchmark::ReportUnrecognizedArguments(remainingCount, remaining.data()))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,390 @@
+//OBJ import benchmarks over generated meshes and optional real-world files.
+//
+//Reports bytes/s (MB/s), faces/s and the process peak RSS. Every generated corpus
+//is built once and reused by all iterations of its benchmark. Before any timing, a few
+//malformed files (indices and exponents too long for an int, indices out of range) have to
+//be rejected or parsed without overflowing and their well-formed neighbours accepted, or the
+//run ends with exit code 1.
+//
+//  ObjImportBench [--max-faces N] [--corpus DIR] [google benchmark flags]
+//
+//--max-faces caps the generated sizes (default 50M faces), --corpus adds every
+//.obj file found under DIR, e.g. the directory holding Aerospace.obj.
+
+#include "../ObjLoader.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+enum class Shape { Grid, Sphere, Soup };
+
+enum class FaceFormat {
+	PosTexNormal,	//f v/vt/vn
+	PosNormal,		//f v//vn
+	PosOnly,		//f v
+	Negative,		//f -v/-vt/-vn
+	Polygon			//f v/vt/vn with quads instead of triangles
+};
+
+const char* shapeName(Shape shape)
+{
+	switch (shape)
+	{
+	case Shape::Grid: return "grid";
+	case Shape::Sphere: return "sphere";
+	default: return "soup";
+	}
+}
+
+const char* formatName(FaceFormat format)
+{
+	switch (format)
+	{
+	case FaceFormat::PosTexNormal: return "v_vt_vn";
+	case FaceFormat::PosNormal: return "v__vn";
+	case FaceFormat::PosOnly: return "v";
+	case FaceFormat::Negative: return "negative";
+	default: return "polygon";
+	}
+}
+
+double peakRssMegabytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+//Writes OBJ text for one shape/format combination with roughly the requested
+//number of triangles (polygon meshes write the same surface as quads).
+class ObjWriter
+{
+public:
+	ObjWriter(FaceFormat format) : format(format), vertexCount(0) {}
+
+	void Vertex(float x, float y, float z, float u, float v, float nx, float ny, float nz)
+	{
+		char line[160];
+		int n = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x, y, z);
+		text.append(line, n);
+		if (format != FaceFormat::PosOnly && format != FaceFormat::PosNormal)
+		{
+			n = snprintf(line, sizeof(line), "vt %.6f %.6f\n", u, v);
+			text.append(line, n);
+		}
+		if (format != FaceFormat::PosOnly)
+		{
+			n = snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", nx, ny, nz);
+			text.append(line, n);
+		}
+		vertexCount++;
+	}
+
+	//zero-based vertex indices, every attribute shares the same index
+	void Face(const unsigned int* corners, int count)
+	{
+		text += "f";
+		char corner[64];
+		for (int i = 0; i < count; i++)
+		{
+			long long index = (long long)corners[i] + 1;
+			if (format == FaceFormat::Negative)
+				index = (long long)corners[i] - (long long)vertexCount;
+			int n;
+			if (format == FaceFormat::PosOnly)
+				n = snprintf(corner, sizeof(corner), " %lld", index);
+			else if (format == FaceFormat::PosNormal)
+				n = snprintf(corner, sizeof(corner), " %lld//%lld", index, index);
+			else
+				n = snprintf(corner, sizeof(corner), " %lld/%lld/%lld", index, index, index);
+			text.append(corner, n);
+		}
+		text += "\n";
+	}
+
+	//emits a quad as one polygon or as two triangles depending on the format
+	void Quad(unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+	{
+		if (format == FaceFormat::Polygon)
+		{
+			unsigned int quad[4] = { a, b, c, d };
+			Face(quad, 4);
+			return;
+		}
+		unsigned int first[3] = { a, b, c };
+		unsigned int second[3] = { a, c, d };
+		Face(first, 3);
+		Face(second, 3);
+	}
+
+	std::string text;
+
+private:
+	FaceFormat format;
+	size_t vertexCount;
+};
+
+std::string generateGrid(FaceFormat format, size_t triangles)
+{
+	unsigned int side = (unsigned int)std::max(1.0, std::sqrt(triangles / 2.0));
+	ObjWriter writer(format);
+	writer.text.reserve((size_t)side * side * 96);
+	for (unsigned int y = 0; y <= side; y++)
+		for (unsigned int x = 0; x <= side; x++)
+			writer.Vertex((float)x, 0.0f, (float)y, (float)x / side, (float)y / side, 0.0f, 1.0f, 0.0f);
+	for (unsigned int y = 0; y < side; y++)
+	{
+		for (unsigned int x = 0; x < side; x++)
+		{
+			unsigned int i = y * (side + 1) + x;
+			writer.Quad(i, i + side + 1, i + side + 2, i + 1);
+		}
+	}
+	return writer.text;
+}
+
+std::string generateSphere(FaceFormat format, size_t triangles)
+{
+	//slices = 2 * stacks keeps the quads roughly square
+	unsigned int stacks = (unsigned int)std::max(2.0, std::sqrt(triangles / 4.0));
+	unsigned int slices = stacks * 2;
+	ObjWriter writer(format);
+	writer.text.reserve((size_t)stacks * slices * 96);
+	const float pi = 3.14159265358979f;
+	for (unsigned int i = 0; i <= stacks; i++)
+	{
+		float theta = pi * i / stacks;
+		for (unsigned int j = 0; j <= slices; j++)
+		{
+			float phi = 2.0f * pi * j / slices;
+			float x = std::sin(theta) * std::cos(phi);
+			float y = std::cos(theta);
+			float z = std::sin(theta) * std::sin(phi);
+			writer.Vertex(x, y, z, (float)j / slices, (float)i / stacks, x, y, z);
+		}
+	}
+	for (unsigned int i = 0; i < stacks; i++)
+	{
+		for (unsigned int j = 0; j < slices; j++)
+		{
+			unsigned int a = i * (slices + 1) + j;
+			unsigned int b = a + slices + 1;
+			writer.Quad(a, b, b + 1, a + 1);
+		}
+	}
+	return writer.text;
+}
+
+//random positions and random connectivity, the worst case for vertex dedup locality
+std::string generateSoup(FaceFormat format, size_t triangles)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	size_t vertices = std::max<size_t>(4, triangles / 2);
+	ObjWriter writer(format);
+	writer.text.reserve(triangles * 96);
+	for (size_t i = 0; i < vertices; i++)
+	{
+		float x = coordinate(rng), y = coordinate(rng), z = coordinate(rng);
+		writer.Vertex(x, y, z, (x + 1.0f) * 0.5f, (y + 1.0f) * 0.5f, 0.0f, 0.0f, 1.0f);
+	}
+	std::uniform_int_distribution<unsigned int> pick(0, (unsigned int)vertices - 1);
+	size_t faces = format == FaceFormat::Polygon ? triangles / 2 : triangles;
+	for (size_t i = 0; i < faces; i++)
+	{
+		unsigned int corners[4] = { pick(rng), pick(rng), pick(rng), pick(rng) };
+		writer.Face(corners, format == FaceFormat::Polygon ? 4 : 3);
+	}
+	return writer.text;
+}
+
+//the corpus for the running benchmark, regenerated only when the benchmark changes
+struct CorpusCache {
+	std::string key;
+	std::string text;
+};
+
+CorpusCache cache;
+
+const std::string& corpusFor(Shape shape, FaceFormat format, size_t triangles)
+{
+	std::string key = std::string(shapeName(shape)) + "/" + formatName(format) + "/" + std::to_string(triangles);
+	if (cache.key != key)
+	{
+		cache.text.clear();
+		cache.text.shrink_to_fit();
+		if (shape == Shape::Grid)
+			cache.text = generateGrid(format, triangles);
+		else if (shape == Shape::Sphere)
+			cache.text = generateSphere(format, triangles);
+		else
+			cache.text = generateSoup(format, triangles);
+		cache.key = key;
+	}
+	return cache.text;
+}
+
+void reportCounters(benchmark::State& state, size_t bytes, size_t faces)
+{
+	state.SetBytesProcessed((int64_t)(bytes * state.iterations()));
+	state.counters["faces/s"] = benchmark::Counter((double)faces * state.iterations(), benchmark::Counter::kIsRate);
+	state.counters["faces"] = (double)faces;
+	state.counters["peak_rss_MB"] = peakRssMegabytes();
+}
+
+void runParse(benchmark::State& state, const std::string& text)
+{
+	ObjMesh mesh;
+	for (auto _ : state)
+	{
+		if (!ParseObj(text, mesh))
+		{
+			state.SkipWithError("ParseObj rejected the input");
+			return;
+		}
+		benchmark::DoNotOptimize(mesh.indices.data());
+		benchmark::ClobberMemory();
+	}
+	reportCounters(state, text.size(), mesh.faceCount);
+}
+
+void registerGenerated(size_t maxFaces)
+{
+	const size_t sizes[] = { 1000, 10000, 100000, 1000000, 10000000, 50000000 };
+	const Shape shapes[] = { Shape::Grid, Shape::Sphere, Shape::Soup };
+	const FaceFormat formats[] = { FaceFormat::PosTexNormal, FaceFormat::PosNormal, FaceFormat::PosOnly, FaceFormat::Negative, FaceFormat::Polygon };
+
+	for (Shape shape : shapes)
+	{
+		for (FaceFormat format : formats)
+		{
+			for (size_t size : sizes)
+			{
+				if (size > maxFaces)
+					continue;
+				std::string name = std::string("ParseObj/") + shapeName(shape) + "/" + formatName(format) + "/" + std::to_string(size);
+				auto* bench = benchmark::RegisterBenchmark(name.c_str(), [shape, format, size](benchmark::State& state) {
+					runParse(state, corpusFor(shape, format, size));
+				});
+				bench->Unit(benchmark::kMillisecond);
+				//multi-million face runs take seconds each, one pass is representative
+				if (size >= 10000000)
+					bench->Iterations(1);
+			}
+		}
+	}
+}
+
+void registerCorpus(const std::string& directory)
+{
+	std::error_code error;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(directory, error))
+	{
+		if (!entry.is_regular_file() || entry.path().extension() != ".obj")
+			continue;
+		std::string path = entry.path().string();
+		std::string name = "ParseObj/file/" + entry.path().filename().string();
+		benchmark::RegisterBenchmark(name.c_str(), [path](benchmark::State& state) {
+			std::ifstream file(path, std::ios::binary);
+			std::stringstream buffer;
+			buffer << file.rdbuf();
+			runParse(state, buffer.str());
+		})->Unit(benchmark::kMillisecond);
+	}
+	if (error)
+		std::cout << "ERROR::BENCH::UNABLE_TO_READ_CORPUS: " << directory << " (" << error.message() << ")" << std::endl;
+}
+
+//input the parser has to reject, or accept, without undefined behaviour
+bool checkParser()
+{
+	struct Case {
+		const char* name;
+		const char* text;
+		bool accepted;
+		size_t faces;
+	};
+	static const Case cases[] = {
+		{ "positive indices", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n", true, 1 },
+		{ "negative indices", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf -3 -2 -1\n", true, 1 },
+		{ "index past INT_MAX", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 99999999999999999999\n", false, 0 },
+		{ "index just past INT_MAX", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 2147483648\n", false, 0 },
+		{ "negative index past INT_MAX", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 -99999999999999999999\n", false, 0 },
+		{ "INT_MAX index out of range", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 2147483647\n", false, 0 },
+		{ "long texture index", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nf 1/1 2/1 3/44444444444444444444\n", false, 0 },
+		{ "long exponent", "v 1e99999999999999999999 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n", true, 1 },
+	};
+	std::cout << "OBJ::CHECK malformed lines below are expected" << std::endl;
+	for (const Case& check : cases)
+	{
+		ObjMesh mesh;
+		bool accepted = ParseObj(check.text, mesh);
+		if (accepted != check.accepted || (accepted && mesh.faceCount != check.faces))
+		{
+			std::cout << "OBJ::CHECK_FAILED " << check.name << ": " << (accepted ? "accepted" : "rejected") << " with " << mesh.faceCount << " faces" << std::endl;
+			return false;
+		}
+	}
+	std::cout << "OBJ::CHECK " << sizeof(cases) / sizeof(cases[0]) << " cases ok" << std::endl;
+	return true;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	//pull out our own flags before google benchmark sees the command line
+	size_t maxFaces = 50000000;
+	std::vector<std::string> corpora;
+	std::vector<char*> remaining;
+	remaining.push_back(argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--max-faces") == 0 && i + 1 < argc)
+			maxFaces = std::stoull(argv[++i]);
+		else if (std::strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+			corpora.push_back(argv[++i]);
+		else
+			remaining.push_back(argv[i]);
+	}
+
+	if (!checkParser())
+		return 1;
+
+	registerGenerated(maxFaces);
+	for (const std::string& directory : corpora)
+		registerCorpus(directory);
+
+	int remainingCount = (int)remaining.size();
+	benchmark::Initialize(&remainingCount, remaining.data());
+	if (benchmark::ReportUnrecognizedArguments(remainingCount, remaining.data()))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,325 @@
+//Static batching benchmarks: merge time for a scene of many small meshes.
+//
+//Builds the kind of scene CAD exports produce: cubes of 24 vertices hanging off a forest of
+//64-node trees, with rotations, non-uniform scales and every fifth node mirrored. Three
+//materials, two of them sharing a texture, and the first tree animated, so its meshes stay
+//movable. Compares BatchStaticMeshes with moving every static vertex into model space on
+//its own, the part of the merge any batching has to do. Reports meshes/s and the draw
+//calls left.
+//Before any timing, the batches are checked against the unbatched meshes: the draw count
+//has to match the vertex budget, movable meshes have to come back untouched, the batches
+//have to hold every static triangle moved into model space (within 1e-4), in its own
+//texture set, and every merged triangle has to wind counter-clockwise around its normals,
+//mirrored ones included. A failed check ends the run with exit code 1.
+//
+//  StaticBatchBench [--meshes N] [google benchmark flags]
+//
+//--meshes sets the scene size (default 12,000).
+
+#include "../StaticBatching.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+//the fields of Mesh.h's Vertex batching touches, without pulling in GL
+struct BatchVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+};
+
+typedef StaticMeshData<BatchVertex> SceneMesh;
+
+struct Scene {
+	TransformSystem transforms;
+	std::vector<SceneMesh> meshes;
+	std::vector<int> nodes;
+	std::vector<bool> movable;
+	std::vector<std::string> textureSets;
+};
+
+const size_t TREE_SIZE = 64;
+const size_t CUBE_VERTICES = 24;
+
+//unit cube with one normal per face, counter-clockwise seen from outside
+SceneMesh makeCube(unsigned int material)
+{
+	SceneMesh cube;
+	cube.material = material;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int side = -1; side <= 1; side += 2)
+		{
+			glm::vec3 normal(0.0f);
+			normal[axis] = (float)side;
+			glm::vec3 u(0.0f), v(0.0f);
+			u[(axis + 1) % 3] = 0.5f;
+			v[(axis + 2) % 3] = 0.5f;
+			if (side < 0)
+				std::swap(u, v);
+			unsigned int base = (unsigned int)cube.vertices.size();
+			glm::vec3 center = normal * 0.5f;
+			glm::vec3 corners[4] = { center - u - v, center + u - v, center + u + v, center - u + v };
+			for (int c = 0; c < 4; c++)
+			{
+				BatchVertex vertex = { corners[c], normal, glm::vec2(c == 1 || c == 2, c >= 2) };
+				cube.vertices.push_back(vertex);
+			}
+			unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+			for (unsigned int index : quad)
+				cube.indices.push_back(base + index);
+		}
+	}
+	return cube;
+}
+
+Scene makeScene(size_t count)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	Scene scene;
+	scene.textureSets = { "brick", "brick", "metal" };
+	size_t side = (size_t)std::ceil(std::sqrt((double)(count + TREE_SIZE - 1) / TREE_SIZE));
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t tree = i / TREE_SIZE, inTree = i % TREE_SIZE;
+		int parent = inTree == 0 ? -1 : (int)(i - inTree + (inTree - 1) / 8);
+		glm::vec3 translation = inTree == 0 ? glm::vec3((float)(tree % side) * 40.0f, 0.0f, (float)(tree / side) * 40.0f)
+			: glm::vec3(unit(rng), unit(rng), unit(rng)) * 4.0f;
+		glm::quat rotation = glm::angleAxis(unit(rng) * 3.14159265f, glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 2.0f, 0.0f)));
+		glm::vec3 scale = glm::vec3(1.0f + 0.3f * unit(rng), 1.0f + 0.3f * unit(rng), 1.0f + 0.3f * unit(rng));
+		if (i % 5 == 3)
+			scale.x = -scale.x;
+		scene.nodes.push_back(scene.transforms.Add(parent, translation, rotation, scale));
+		scene.meshes.push_back(makeCube((unsigned int)(i % 3)));
+		scene.movable.push_back(tree == 0);
+	}
+	scene.transforms.Update();
+	return scene;
+}
+
+size_t meshCount = 12000;
+
+const Scene& sceneFor(size_t count)
+{
+	static Scene scene;
+	if (scene.meshes.size() != count)
+		scene = makeScene(count);
+	return scene;
+}
+
+//one triangle as its texture set and corners, corners sorted so the order does not matter
+typedef std::pair<std::string, std::array<float, 9>> Triangle;
+
+Triangle triangleOf(const std::string& textureSet, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	std::array<glm::vec3, 3> corners = { a, b, c };
+	std::sort(corners.begin(), corners.end(), [](const glm::vec3& x, const glm::vec3& y) {
+		return x.x != y.x ? x.x < y.x : x.y != y.y ? x.y < y.y : x.z < y.z;
+	});
+	Triangle triangle;
+	triangle.first = textureSet;
+	for (int k = 0; k < 3; k++)
+	{
+		for (int d = 0; d < 3; d++)
+			triangle.second[k * 3 + d] = corners[k][d];
+	}
+	return triangle;
+}
+
+//the batches against the meshes they were made from, see the top of the file
+bool checkAgainstUnbatched()
+{
+	const Scene& scene = sceneFor(meshCount);
+	auto fail = [](const std::string& what) {
+		std::cout << "BATCHING::CHECK_FAILED " << what << std::endl;
+		return false;
+	};
+
+	//what the unbatched draw loop would put on screen: every static cube in model space
+	size_t movableCount = 0;
+	size_t setVertices[2] = { 0, 0 };
+	std::vector<Triangle> expected;
+	for (size_t i = 0; i < scene.meshes.size(); i++)
+	{
+		if (scene.movable[i])
+		{
+			movableCount++;
+			continue;
+		}
+		const SceneMesh& mesh = scene.meshes[i];
+		const glm::mat4& world = scene.transforms.World(scene.nodes[i]);
+		const std::string& textureSet = scene.textureSets[mesh.material];
+		setVertices[textureSet == "brick" ? 0 : 1] += mesh.vertices.size();
+		for (size_t t = 0; t < mesh.indices.size(); t += 3)
+		{
+			glm::vec3 corners[3];
+			for (int k = 0; k < 3; k++)
+				corners[k] = glm::vec3(world * glm::vec4(mesh.vertices[mesh.indices[t + k]].Position, 1.0f));
+			expected.push_back(triangleOf(textureSet, corners[0], corners[1], corners[2]));
+		}
+	}
+
+	std::vector<SceneMesh> built = scene.meshes;
+	std::vector<int> nodes = scene.nodes;
+	size_t kept = BatchStaticMeshes(built, nodes, scene.movable, scene.textureSets, scene.transforms);
+
+	//all meshes are the same size, so every texture set fills whole batches but its last
+	size_t perBatch = (STATIC_BATCH_MAX_VERTICES / CUBE_VERTICES) * CUBE_VERTICES;
+	size_t expectedDraws = movableCount + (setVertices[0] + perBatch - 1) / perBatch + (setVertices[1] + perBatch - 1) / perBatch;
+	if (kept != movableCount || built.size() != expectedDraws || nodes.size() != built.size())
+		return fail("draw count " + std::to_string(built.size()) + ", expected " + std::to_string(expectedDraws));
+
+	size_t movableSeen = 0;
+	for (size_t i = 0; i < scene.meshes.size() && movableSeen < kept; i++)
+	{
+		if (!scene.movable[i])
+			continue;
+		const SceneMesh& source = scene.meshes[i];
+		const SceneMesh& mesh = built[movableSeen];
+		if (nodes[movableSeen] != scene.nodes[i] || mesh.indices != source.indices || mesh.vertices.size() != source.vertices.size()
+			|| std::memcmp(mesh.vertices.data(), source.vertices.data(), source.vertices.size() * sizeof(BatchVertex)) != 0)
+			return fail("movable mesh " + std::to_string(i) + " changed");
+		movableSeen++;
+	}
+
+	std::vector<Triangle> merged;
+	for (size_t b = kept; b < built.size(); b++)
+	{
+		const SceneMesh& batch = built[b];
+		if (nodes[b] != -1 || batch.vertices.size() > STATIC_BATCH_MAX_VERTICES)
+			return fail("batch " + std::to_string(b) + " node or size");
+		for (const BatchVertex& vertex : batch.vertices)
+		{
+			if (std::fabs(glm::length(vertex.Normal) - 1.0f) > 1e-4f)
+				return fail("batch " + std::to_string(b) + " normal length");
+		}
+		for (size_t t = 0; t < batch.indices.size(); t += 3)
+		{
+			const BatchVertex& a = batch.vertices[batch.indices[t]];
+			const BatchVertex& c1 = batch.vertices[batch.indices[t + 1]];
+			const BatchVertex& c2 = batch.vertices[batch.indices[t + 2]];
+			glm::vec3 face = glm::cross(c1.Position - a.Position, c2.Position - a.Position);
+			if (glm::dot(face, a.Normal + c1.Normal + c2.Normal) <= 0.0f)
+				return fail("batch " + std::to_string(b) + " triangle " + std::to_string(t / 3) + " winds clockwise");
+			merged.push_back(triangleOf(scene.textureSets[batch.material], a.Position, c1.Position, c2.Position));
+		}
+	}
+
+	if (merged.size() != expected.size())
+		return fail(std::to_string(merged.size()) + " merged triangles, expected " + std::to_string(expected.size()));
+	std::sort(expected.begin(), expected.end());
+	std::sort(merged.begin(), merged.end());
+	for (size_t t = 0; t < expected.size(); t++)
+	{
+		if (expected[t].first != merged[t].first)
+			return fail("triangle " + std::to_string(t) + " in the wrong texture set");
+		for (int k = 0; k < 9; k++)
+		{
+			if (std::fabs(expected[t].second[k] - merged[t].second[k]) > 1e-4f)
+				return fail("triangle " + std::to_string(t) + " moved");
+		}
+	}
+	std::cout << "BATCHING::CHECK ok, " << scene.meshes.size() << " meshes in " << built.size() << " draws, " << kept << " kept as they were" << std::endl;
+	return true;
+}
+
+void reportCounters(benchmark::State& state, const Scene& scene, size_t draws)
+{
+	state.counters["meshes/s"] = benchmark::Counter((double)scene.meshes.size() * state.iterations(), benchmark::Counter::kIsRate);
+	state.counters["draws"] = (double)draws;
+}
+
+//every static vertex moved into model space in place, no sorting or merging, the baseline
+void runTransformOnly(benchmark::State& state)
+{
+	const Scene& scene = sceneFor(meshCount);
+	size_t draws = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		std::vector<SceneMesh> built = scene.meshes;
+		state.ResumeTiming();
+		for (size_t i = 0; i < built.size(); i++)
+		{
+			if (scene.movable[i])
+				continue;
+			const glm::mat4& world = scene.transforms.World(scene.nodes[i]);
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+			for (BatchVertex& vertex : built[i].vertices)
+			{
+				vertex.Position = glm::vec3(world * glm::vec4(vertex.Position, 1.0f));
+				vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+			}
+		}
+		draws = built.size();
+		benchmark::DoNotOptimize(built.data());
+		benchmark::ClobberMemory();
+	}
+	reportCounters(state, scene, draws);
+}
+
+void runBatch(benchmark::State& state)
+{
+	const Scene& scene = sceneFor(meshCount);
+	size_t draws = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		std::vector<SceneMesh> built = scene.meshes;
+		std::vector<int> nodes = scene.nodes;
+		state.ResumeTiming();
+		BatchStaticMeshes(built, nodes, scene.movable, scene.textureSets, scene.transforms);
+		draws = built.size();
+		benchmark::DoNotOptimize(built.data());
+		benchmark::ClobberMemory();
+	}
+	reportCounters(state, scene, draws);
+}
+
+void registerBenchmarks()
+{
+	std::string size = std::to_string(meshCount);
+	benchmark::RegisterBenchmark(("Batching/transform_only/" + size).c_str(), runTransformOnly)->Unit(benchmark::kMillisecond);
+	benchmark::RegisterBenchmark(("Batching/merge/" + size).c_str(), runBatch)->Unit(benchmark::kMillisecond);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	//pull out our own flags before google benchmark sees the command line
+	std::vector<char*> remaining;
+	remaining.push_back(argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--meshes") == 0 && i + 1 < argc)
+			meshCount = std::stoull(argv[++i]);
+		else
+			remaining.push_back(argv[i]);
+	}
+
+	if (!checkAgainstUnbatched())
+		return 1;
+	registerBenchmarks();
+
+	int remainingCount = (int)remaining.size();
+	benchmark::Initialize(&remainingCount, remaining.data());
+	if (benchmark::ReportUnrecognizedArguments(remainingCount, remaining.data()))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
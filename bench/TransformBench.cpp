@@ -0,0 +1,251 @@
+//Transform batch benchmarks: world and MVP matrices for a large node hierarchy.
+//
+//Compares the per-object glm::translate/rotate/scale chain the viewer used to build its
+//model matrix with TransformSystem's SoA batch, for different shares of moving nodes.
+//Reports objects/s (nodes per second whose matrices are up to date after the frame).
+//Before any timing, the batch's world and MVP matrices are checked against the glm chain
+//over a few frames of partial motion, with and without camera moves. An entry further
+//than 1e-4 of the largest one in its reference matrix ends the run with exit code 1.
+//
+//  TransformBench [--objects N] [google benchmark flags]
+//
+//--objects sets the hierarchy size (default 100k). Build with -mavx to get the 8-wide path.
+
+#include "../TransformSystem.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+//a forest of 8-ary trees, 64 nodes per tree, the shape of a scene of rigged or grouped props
+struct Scene {
+	std::vector<int> parents;
+	std::vector<glm::vec3> translations;
+	std::vector<glm::vec3> axes;
+	std::vector<float> angles;
+	std::vector<glm::vec3> scales;
+};
+
+Scene makeScene(size_t count)
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	Scene scene;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t inTree = i % 64;
+		scene.parents.push_back(inTree == 0 ? -1 : (int)(i - inTree + (inTree - 1) / 8));
+		scene.translations.push_back(glm::vec3(unit(rng), unit(rng), unit(rng)) * 10.0f);
+		scene.axes.push_back(glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 2.0f, 0.0f)));
+		scene.angles.push_back(unit(rng) * 3.14159265f);
+		scene.scales.push_back(glm::vec3(1.0f + 0.5f * unit(rng)));
+	}
+	return scene;
+}
+
+size_t objectCount = 100000;
+
+const Scene& sceneFor(size_t count)
+{
+	static Scene scene;
+	if (scene.parents.size() != count)
+		scene = makeScene(count);
+	return scene;
+}
+
+glm::mat4 viewProjectionAt(int frame)
+{
+	float angle = frame * 0.01f;
+	glm::mat4 view = glm::lookAt(glm::vec3(std::cos(angle) * 50.0f, 10.0f, std::sin(angle) * 50.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	return glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 200.0f) * view;
+}
+
+//largest difference between two matrices, relative to the largest entry of reference
+float matrixError(const glm::mat4& value, const glm::mat4& reference)
+{
+	float error = 0.0f, largest = 1e-30f;
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			error = std::max(error, std::fabs(value[c][r] - reference[c][r]));
+			largest = std::max(largest, std::fabs(reference[c][r]));
+		}
+	}
+	return error / largest;
+}
+
+//the batch against the glm chain, frame by frame: all nodes new, every tenth node rotating
+//with and without a camera move, then nothing changing
+bool checkAgainstGlm()
+{
+	const Scene& scene = sceneFor(objectCount);
+	size_t count = scene.parents.size();
+	TransformSystem transforms;
+	transforms.Reserve(count);
+	for (size_t i = 0; i < count; i++)
+		transforms.Add(scene.parents[i], scene.translations[i], glm::angleAxis(scene.angles[i], scene.axes[i]), scene.scales[i]);
+
+	std::vector<float> angles = scene.angles;
+	std::vector<glm::mat4> world(count);
+	const int frames = 4;
+	const int cameraFrames[frames] = { 0, 1, 1, 1 };
+	const size_t moveEvery[frames] = { 0, 10, 10, 0 };
+	float worstWorld = 0.0f, worstMvp = 0.0f;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		if (moveEvery[frame] > 0)
+		{
+			for (size_t i = frame % moveEvery[frame]; i < count; i += moveEvery[frame])
+			{
+				angles[i] = scene.angles[i] + frame * 0.25f;
+				transforms.SetRotation((int)i, glm::angleAxis(angles[i], scene.axes[i]));
+			}
+		}
+		glm::mat4 viewProjection = viewProjectionAt(cameraFrames[frame] * 100);
+		transforms.Update();
+		transforms.UpdateMVP(viewProjection);
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::mat4 local = glm::translate(glm::mat4(1.0f), scene.translations[i]);
+			local = glm::rotate(local, angles[i], scene.axes[i]);
+			local = glm::scale(local, scene.scales[i]);
+			world[i] = scene.parents[i] < 0 ? local : world[scene.parents[i]] * local;
+			worstWorld = std::max(worstWorld, matrixError(transforms.World((int)i), world[i]));
+			worstMvp = std::max(worstMvp, matrixError(transforms.MVP((int)i), viewProjection * world[i]));
+		}
+	}
+	std::cout << "TRANSFORMS::CHECK largest relative error world " << worstWorld << ", mvp " << worstMvp << std::endl;
+	if (worstWorld > 1e-4f || worstMvp > 1e-4f)
+	{
+		std::cout << "TRANSFORMS::CHECK_FAILED batch matrices differ from the glm chain" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void reportCounters(benchmark::State& state, size_t objects)
+{
+	state.counters["objects/s"] = benchmark::Counter((double)objects * state.iterations(), benchmark::Counter::kIsRate);
+	state.counters["objects"] = (double)objects;
+}
+
+//every node rebuilt every frame with glm, the baseline
+void runGlmChained(benchmark::State& state)
+{
+	const Scene& scene = sceneFor(objectCount);
+	size_t count = scene.parents.size();
+	std::vector<glm::mat4> world(count), mvp(count);
+	int frame = 0;
+	for (auto _ : state)
+	{
+		glm::mat4 viewProjection = viewProjectionAt(frame++);
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::mat4 local = glm::translate(glm::mat4(1.0f), scene.translations[i]);
+			local = glm::rotate(local, scene.angles[i] + frame * 0.001f, scene.axes[i]);
+			local = glm::scale(local, scene.scales[i]);
+			world[i] = scene.parents[i] < 0 ? local : world[scene.parents[i]] * local;
+			mvp[i] = viewProjection * world[i];
+		}
+		benchmark::DoNotOptimize(mvp.data());
+		benchmark::ClobberMemory();
+	}
+	reportCounters(state, count);
+}
+
+//moveEvery: every n-th node gets a new rotation each frame (0 = none). cameraMoves: new viewProjection each frame
+void runBatch(benchmark::State& state, size_t moveEvery, bool cameraMoves)
+{
+	const Scene& scene = sceneFor(objectCount);
+	size_t count = scene.parents.size();
+	TransformSystem transforms;
+	transforms.Reserve(count);
+	for (size_t i = 0; i < count; i++)
+		transforms.Add(scene.parents[i], scene.translations[i], glm::angleAxis(scene.angles[i], scene.axes[i]), scene.scales[i]);
+	transforms.Update();
+	transforms.UpdateMVP(viewProjectionAt(0));
+
+	int frame = 1;
+	size_t updated = 0;
+	for (auto _ : state)
+	{
+		if (moveEvery > 0)
+		{
+			for (size_t i = frame % moveEvery; i < count; i += moveEvery)
+				transforms.SetRotation((int)i, glm::angleAxis(scene.angles[i] + frame * 0.001f, scene.axes[i]));
+		}
+		transforms.Update();
+		transforms.UpdateMVP(cameraMoves ? viewProjectionAt(frame) : viewProjectionAt(0));
+		updated += transforms.UpdatedCount();
+		frame++;
+		benchmark::DoNotOptimize(transforms.MVPs().data());
+		benchmark::ClobberMemory();
+	}
+	reportCounters(state, count);
+	state.counters["world_updates/frame"] = (double)updated / std::max<double>((double)state.iterations(), 1.0);
+}
+
+void registerBenchmarks()
+{
+	std::string size = std::to_string(objectCount);
+	benchmark::RegisterBenchmark(("Transforms/glm_chained/" + size).c_str(), runGlmChained)->Unit(benchmark::kMicrosecond);
+	struct Case {
+		const char* name;
+		size_t moveEvery;
+		bool cameraMoves;
+	};
+	const Case cases[] = {
+		{ "all_moving", 1, true },
+		{ "10pct_moving", 10, true },
+		{ "1pct_moving", 100, true },
+		{ "camera_only", 0, true },
+		{ "idle", 0, false },
+	};
+	for (const Case& c : cases)
+	{
+		Case copy = c;
+		benchmark::RegisterBenchmark(("Transforms/batch/" + std::string(c.name) + "/" + size).c_str(), [copy](benchmark::State& state) {
+			runBatch(state, copy.moveEvery, copy.cameraMoves);
+		})->Unit(benchmark::kMicrosecond);
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	//pull out our own flags before google benchmark sees the command line
+	std::vector<char*> remaining;
+	remaining.push_back(argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+			objectCount = std::stoull(argv[++i]);
+		else
+			remaining.push_back(argv[i]);
+	}
+
+	std::cout << "TRANSFORMS::SIMD_WIDTH " << TRANSFORM_SIMD_WIDTH << std::endl;
+	if (!checkAgainstGlm())
+		return 1;
+	registerBenchmarks();
+
+	int remainingCount = (int)remaining.size();
+	benchmark::Initialize(&remainingCount, remaining.data());
+	if (benchmark::ReportUnrecognizedArguments(remainingCount, remaining.data()))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,77 @@
+#version 330 core
+//deferred lighting for the lights that touch every pixel: the directional light and the
+//camera spot light. point lights are added afterwards by deferred_point
+out vec4 FragColor;
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    float quadratic;
+    float linear;
+    float constant;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+uniform DirLight dirLight;
+uniform SpotLight spotLight;
+uniform bool spotEnabled;
+uniform vec3 viewPos;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    float depth = texture(gDepth, uv).r;
+    if (depth == 1.0)
+        discard;
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = world.xyz / world.w;
+
+    vec3 albedo = texture(gAlbedo, uv).rgb;
+    vec4 specularShininess = texture(gSpecular, uv);
+    vec3 specColor = specularShininess.rgb;
+    float shininess = specularShininess.a;
+    vec3 normal = texture(gNormal, uv).xyz;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 lightDir = normalize(-dirLight.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 result = dirLight.ambient * albedo + dirLight.diffuse * diff * albedo + dirLight.specular * spec * specColor;
+
+    if (spotEnabled)
+    {
+        lightDir = normalize(spotLight.position - fragPos);
+        diff = max(dot(normal, lightDir), 0.0);
+        reflectDir = reflect(-lightDir, normal);
+        spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+        float theta = dot(lightDir, normalize(-spotLight.direction));
+        float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+        float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+        float distance = length(spotLight.position - fragPos);
+        float attenuation = 1.0 / (spotLight.constant + spotLight.linear * distance + spotLight.quadratic * distance * distance);
+        result += (spotLight.ambient * albedo + spotLight.diffuse * diff * albedo + spotLight.specular * spec * specColor) * intensity * attenuation;
+    }
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,42 @@
+#version 330 core
+//adds one point light to the pixels its volume covers, same terms as CalcPointLight in shader.fs
+out vec4 FragColor;
+
+flat in vec4 LightPositionRadius;
+flat in vec3 LightAmbient;
+flat in vec3 LightDiffuse;
+flat in vec3 LightSpecular;
+flat in vec3 LightAttenuation;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+uniform vec3 viewPos;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    float depth = texture(gDepth, uv).r;
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = world.xyz / world.w;
+    float distance = length(LightPositionRadius.xyz - fragPos);
+    if (depth == 1.0 || distance > LightPositionRadius.w)
+        discard;
+
+    vec3 albedo = texture(gAlbedo, uv).rgb;
+    vec4 specularShininess = texture(gSpecular, uv);
+    vec3 normal = texture(gNormal, uv).xyz;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 lightDir = normalize(LightPositionRadius.xyz - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), specularShininess.a);
+    float attenuation = 1.0 / (LightAttenuation.x + LightAttenuation.y * distance + LightAttenuation.z * distance * distance);
+
+    FragColor = vec4(attenuation * (LightAmbient * albedo + LightDiffuse * diff * albedo + LightSpecular * spec * specularShininess.rgb), 1.0);
+}
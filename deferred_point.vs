@@ -0,0 +1,27 @@
+#version 330 core
+//one instance per point light: a unit sphere scaled to the light's radius
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aPositionRadius;
+layout (location = 2) in vec3 aAmbient;
+layout (location = 3) in vec3 aDiffuse;
+layout (location = 4) in vec3 aSpecular;
+layout (location = 5) in vec3 aAttenuation;
+
+flat out vec4 LightPositionRadius;
+flat out vec3 LightAmbient;
+flat out vec3 LightDiffuse;
+flat out vec3 LightSpecular;
+flat out vec3 LightAttenuation;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    LightPositionRadius = aPositionRadius;
+    LightAmbient = aAmbient;
+    LightDiffuse = aDiffuse;
+    LightSpecular = aSpecular;
+    LightAttenuation = aAttenuation;
+    gl_Position = projection * view * vec4(aPositionRadius.xyz + aPos * aPositionRadius.w, 1.0);
+}
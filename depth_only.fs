@@ -0,0 +1,6 @@
+#version 330 core
+//depth pre-pass: shader.vs positions, no color. the shading pass that follows runs with
+//GL_LEQUAL and depth writes off, so every pixel is shaded once
+void main()
+{
+}
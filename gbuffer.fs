@@ -0,0 +1,69 @@
+#version 330 core
+//geometry pass of the deferred path: surface attributes only, lighting happens later
+//once per pixel. takes the same material switches as shader.fs
+layout (location = 0) out vec4 gAlbedo;
+//specular color, shininess as is in alpha (a half float target)
+layout (location = 1) out vec4 gSpecular;
+layout (location = 2) out vec4 gNormal;
+
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    sampler2D normal;
+    vec3 specularColor;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform Material material;
+
+#if HAS_NORMAL_MAP
+in vec4 Tangent;
+
+vec3 PerturbNormal(vec3 normal)
+{
+    vec3 mapped = texture(material.normal, TexCoords).xyz * 2.0 - 1.0;
+    //generated tangents, w is the bitangent sign. without a tangent buffer the attribute reads (0, 0, 0, 1)
+    if (dot(Tangent.xyz, Tangent.xyz) > 1e-12)
+    {
+        vec3 T = normalize(Tangent.xyz - normal * dot(normal, Tangent.xyz));
+        vec3 B = Tangent.w * cross(normal, T);
+        return normalize(mat3(T, B, normal) * mapped);
+    }
+    vec3 dp1 = dFdx(FragPos);
+    vec3 dp2 = dFdy(FragPos);
+    vec2 duv1 = dFdx(TexCoords);
+    vec2 duv2 = dFdy(TexCoords);
+    vec3 dp2perp = cross(dp2, normal);
+    vec3 dp1perp = cross(normal, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+    return normalize(mat3(T * invmax, B * invmax, normal) * mapped);
+}
+#endif
+
+void main()
+{
+    vec3 norm = normalize(Normal);
+#if HAS_NORMAL_MAP
+    norm = PerturbNormal(norm);
+#endif
+    gAlbedo = vec4(texture(material.diffuse, TexCoords).rgb, 1.0);
+#if HAS_SPECULAR_MAP
+    gSpecular = vec4(texture(material.specular, TexCoords).rgb, material.shininess);
+#else
+    gSpecular = vec4(material.specularColor, material.shininess);
+#endif
+    gNormal = vec4(norm, 0.0);
+}
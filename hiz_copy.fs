@@ -0,0 +1,10 @@
+#version 330 core
+//first level of the Hi-Z pyramid: the depth buffer copied into a float color target
+out float Depth;
+
+uniform sampler2D depthTexture;
+
+void main()
+{
+    Depth = texelFetch(depthTexture, ivec2(gl_FragCoord.xy), 0).r;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+//one Hi-Z level from the level above: the farthest of the texels it covers. an odd
+//width or height leaves a last row or column that the texels next to it take in too.
+//the texture's base level is clamped to the level above, so lod 0 reads it
+out float Depth;
+
+uniform sampler2D previousLevel;
+
+void main()
+{
+    ivec2 size = textureSize(previousLevel, 0);
+    ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = min(texel + ivec2(1), size - 1);
+    if (texel.x + 2 == size.x - 1)
+        last.x = size.x - 1;
+    if (texel.y + 2 == size.y - 1)
+        last.y = size.y - 1;
+    float farthest = 0.0;
+    for (int y = texel.y; y <= last.y; y++)
+        for (int x = texel.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(previousLevel, ivec2(x, y), 0).r);
+    Depth = farthest;
+}
@@ -2,85 +2,243 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "AssetWatcher.h"
+#include "Bvh.h"
 #include "Camera.h"
+#include "DeferredRenderer.h"
+#include "FrameProfiler.h"
+#include "GlObject.h"
+#include "Headless.h"
+#include "HiZ.h"
+#include "JobSystem.h"
+#include "Lights.h"
+#include "MemoryRegistry.h"
+#include "MeshCodec.h"
+#include "Model.h"
+#include "ObjLoader.h"
+#include "Profiler.h"
+#include "RingBuffer.h"
 #include "Shader.h"
+#include "Simulation.h"
+#include "TextureStreamer.h"
+#include "TransformSystem.h"
 #include "stb_image.h"
 
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
 #include <iostream>
 #include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+SimulationInput processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-unsigned int loadTexture(char const* path);
+GlTexture loadTexture(char const* path, const std::string& owner);
+GlTexture loadColorTexture(glm::vec3 color, const std::string& owner);
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 Texture;
-
-    bool operator==(const Vertex& rhs) const noexcept
-    {
-        bool pos = rhs.Position.x == this->Position.x && rhs.Position.y == this->Position.y && rhs.Position.z == this->Position.z;
-        bool tex = rhs.Texture.x == this->Texture.x && rhs.Texture.y == this->Texture.y;
-        return pos && tex;
-    }
-
-};
-
-//timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-
-//pitch and yaw
+//the render camera, copied from the simulation every frame
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+//pitch and yaw: mouse and scroll movement since the last frame, handed to the simulation
 float lastX = 400;
 float lastY = 300;
 bool firstMouse = true;
+glm::vec2 mouseOffset = glm::vec2(0.0f);
+float scrollOffset = 0.0f;
 
 glm::vec3 lightPos = glm::vec3(1.2f, 1.0f, 2.0f);
 
 float ambientStrength = 0.1f; //ambient lighting coefficient
 float specularStrength = 0.5f; //specular lighting coefficient
 
-int main()
+//F toggles the camera spot light, which switches the model to a variant without it
+bool flashlight = true;
+bool flashlightKeyDown = false;
+//G switches between forward and deferred shading
+bool deferredShading = false;
+bool deferredKeyDown = false;
+//Z toggles the depth pre-pass, H the Hi-Z occlusion culling
+bool depthPrepass = false;
+bool depthPrepassKeyDown = false;
+bool hizCulling = false;
+bool hizCullingKeyDown = false;
+//P picks the triangle in the middle of the view
+bool pickRequested = false;
+bool pickKeyDown = false;
+
+//command line options, the defaults reproduce the interactive viewer
+struct RunOptions {
+    bool headless = false;
+    int frames = 300;
+    int width = 1200;
+    int height = 900;
+    std::string modelPath = "Aerospace.obj";
+    std::string reportPath = "headless_report.csv";
+    bool watch = true;
+    int pointLights = 4;
+    bool deferred = false;
+    bool depthPrepass = false;
+    bool hiz = false;
+    //headless only: pick along the camera's front vector every frame
+    bool pick = false;
+    //streams texture mips within this many bytes of GPU memory, 0 uploads every mip at load
+    size_t textureBudget = 0;
+    //imports OBJ files through compressed containers in mesh_cache/
+    bool meshCache = false;
+    //warns whenever the registered GPU and CPU memory grows past this many bytes, 0 never
+    size_t memoryLimit = 0;
+    //headless only: render every light count with both paths and compare them
+    std::vector<int> lightSweep;
+};
+
+//largest accepted --width/--height, and --point-lights or --light-sweep count
+const int MAX_TARGET_SIZE = 16384;
+const int MAX_POINT_LIGHTS = 4096;
+
+void printUsage(const char* program)
 {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    
-    //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    std::cout << "Usage: " << program << " [--headless] [--frames N] [--width N] [--height N] [--model PATH] [--report PATH] [--no-watch]"
+        << " [--point-lights N] [--deferred] [--depth-prepass] [--hiz] [--pick] [--texture-budget MB] [--mesh-cache] [--memory-limit MB]"
+        << " [--light-sweep N,N,...]" << std::endl;
+}
 
+//the whole of text as an int in [low, high], throws like std::stoi when it is not one
+int intArgument(const std::string& text, int low, int high)
+{
+    size_t used = 0;
+    int value = std::stoi(text, &used);
+    if (used != text.size())
+        throw std::invalid_argument("trailing characters");
+    if (value < low || value > high)
+        throw std::out_of_range("must be from " + std::to_string(low) + " to " + std::to_string(high));
+    return value;
+}
 
-    GLFWwindow* window = glfwCreateWindow(1200, 900, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
+//false (after printing why and the usage) when a numeric option got something else or a
+//value out of its range
+bool parseArguments(int argc, char** argv, RunOptions& options)
+{
+    for (int i = 1; i < argc; i++)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try
+        {
+            if (arg == "--headless")
+                options.headless = true;
+            else if (arg == "--frames" && hasValue)
+                options.frames = intArgument(argv[++i], 1, INT_MAX);
+            else if (arg == "--width" && hasValue)
+                options.width = intArgument(argv[++i], 1, MAX_TARGET_SIZE);
+            else if (arg == "--height" && hasValue)
+                options.height = intArgument(argv[++i], 1, MAX_TARGET_SIZE);
+            else if (arg == "--model" && hasValue)
+                options.modelPath = argv[++i];
+            else if (arg == "--report" && hasValue)
+                options.reportPath = argv[++i];
+            else if (arg == "--no-watch")
+                options.watch = false;
+            else if (arg == "--point-lights" && hasValue)
+                options.pointLights = intArgument(argv[++i], 0, MAX_POINT_LIGHTS);
+            else if (arg == "--deferred")
+                options.deferred = true;
+            else if (arg == "--depth-prepass")
+                options.depthPrepass = true;
+            else if (arg == "--hiz")
+                options.hiz = true;
+            else if (arg == "--pick")
+                options.pick = true;
+            else if (arg == "--texture-budget" && hasValue)
+                options.textureBudget = (size_t)intArgument(argv[++i], 0, INT_MAX) * 1024 * 1024;
+            else if (arg == "--mesh-cache")
+                options.meshCache = true;
+            else if (arg == "--memory-limit" && hasValue)
+                options.memoryLimit = (size_t)intArgument(argv[++i], 0, INT_MAX) * 1024 * 1024;
+            else if (arg == "--light-sweep" && hasValue)
+            {
+                std::stringstream counts(argv[++i]);
+                std::string count;
+                while (std::getline(counts, count, ','))
+                    options.lightSweep.push_back(intArgument(count, 0, MAX_POINT_LIGHTS));
+            }
+            else
+                std::cout << "Ignoring unknown argument: " << arg << std::endl;
+        }
+        catch (std::exception& e)
+        {
+            std::cout << "ERROR::ARGUMENTS::INVALID_VALUE: " << arg << " " << argv[i] << " (" << e.what() << ")" << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    return true;
+}
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+int main(int argc, char** argv)
+{
+    RunOptions options;
+    if (!parseArguments(argc, argv, options))
         return -1;
+    MemoryRegistry& memory = MemoryRegistry::Get();
+    memory.SetLimit(options.memoryLimit);
+    //created here so the main thread is the one that runs main-thread jobs
+    JobSystem& jobs = JobSystem::Get();
+
+    GLFWwindow* window = NULL;
+    HeadlessContext headlessContext;
+    OffscreenTarget offscreen;
+    if (options.headless)
+    {
+        if (!headlessContext.Create() || !offscreen.Create(options.width, options.height))
+            return -1;
     }
+    else
+    {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    
+        //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-    glEnable(GL_DEPTH_TEST); 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        window = glfwCreateWindow(options.width, options.height, "LearnOpenGL", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+    }
+
+    glEnable(GL_DEPTH_TEST); 
     Shader lightCubeShader("shader_light.vs", "shader_light.fs");
-    Shader lightingShader("shader.vs", "shader.fs");
+    ShaderVariants lightingShaders("shader.vs", "shader.fs");
+    Shader depthShader("shader.vs", "depth_only.fs");
 
     float vertices[] = {
         // positions          // normals           // texture coords
@@ -149,168 +307,90 @@ int main()
     };
 
 
-    std::ifstream readObj;
-    readObj.open("Aerospace.obj");
-
-    if (!readObj) {
+    //a .objz model is a baked container, anything else is parsed as OBJ
+    bool bakedModel = std::filesystem::path(options.modelPath).extension() == ".objz";
+    ObjMesh objMesh;
+    bool loaded = bakedModel ? LoadMeshFile(options.modelPath, objMesh)
+        : options.meshCache ? LoadObjCached(options.modelPath, "mesh_cache", objMesh)
+        : LoadObjFile(options.modelPath, objMesh);
+    if (!loaded) {
         std::cout << "Unable to open file";
         exit(1); // terminate with error
     }
 
-    std::string currentLine;
-
-    std::vector<glm::vec3> point_vertex({});
-    std::vector<glm::vec3> normal_vertex;
-    std::vector<glm::vec2> texture_vertex;
-
-
-    std::vector<int> indices;
-
-    std::vector<Vertex> vertex_data;
+    //Generate Vertex buffer objects and vertex array object. the handles own them, the
+    //plain ids are what the GL calls below use
+    GlVertexArray modelVertexArray = GlVertexArray::Create();
+    GlBuffer modelVertices = GlBuffer::Create();
+    GlBuffer modelIndices = GlBuffer::Create();
+    unsigned int VAO = modelVertexArray.Id(), VBO = modelVertices.Id(), IBO = modelIndices.Id();
+    //the CPU copy stays for picking, culling and reload diffs
+    auto objMeshBytes = [&]() {
+        return objMesh.vertices.size() * sizeof(ObjVertex) + objMesh.indices.size() * sizeof(unsigned int) + objMesh.tangents.size() * sizeof(glm::vec4);
+    };
+    MemoryAllocation modelMeshMemory(MEMORY_MESH_DATA, options.modelPath, objMeshBytes());
 
+    glBindVertexArray(VAO);
 
-    int count = 0;
-    while (getline(readObj, currentLine))
     {
-        std::string sample;
-        std::stringstream str;
-        if (currentLine[0] == 'v')
-        {
-            if (currentLine[1] == 'n')
-            {
-                glm::vec3 temp;
-                str << currentLine.substr(3, currentLine.length());
-                getline(str, sample, ' ');
-                float num = std::stof(sample);
-                temp.x = num;
-
-                getline(str, sample, ' ');
-                num = std::stof(sample);
-                temp.y = num;
-
-                getline(str, sample, ' ');
-                num = std::stof(sample);
-                temp.z = num;
-
-                normal_vertex.push_back(temp);
-            }
-            else if (currentLine[1] == 't')
-            {
-                str << currentLine.substr(3, currentLine.length());
-                
-                glm::vec2 temp;
-                str << currentLine.substr(3, currentLine.length());
-                getline(str, sample, ' ');
-                float num = std::stof(sample);
-                temp.x = num;
-
-                getline(str, sample, ' ');
-                num = std::stof(sample);
-                temp.y = num;
-
-                texture_vertex.push_back(temp);
-            }
-
-            else
-            {
-                str << currentLine.substr(2, currentLine.length());
-                glm::vec3 temp;
-                str << currentLine.substr(3, currentLine.length());
-                getline(str, sample, ' ');
-                float num = std::stof(sample);
-                temp.x = num;
-
-                getline(str, sample, ' ');
-                num = std::stof(sample);
-                temp.y = num;
-
-                getline(str, sample, ' ');
-                num = std::stof(sample);
-                temp.z = num;
-
-                point_vertex.push_back(temp);
-            }
-        }
-        else if (currentLine[0] == 'f')
-        {
-            std::stringstream next_layer;
-            str << currentLine.substr(2, currentLine.length());
-            
-            
-            Vertex point = {};
-            while (getline(str, sample, ' '))
-            {
-                if (sample.find("//") == -1)
-                {
-                    std::stringstream c;
-                    c << sample;
-                    getline(c, sample, '/');
-                    point.Position = point_vertex[std::stoi(sample)];
-                    getline(c, sample, '/');
-                    point.Texture = texture_vertex[std::stoi(sample)];
-                    getline(c, sample, '/');
-                    point.Normal = normal_vertex[std::stoi(sample)];
-                    std::vector<Vertex>::iterator itr = std::find(vertex_data.begin(), vertex_data.end(), point);
-
-                    if (itr != vertex_data.end())
-                    {
-                        indices.push_back(count);
-                        vertex_data.push_back(point);
-                        count++;
-                    }
-                    else
-                    {
-                        int recur_ind = std::distance(vertex_data.begin(), itr);
-                        indices.push_back(recur_ind);
-                    }
-                }
+        PROFILE_ZONE("obj.upload", "gpu");
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, objMesh.vertices.size() * sizeof(ObjVertex), objMesh.vertices.data(), GL_STATIC_DRAW);
 
-                else
-                {
-                    std::size_t ind = sample.find("//");
-                    unsigned int v = std::stoi(sample.substr(0, ind));
-                    point.Position = point_vertex[v - 1];
-                    indices.push_back(v - 1);
-                }
-            }
-            
-        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, objMesh.indices.size() * sizeof(unsigned int), objMesh.indices.data(), GL_STATIC_DRAW);
     }
+    modelVertices.Track(MEMORY_VERTEX_BUFFERS, options.modelPath, objMesh.vertices.size() * sizeof(ObjVertex));
+    modelIndices.Track(MEMORY_INDEX_BUFFERS, options.modelPath, objMesh.indices.size() * sizeof(unsigned int));
+    PROFILE_COUNTER("obj.upload_bytes", objMesh.vertices.size() * sizeof(ObjVertex) + objMesh.indices.size() * sizeof(unsigned int));
 
-    std::cout << indices[100];
-
-    unsigned int VBO, VAO, IBO;
-    //Generate Vertex buffer objects and vertex array object
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &IBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, point_vertex.size() * sizeof(glm::vec3), &point_vertex[0], GL_STATIC_DRAW);
+    //bounds for occlusion culling. smaller clusters cull more precisely but cost more tests
+    const unsigned int clusterTriangles = 64;
+    std::vector<MeshCluster> clusters;
+    std::vector<ClusterRange> clusterRanges;
+    BuildClusters(objMesh, clusterTriangles, clusters, clusterRanges);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (indices).size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
+    //picking BVH in object space, built by the first pick after a load or reload
+    MeshBvh objBvh;
+    size_t pickCount = 0, pickHits = 0;
+    double pickMicroseconds = 0.0;
 
     
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, Position));
     glEnableVertexAttribArray(0);  //set vertex attribute pointers
 
-
-    /*glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, Normal));
     glEnableVertexAttribArray(1); //set normal vec attribute pointers
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2); //set texcoords for vertex shaders*/
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, TexCoords));
+    glEnableVertexAttribArray(2); //set texcoords for vertex shaders
+
+    //tangents have their own buffer, only meshes with a normal-mapped material have any
+    GlBuffer tangentBuffer = GlBuffer::Create();
+    unsigned int tangentVBO = tangentBuffer.Id();
+    auto uploadTangents = [&]() {
+        glBindVertexArray(VAO);
+        if (objMesh.tangents.empty())
+        {
+            glDisableVertexAttribArray(3);
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, tangentVBO);
+        glBufferData(GL_ARRAY_BUFFER, objMesh.tangents.size() * sizeof(glm::vec4), objMesh.tangents.data(), GL_STATIC_DRAW);
+        tangentBuffer.Track(MEMORY_VERTEX_BUFFERS, options.modelPath, objMesh.tangents.size() * sizeof(glm::vec4));
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(3);
+    };
+    uploadTangents();
 
     //Lighting VAO
-    unsigned int lightVAO, VBO_2;
-    glGenVertexArrays(1, &lightVAO);
-    glGenBuffers(1, &VBO_2);
+    GlVertexArray lightVertexArray = GlVertexArray::Create();
+    GlBuffer lightVertices = GlBuffer::Create();
+    unsigned int lightVAO = lightVertexArray.Id(), VBO_2 = lightVertices.Id();
     glBindVertexArray(lightVAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO_2);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    lightVertices.Track(MEMORY_VERTEX_BUFFERS, "viewer", sizeof(vertices));
     
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -338,25 +418,355 @@ int main()
     
     glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
 
-    unsigned int diffuseMap = loadTexture("container2.png");
-    unsigned int specularMap = loadTexture("container2_specular.png");
+    //textures the viewer created, by id. streamed ones belong to the streamer
+    std::unordered_map<unsigned int, GlTexture> ownedTextures;
+    auto own = [&](GlTexture texture) {
+        unsigned int id = texture.Id();
+        ownedTextures.emplace(id, std::move(texture));
+        return id;
+    };
+    unsigned int diffuseMap = own(loadTexture("container2.png", "viewer"));
+    unsigned int specularMap = own(loadTexture("container2_specular.png", "viewer"));
+
+    //GL state for each entry of the material table. Textures are shared by path, materials
+    //without a diffuse map get a 1x1 texture of their color, and names the MTL files never
+    //defined keep the container look. permutation picks the shader variant for the material
+    struct MaterialTextures {
+        unsigned int diffuse;
+        unsigned int specular;
+        unsigned int normal;
+        glm::vec3 specularColor;
+        float shininess;
+        ShaderPermutation permutation;
+    };
+    std::vector<MaterialTextures> materialTextures;
+    size_t split = options.modelPath.find_last_of("/\\");
+    std::string modelDirectory = split == std::string::npos ? "" : options.modelPath.substr(0, split + 1);
+    std::unordered_map<std::string, unsigned int> textureCache;
+    TextureStreamer textureStreamer;
+    textureStreamer.SetBudget(options.textureBudget);
+    textureCache.emplace("container2.png", diffuseMap);
+    textureCache.emplace("container2_specular.png", specularMap);
+    auto textureFor = [&](const std::string& map, glm::vec3 color) {
+        std::string key = map.empty() ? "#" + std::to_string(color.x) + "," + std::to_string(color.y) + "," + std::to_string(color.z) : modelDirectory + map;
+        std::unordered_map<std::string, unsigned int>::iterator itr = textureCache.find(key);
+        if (itr != textureCache.end())
+            return itr->second;
+        unsigned int texture = map.empty() ? own(loadColorTexture(color, options.modelPath))
+            : textureStreamer.Active() ? textureStreamer.Load(key, options.modelPath) : own(loadTexture(key.c_str(), options.modelPath));
+        textureCache.emplace(key, texture);
+        return texture;
+    };
+    auto loadMaterials = [&]() {
+        PROFILE_ZONE("materials.load", "texture");
+        materialTextures.clear();
+        for (const ObjMaterial& material : objMesh.materials)
+        {
+            MaterialTextures textures = { textureCache["container2.png"], textureCache["container2_specular.png"], 0, glm::vec3(0.0f), 64.0f, ShaderPermutation() };
+            if (material.Defined)
+            {
+                textures.diffuse = textureFor(material.DiffuseMap, material.Diffuse);
+                textures.specular = material.SpecularMap.empty() ? 0 : textureFor(material.SpecularMap, material.Specular);
+                textures.normal = material.NormalMap.empty() ? 0 : textureFor(material.NormalMap, glm::vec3(0.5f, 0.5f, 1.0f));
+                textures.specularColor = material.Specular;
+                textures.shininess = material.Shininess;
+                textures.permutation.specularMap = !material.SpecularMap.empty();
+                textures.permutation.normalMap = !material.NormalMap.empty();
+            }
+            materialTextures.push_back(textures);
+        }
+        PROFILE_COUNTER("materials.count", objMesh.materials.size());
+    };
+    loadMaterials();
+    //how densely each range's texture coordinates cover it, for picking the mips to stream
+    std::vector<TextureFootprint> footprints;
+    if (textureStreamer.Active())
+        MeasureFootprints(objMesh, footprints);
+
+    //re-export a file while the viewer runs and only that file is re-imported. headless runs
+    //stay off so their output depends on the command line alone
+    AssetWatcher watcher;
+    //the MTL libraries and textures the current materials come from. called again after a
+    //reload, which can name files that were not there at startup
+    auto watchMaterials = [&]()
+    {
+        if (!bakedModel)
+        {
+            for (const std::string& library : objMesh.libraries)
+                watcher.WatchLibrary(library, options.modelPath);
+        }
+        for (const std::pair<const std::string, unsigned int>& texture : textureCache)
+        {
+            if (texture.first[0] != '#')
+                watcher.WatchTexture(texture.first);
+        }
+    };
+    if (options.watch && !options.headless)
+    {
+        //re-importing goes through the OBJ parser, so baked containers are not watched
+        if (!bakedModel)
+            watcher.WatchMesh(options.modelPath, objMesh);
+        watchMaterials();
+        watcher.Start();
+    }
+
+    //everything up to here is load time, dump it before the render loop starts
+    PROFILE_WRITE_TRACE("load_trace.json");
+    PROFILE_PRINT_SUMMARY();
     //unsigned int specularMap = loadTexture("lighting_maps_specular_color.png");
     //unsigned int emissionMap = loadTexture("matrix.jpg");
 
-    lightingShader.use();
-    lightingShader.setInt("material.diffuse", 0);
-    lightingShader.setInt("material.specular", 1);
     //lightingShader.setInt("material.emission", 2);
 
     glm::vec3 trans = glm::vec3(0.0f, 0.0f, 0.0f);
     float ang = 0.0f;
-    while (!glfwWindowShouldClose(window))
+    FrameProfiler frameProfiler;
+
+    //the model and the light cubes as transform nodes, rebuilt only when they move
+    TransformSystem sceneTransforms;
+    int modelNode = sceneTransforms.Add(-1, trans, glm::angleAxis(ang, glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(1.0f));
+    int lightCubeNodes[4];
+    for (int i = 0; i < 4; i++)
+        lightCubeNodes[i] = sceneTransforms.Add(-1, pointLightPositions[i], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.2f));
+    float nodeAngle = ang;
+
+    //camera and model motion tick at a fixed 120Hz on the simulation thread, the render loop
+    //draws the state of its previous frame's clock while the next ticks run
+    SimulationLoop simulation;
+    simulation.Start(camera, trans, ang, options.headless ? 0.0 : glfwGetTime());
+
+    //headless runs fly a fixed path around the model's bounds and use a fixed 60Hz clock,
+    //so two runs over the same model produce the same frames
+    glm::vec3 boundsMin = objMesh.vertices.empty() ? glm::vec3(0.0f) : objMesh.vertices[0].Position;
+    glm::vec3 boundsMax = boundsMin;
+    for (const ObjVertex& v : objMesh.vertices)
     {
+        boundsMin = glm::min(boundsMin, v.Position);
+        boundsMax = glm::max(boundsMax, v.Position);
+    }
+    float boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+    CameraPath cameraPath((boundsMin + boundsMax) * 0.5f, boundsRadius);
+    float aspect = options.headless ? (float)options.width / (float)options.height : 800.0f / 600.0f;
+    float farPlane = options.headless ? std::max(100.0f, boundsRadius * 6.0f) : 100.0f;
+
+    //the original four point lights all sit at the first light cube, extra lights for
+    //light-count tests are spread around the model
+    SceneLights sceneLights;
+    sceneLights.dirLight = { glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3(0.05f), glm::vec3(0.4f), glm::vec3(0.5f) };
+    sceneLights.spotLight = { true, camera.Position, camera.Front, glm::vec3(0.0f), glm::vec3(1.0f), glm::vec3(1.0f), 1.0f, 0.09f, 0.032f,
+        glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(15.0f)) };
+    int maxPointLights = options.pointLights;
+    for (int count : options.lightSweep)
+        maxPointLights = std::max(maxPointLights, count);
+    for (int i = 0; i < std::min(maxPointLights, 4); i++)
+        sceneLights.pointLights.push_back({ pointLightPositions[0], glm::vec3(0.2f), glm::vec3(0.5f), glm::vec3(1.0f), 1.0f, 0.09f, 0.032f });
+    std::vector<PointLightSource> extraLights = MakeLightRing(std::max(maxPointLights - 4, 0), (boundsMin + boundsMax) * 0.5f, boundsRadius);
+    sceneLights.pointLights.insert(sceneLights.pointLights.end(), extraLights.begin(), extraLights.end());
+
+    //the forward shader reads its lights from one uniform block
+    int maxBlockSize = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+    int forwardLightLimit = maxBlockSize / (int)sizeof(PointLightBlock);
+
+    //per-frame data lives in a triple-buffered ring: the Transforms block of shader.vs, the
+    //forward point lights, the deferred light instances and the Hi-Z indirect draws
+    const unsigned int transformsBinding = 0;
+    const unsigned int pointLightsBinding = 1;
+    bool multiDrawIndirect = GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_multi_draw_indirect;
+    struct DrawElementsIndirectCommand {
+        unsigned int count;
+        unsigned int instanceCount;
+        unsigned int firstIndex;
+        int baseVertex;
+        unsigned int baseInstance;
+    };
+    auto ringBytesPerFrame = [&]() {
+        //block sizes plus one alignment gap for each of the four allocations
+        return 3 * sizeof(glm::mat4) + sceneLights.pointLights.size() * (sizeof(PointLightBlock) + 64) +
+            clusters.size() * sizeof(DrawElementsIndirectCommand) + 4 * 256;
+    };
+    FrameRingBuffer frameRing;
+    if (!frameRing.Create(ringBytesPerFrame()))
+    {
+        std::cout << "ERROR::RING::UNAVAILABLE" << std::endl;
+        return -1;
+    }
+
+    deferredShading = options.deferred;
+    DeferredRenderer deferred;
+    depthPrepass = options.depthPrepass;
+    hizCulling = options.hiz;
+    HiZBuffer hiz;
+    FragmentCounter fragmentCounter;
+    unsigned int targetFramebuffer = options.headless ? offscreen.Framebuffer() : 0;
+
+    //a light sweep renders the same camera path once per light count and path
+    struct SweepConfig {
+        int lights;
+        bool deferred;
+    };
+    std::vector<SweepConfig> sweepConfigs;
+    int framesPerConfig = options.frames;
+    if (options.headless)
+    {
+        for (int count : options.lightSweep)
+        {
+            if (count <= forwardLightLimit)
+                sweepConfigs.push_back({ count, false });
+            else
+                std::cout << "LIGHTING::SWEEP forward path skipped at " << count << " lights (limit " << forwardLightLimit << ")" << std::endl;
+            sweepConfigs.push_back({ count, true });
+        }
+        if (!sweepConfigs.empty())
+            options.frames = framesPerConfig * (int)sweepConfigs.size();
+    }
+
+    struct HeadlessFrame {
+        double milliseconds;
+        unsigned long long hash;
+        size_t frustumCulled;
+        size_t occluded;
+        unsigned long long fragments;
+    };
+    std::vector<HeadlessFrame> headlessFrames;
+    std::vector<ClusterVisibility> clusterVisibility;
+    int frame = 0;
+
+    while (options.headless ? frame < options.frames : !glfwWindowShouldClose(window))
+    {
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        frameProfiler.BeginFrame();
+        jobs.RunMainThreadJobs();
+
+        //apply finished re-imports before anything of this frame is drawn, so a frame
+        //never mixes old and new data
+        for (AssetUpdate& update : watcher.TakeUpdates())
+        {
+            PROFILE_ZONE("reload.apply", "reload");
+            if (update.kind == AssetKind::Mesh)
+            {
+                size_t uploaded = 0;
+                glBindVertexArray(VAO);
+                if (update.vertexResize)
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+                    glBufferData(GL_ARRAY_BUFFER, update.mesh.vertices.size() * sizeof(ObjVertex), update.mesh.vertices.data(), GL_STATIC_DRAW);
+                    modelVertices.Track(MEMORY_VERTEX_BUFFERS, options.modelPath, update.mesh.vertices.size() * sizeof(ObjVertex));
+                    uploaded += update.mesh.vertices.size() * sizeof(ObjVertex);
+                }
+                else
+                    uploaded += AssetWatcher::UploadSpans(GL_ARRAY_BUFFER, VBO, update.mesh.vertices.data(), update.vertexSpans);
+                if (update.indexResize)
+                {
+                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+                    glBufferData(GL_ELEMENT_ARRAY_BUFFER, update.mesh.indices.size() * sizeof(unsigned int), update.mesh.indices.data(), GL_STATIC_DRAW);
+                    modelIndices.Track(MEMORY_INDEX_BUFFERS, options.modelPath, update.mesh.indices.size() * sizeof(unsigned int));
+                    uploaded += update.mesh.indices.size() * sizeof(unsigned int);
+                }
+                else
+                    uploaded += AssetWatcher::UploadSpans(GL_ELEMENT_ARRAY_BUFFER, IBO, update.mesh.indices.data(), update.indexSpans);
+                PROFILE_COUNTER("reload.upload_bytes", uploaded);
+                std::cout << "RELOAD::MESH " << update.path << ": " << update.vertexSpans.size() + update.indexSpans.size() << " spans, " << uploaded << " bytes uploaded" << std::endl;
+
+                bool materialsChanged = update.mesh.materials.size() != objMesh.materials.size();
+                for (size_t i = 0; !materialsChanged && i < objMesh.materials.size(); i++)
+                    materialsChanged = !objMesh.materials[i].SameAs(update.mesh.materials[i]);
+                objMesh = std::move(update.mesh);
+                modelMeshMemory.Resize(objMeshBytes());
+                uploadTangents();
+                objBvh.Clear();
+                BuildClusters(objMesh, clusterTriangles, clusters, clusterRanges);
+                if (textureStreamer.Active())
+                    MeasureFootprints(objMesh, footprints);
+                frameRing.Reserve(ringBytesPerFrame());
+                if (materialsChanged)
+                    loadMaterials();
+                watchMaterials();
+            }
+            else
+            {
+                //the new texture is complete before any material points at it, then every user
+                //switches over at once and the old object goes away
+                std::unordered_map<std::string, unsigned int>::iterator itr = textureCache.find(update.path);
+                if (itr == textureCache.end())
+                    continue;
+                unsigned int previous = itr->second;
+                if (textureStreamer.Streams(previous))
+                {
+                    //streamed textures keep their id, so the materials stay as they are
+                    textureStreamer.Reload(previous, update.pixels.data(), update.width, update.height, update.components);
+                    std::cout << "RELOAD::TEXTURE " << update.path << std::endl;
+                    continue;
+                }
+                GlTexture created = GlTexture::Adopt(AssetWatcher::CreateTexture(update));
+                created.Track(MEMORY_TEXTURES, options.modelPath, TextureBytes(update.width, update.height, update.components, true));
+                unsigned int texture = own(std::move(created));
+                itr->second = texture;
+                for (MaterialTextures& material : materialTextures)
+                {
+                    if (material.diffuse == previous)
+                        material.diffuse = texture;
+                    if (material.specular == previous)
+                        material.specular = texture;
+                    if (material.normal == previous)
+                        material.normal = texture;
+                }
+                ownedTextures.erase(previous);
+                std::cout << "RELOAD::TEXTURE " << update.path << std::endl;
+            }
+        }
+
+        //shader edits are picked up too. lighting uniforms are set on every use, the light cube samplers are set again
+        if (options.watch && !options.headless)
+        {
+            lightingShaders.ReloadIfChanged();
+            depthShader.ReloadIfChanged();
+            if (deferred.Width > 0)
+                deferred.ReloadIfChanged();
+            if (lightCubeShader.ReloadIfChanged())
+            {
+                lightCubeShader.use();
+                lightCubeShader.setInt("texture1", 0);
+                lightCubeShader.setInt("texture2", 1);
+            }
+        }
+
         // input
-        processInput(window);
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        frameProfiler.BeginCpu("input");
+        if (!options.headless)
+            simulation.PushInput(processInput(window));
+        frameProfiler.EndCpu("input");
+        double clock = options.headless ? frame / 60.0 : glfwGetTime();
+        float currentFrame = (float)clock;
+        SimulationState state = simulation.Advance(clock);
+        camera.Position = state.cameraPosition;
+        camera.SetOrientation(state.cameraYaw, state.cameraPitch);
+        camera.Zoom = state.cameraZoom;
+        trans = state.modelTranslation;
+        ang = state.modelAngle;
+
+        int pointLightCount = options.pointLights;
+        std::string passLabel;
+        if (options.headless)
+        {
+            if (!sweepConfigs.empty())
+            {
+                const SweepConfig& config = sweepConfigs[frame / framesPerConfig];
+                pointLightCount = config.lights;
+                deferredShading = config.deferred;
+                passLabel = std::string(config.deferred ? " deferred/" : " forward/") + std::to_string(config.lights);
+                cameraPath.Apply(camera, frame % framesPerConfig, framesPerConfig);
+            }
+            else
+                cameraPath.Apply(camera, frame, options.frames);
+            offscreen.Bind();
+        }
+        if (!deferredShading && pointLightCount > forwardLightLimit)
+            pointLightCount = forwardLightLimit;
+        pointLightCount = std::min(pointLightCount, (int)sceneLights.pointLights.size());
+        sceneLights.spotLight.enabled = flashlight;
+        sceneLights.spotLight.position = camera.Position;
+        sceneLights.spotLight.direction = camera.Front;
         
 
 
@@ -365,87 +775,125 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         
-        lightColor.x = (float)sin(glfwGetTime() * 2.0);
-        lightColor.y = (float)sin(glfwGetTime() * 1.3);
-        lightColor.z = (float)sin(glfwGetTime() * 0.7);
+        lightColor.x = (float)sin(currentFrame * 2.0);
+        lightColor.y = (float)sin(currentFrame * 1.3);
+        lightColor.z = (float)sin(currentFrame * 0.7);
         glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
         glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
 
-        lightingShader.use();
-
-        lightingShader.setVec3("light.position", lightPos);
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        //directional light setup
-        lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, farPlane);
+        glm::mat4 view = camera.GetViewMatrix();
+        
 
-        //point light setup
-        for (int i = 0; i < 4; i++) {
-            std::string number = std::to_string(i);
-            lightingShader.setVec3("potLight[" + number + "].position", pointLightPositions[0]);
-            lightingShader.setFloat("potLight[" + number + "].constant", 1.0f);
-            lightingShader.setFloat("potLight[" + number + "].linear", 0.09f);
-            lightingShader.setFloat("potLight[" + number + "].quadratic", 0.032f);
-            lightingShader.setVec3("potLight[" + number + "].ambient", 0.2f, 0.2f, 0.2f);
-            lightingShader.setVec3("potLight[" + number + "].diffuse", 0.5f, 0.5f, 0.5f);
-            lightingShader.setVec3("potLight[" + number + "].specular", 1.0f, 1.0f, 1.0f);
+        if (trans != sceneTransforms.Translation(modelNode))
+            sceneTransforms.SetTranslation(modelNode, trans); // translate it down so it's at the center of the scene
+        if (ang != nodeAngle)
+        {
+            sceneTransforms.SetRotation(modelNode, glm::angleAxis(ang, glm::vec3(0.0f, 1.0f, 0.0f)));
+            nodeAngle = ang;
         }
-        
-        //spotlight setup
-        lightingShader.setVec3("spotLight.position", camera.Position);
-        lightingShader.setVec3("spotLight.direction", camera.Front);
-        lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-        lightingShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-        lightingShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("spotLight.constant", 1.0f);
-        lightingShader.setFloat("spotLight.linear", 0.09f);
-        lightingShader.setFloat("spotLight.quadratic", 0.032f);
-        lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-        lightingShader.setVec3("light.direction", -0.2f, -1.0f, -0.3f);
-
-        lightingShader.setFloat("material.shininess", 64.0f);
+        frameProfiler.BeginCpu("transforms");
+        sceneTransforms.Update();
+        sceneTransforms.UpdateMVP(projection * view);
+        frameProfiler.EndCpu("transforms");
+        glm::mat4 model = sceneTransforms.World(modelNode);
 
-        
+        if (pickRequested || (options.headless && options.pick))
+        {
+            pickRequested = false;
+            if (!objBvh.Built())
+                objBvh.Build(objMesh.vertices, objMesh.indices);
+            std::chrono::steady_clock::time_point pickStart = std::chrono::steady_clock::now();
+            RayHit hit;
+            bool picked = objBvh.Pick(camera.Position, camera.Front, model, hit);
+            pickMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+            pickCount++;
+            pickHits += picked ? 1 : 0;
+            if (!options.headless && picked)
+            {
+                std::string materialName;
+                for (const ObjMaterialRange& range : objMesh.ranges)
+                {
+                    if (hit.triangle * 3 >= range.indexOffset && hit.triangle * 3 < range.indexOffset + range.indexCount)
+                        materialName = objMesh.materials[range.material].Name;
+                }
+                std::cout << "PICK::triangle " << hit.triangle << " (" << materialName << ") at " << hit.distance << std::endl;
+            }
+            else if (!options.headless)
+                std::cout << "PICK::nothing" << std::endl;
+        }
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.f);
-        glm::mat4 view = camera.GetViewMatrix();
+        //cluster tests run on the job system while this thread fills the ring and sets uniforms
+        JobHandle clustersTested;
+        if (hizCulling)
+        {
+            clusterVisibility.resize(clusters.size());
+            glm::mat4 viewProjection = projection * view;
+            clustersTested = jobs.ParallelFor(clusters.size(), 64, [&clusters, &clusterVisibility, &hiz, model, viewProjection](size_t begin, size_t end) {
+                for (size_t c = begin; c < end; c++)
+                    clusterVisibility[c] = hiz.Test(clusters[c].boundsMin, clusters[c].boundsMax, model, viewProjection);
+            });
+        }
 
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-        
+        //this frame's transforms and forward lights go to the ring once, every program reads the same copy
+        frameRing.BeginFrame();
+        RingAllocation transforms = frameRing.AllocateUniform(3 * sizeof(glm::mat4));
+        if (transforms.Valid())
+        {
+            glm::mat4 matrices[3] = { projection, view, model };
+            memcpy(transforms.Data, matrices, sizeof(matrices));
+            glBindBufferRange(GL_UNIFORM_BUFFER, transformsBinding, frameRing.Buffer(), transforms.Offset, transforms.Size);
+        }
+        if (!deferredShading && pointLightCount > 0)
+        {
+            RingAllocation lights = frameRing.AllocateUniform(pointLightCount * sizeof(PointLightBlock));
+            if (lights.Valid())
+            {
+                PointLightBlock* blocks = (PointLightBlock*)lights.Data;
+                for (int i = 0; i < pointLightCount; i++)
+                    blocks[i] = ToBlock(sceneLights.pointLights[i]);
+                glBindBufferRange(GL_UNIFORM_BUFFER, pointLightsBinding, frameRing.Buffer(), lights.Offset, lights.Size);
+            }
+        }
 
-        glm::mat4 model = glm::mat4(1.0f);
-        
-        model = glm::translate(model, trans); // translate it down so it's at the center of the scene
-        model = glm::rotate(model, ang, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-            trans.y += 0.01f;
-        if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
-            trans.y -= 0.01f;
-        if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-            trans.x -= 0.01f;
-        if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-            trans.x += 0.01f;
-        if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-            trans.z -= 0.01f;
-        if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
-            trans.z += 0.01f;
-        if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-            ang += 0.01f;
-
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-        lightingShader.setMat4("model", model);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
+        //per-frame state, set on every shader variant this frame draws with. the G-buffer
+        //pass only needs the surface half, the forward pass also takes the lights
+        auto setSurfaceUniforms = [&](Shader& surfaceShader) {
+            surfaceShader.use();
+            surfaceShader.setInt("material.diffuse", 0);
+            surfaceShader.setInt("material.specular", 1);
+            surfaceShader.setInt("material.normal", 2);
+            surfaceShader.setBlockBinding("Transforms", transformsBinding);
+            surfaceShader.setBlockBinding("PointLights", pointLightsBinding);
+        };
+        auto setLightingUniforms = [&](Shader& lightingShader) {
+            frameProfiler.BeginCpu("uniforms");
+            setSurfaceUniforms(lightingShader);
+
+            lightingShader.setVec3("light.position", lightPos);
+            lightingShader.setVec3("viewPos", camera.Position);
+
+            //directional light setup
+            lightingShader.setVec3("dirLight.direction", sceneLights.dirLight.direction);
+            lightingShader.setVec3("dirLight.ambient", sceneLights.dirLight.ambient);
+            lightingShader.setVec3("dirLight.diffuse", sceneLights.dirLight.diffuse);
+            lightingShader.setVec3("dirLight.specular", sceneLights.dirLight.specular);
+
+            //spotlight setup
+            const SpotLightSource& spot = sceneLights.spotLight;
+            lightingShader.setVec3("spotLight.position", spot.position);
+            lightingShader.setVec3("spotLight.direction", spot.direction);
+            lightingShader.setVec3("spotLight.ambient", spot.ambient);
+            lightingShader.setVec3("spotLight.diffuse", spot.diffuse);
+            lightingShader.setVec3("spotLight.specular", spot.specular);
+            lightingShader.setFloat("spotLight.constant", spot.constant);
+            lightingShader.setFloat("spotLight.linear", spot.linear);
+            lightingShader.setFloat("spotLight.quadratic", spot.quadratic);
+            lightingShader.setFloat("spotLight.cutOff", spot.cutOff);
+            lightingShader.setFloat("spotLight.outerCutOff", spot.outerCutOff);
+            lightingShader.setVec3("light.direction", -0.2f, -1.0f, -0.3f);
+            frameProfiler.EndCpu("uniforms");
+        };
 
         //glActiveTexture(GL_TEXTURE2);
         //glBindTexture(GL_TEXTURE_2D, emissionMap);
@@ -462,8 +910,190 @@ int main()
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }*/
         
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        //with Hi-Z culling on, each range draws only its visible clusters, adjacent ones merged
+        //into a single run, and the runs of a range go out in one glMultiDrawElements
+        std::vector<GLsizei> runCounts;
+        std::vector<const void*> runOffsets;
+        std::vector<size_t> rangeRuns(objMesh.ranges.size() + 1, 0);
+        size_t frustumCulled = 0, occluded = 0;
+        if (hizCulling)
+        {
+            FrameProfiler::CpuScope cullScope(frameProfiler, "hiz_test");
+            jobs.Wait(clustersTested);
+            for (size_t i = 0; i < objMesh.ranges.size(); i++)
+            {
+                const ClusterRange& clusterRange = clusterRanges[i];
+                unsigned int runEnd = 0;
+                for (unsigned int c = clusterRange.firstCluster; c < clusterRange.firstCluster + clusterRange.clusterCount; c++)
+                {
+                    const MeshCluster& cluster = clusters[c];
+                    ClusterVisibility visibility = clusterVisibility[c];
+                    if (visibility == ClusterVisibility::OutsideFrustum)
+                        frustumCulled++;
+                    else if (visibility == ClusterVisibility::Occluded)
+                        occluded++;
+                    else if (runCounts.size() > rangeRuns[i] && runEnd == cluster.indexOffset)
+                        runCounts.back() += (GLsizei)cluster.indexCount;
+                    else
+                    {
+                        runCounts.push_back((GLsizei)cluster.indexCount);
+                        runOffsets.push_back((const void*)(cluster.indexOffset * sizeof(unsigned int)));
+                    }
+                    if (visibility == ClusterVisibility::Visible)
+                        runEnd = cluster.indexOffset + cluster.indexCount;
+                }
+                rangeRuns[i + 1] = runCounts.size();
+            }
+        }
+        //the same runs as indirect commands, so the driver reads them from the ring
+        RingAllocation commands = { NULL, 0, 0 };
+        if (hizCulling && multiDrawIndirect && !runCounts.empty())
+            commands = frameRing.Allocate(runCounts.size() * sizeof(DrawElementsIndirectCommand), 4);
+        if (commands.Valid())
+        {
+            DrawElementsIndirectCommand* command = (DrawElementsIndirectCommand*)commands.Data;
+            for (size_t run = 0; run < runCounts.size(); run++)
+                command[run] = { (unsigned int)runCounts[run], 1, (unsigned int)((size_t)runOffsets[run] / sizeof(unsigned int)), 0, 0 };
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frameRing.Buffer());
+        }
+        frameRing.Flush();
+        auto drawRange = [&](size_t i) {
+            const ObjMaterialRange& range = objMesh.ranges[i];
+            if (!hizCulling)
+                glDrawElements(GL_TRIANGLES, (GLsizei)range.indexCount, GL_UNSIGNED_INT, (void*)(range.indexOffset * sizeof(unsigned int)));
+            else if (rangeRuns[i + 1] == rangeRuns[i])
+                return;
+            else if (commands.Valid())
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(commands.Offset + rangeRuns[i] * sizeof(DrawElementsIndirectCommand)),
+                    (GLsizei)(rangeRuns[i + 1] - rangeRuns[i]), 0);
+            else
+                glMultiDrawElements(GL_TRIANGLES, &runCounts[rangeRuns[i]], GL_UNSIGNED_INT, &runOffsets[rangeRuns[i]], (GLsizei)(rangeRuns[i + 1] - rangeRuns[i]));
+        };
+        auto rangeEmpty = [&](size_t i) {
+            return hizCulling && rangeRuns[i + 1] == rangeRuns[i];
+        };
+
+        //depth only, so the shading pass after it shades each pixel once
+        auto drawDepth = [&]() {
+            glBindVertexArray(VAO);
+            depthShader.use();
+            depthShader.setBlockBinding("Transforms", transformsBinding);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (size_t i = 0; i < objMesh.ranges.size(); i++)
+                drawRange(i);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_LEQUAL);
+            glDepthMask(GL_FALSE);
+        };
+
+        //the loader groups indices by material, so one bind and one draw per material.
+        //the G-buffer variants only differ by material maps, lights are applied afterwards
+        auto drawModel = [&](bool gBufferPass) {
+            glBindVertexArray(VAO);
+            unsigned int currentProgram = 0;
+            for (size_t i = 0; i < objMesh.ranges.size(); i++)
+            {
+                const ObjMaterialRange& range = objMesh.ranges[i];
+                if (rangeEmpty(i))
+                    continue;
+                const MaterialTextures& material = materialTextures[range.material];
+                ShaderPermutation permutation = material.permutation;
+                if (!gBufferPass)
+                {
+                    permutation.pointLights = pointLightCount;
+                    permutation.spotLight = flashlight;
+                }
+                Shader& lightingShader = gBufferPass ? deferred.GeometryShaders().Get(permutation) : lightingShaders.Get(permutation);
+                if (lightingShader.ID != currentProgram)
+                {
+                    if (gBufferPass)
+                        setSurfaceUniforms(lightingShader);
+                    else
+                        setLightingUniforms(lightingShader);
+                    currentProgram = lightingShader.ID;
+                }
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, material.diffuse);
+                if (permutation.specularMap)
+                {
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, material.specular);
+                }
+                else
+                    lightingShader.setVec3("material.specularColor", material.specularColor);
+                if (permutation.normalMap)
+                {
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, material.normal);
+                }
+                lightingShader.setFloat("material.shininess", material.shininess);
+                drawRange(i);
+            }
+        };
+
+        int targetWidth = options.width, targetHeight = options.height;
+        if (!options.headless)
+            glfwGetFramebufferSize(window, &targetWidth, &targetHeight);
+
+        //every range drawn this frame asks for the mip its nearest point needs. headless runs
+        //wait for the loads, so their frames do not depend on thread timing
+        if (textureStreamer.Active())
+        {
+            float focalPixels = (float)targetHeight / (2.0f * tan(glm::radians(camera.Zoom) * 0.5f));
+            for (size_t i = 0; i < objMesh.ranges.size(); i++)
+            {
+                if (rangeEmpty(i))
+                    continue;
+                const MaterialTextures& material = materialTextures[objMesh.ranges[i].material];
+                float texcoordsPerPixel = footprints[i].TexcoordsPerPixel(model, camera.Position, focalPixels);
+                textureStreamer.Request(material.diffuse, texcoordsPerPixel);
+                if (material.permutation.specularMap)
+                    textureStreamer.Request(material.specular, texcoordsPerPixel);
+                if (material.permutation.normalMap)
+                    textureStreamer.Request(material.normal, texcoordsPerPixel);
+            }
+            textureStreamer.Update();
+            if (options.headless)
+                textureStreamer.Finish();
+        }
+        if (deferredShading)
+        {
+            //the G-buffer follows the framebuffer size, it is only allocated once deferred is used
+            if (deferred.Width == 0 && !deferred.Create(targetWidth, targetHeight))
+            {
+                std::cout << "ERROR::DEFERRED::UNAVAILABLE, staying on forward shading" << std::endl;
+                deferredShading = false;
+            }
+            deferred.Resize(targetWidth, targetHeight);
+        }
+        if (deferredShading)
+        {
+            frameProfiler.BeginGpu("gbuffer" + passLabel);
+            deferred.BeginGeometry();
+            if (depthPrepass)
+                drawDepth();
+            fragmentCounter.Begin();
+            drawModel(true);
+            fragmentCounter.End();
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            frameProfiler.EndGpu();
+            frameProfiler.BeginGpu("lighting" + passLabel);
+            deferred.Light(targetFramebuffer, view, projection, camera.Position, sceneLights, pointLightCount, &frameRing);
+            frameProfiler.EndGpu();
+        }
+        else
+        {
+            frameProfiler.BeginGpu("model" + passLabel);
+            if (depthPrepass)
+                drawDepth();
+            fragmentCounter.Begin();
+            drawModel(false);
+            fragmentCounter.End();
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            frameProfiler.EndGpu();
+        }
 
 
         lightCubeShader.use();
@@ -473,27 +1103,152 @@ int main()
         lightCubeShader.setMat4("view", view);  
         lightCubeShader.setVec3("lightColor", lightColor);
 
+        frameProfiler.BeginGpu("light_cubes");
         glBindVertexArray(lightVAO);
         
         for (int i = 0; i < 4; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f));
-            lightCubeShader.setMat4("model", model);
+            lightCubeShader.setMat4("model", sceneTransforms.World(lightCubeNodes[i]));
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
+        frameProfiler.EndGpu();
+
+        //the finished depth becomes the occluder set for the frames after this one
+        if (hizCulling)
+        {
+            if (hiz.Width == 0 && !hiz.Create(targetWidth, targetHeight))
+            {
+                std::cout << "ERROR::HIZ::UNAVAILABLE, occlusion culling off" << std::endl;
+                hizCulling = false;
+            }
+            else
+            {
+                hiz.Resize(targetWidth, targetHeight);
+                frameProfiler.BeginGpu("hiz");
+                hiz.Build(targetFramebuffer, projection * view);
+                frameProfiler.EndGpu();
+            }
+        }
+        else if (hiz.Width > 0)
+            hiz.Invalidate();
+        frameRing.EndFrame();
 
         //check and call events and swap the buffers
 
-        
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        frameProfiler.EndFrame();
+        if (options.headless)
+        {
+            //the readback waits for the frame to finish, so the time below is the full render time
+            unsigned long long hash = offscreen.ReadAndHash();
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+            headlessFrames.push_back({ milliseconds, hash, frustumCulled, occluded, fragmentCounter.Last });
+            frame++;
+        }
+        else
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
 
-    /*glDeleteVertexArrays(1, &VAO);
-    glDeleteVertexArrays(1, &lightVAO);
-    glDeleteBuffers(1, &VBO);*/
+    textureStreamer.Finish();
+    watcher.Stop();
+    simulation.Stop();
+    frameProfiler.WriteCsv("frame_profile.csv");
+    frameProfiler.PrintSummary();
+
+    //median GPU time of each configuration's passes next to its median wall time per frame
+    if (!sweepConfigs.empty())
+    {
+        std::ofstream sweep("lighting_sweep.csv");
+        sweep << "lights,path,gpu_ms,frame_ms\n";
+        for (size_t i = 0; i < sweepConfigs.size(); i++)
+        {
+            const SweepConfig& config = sweepConfigs[i];
+            std::string label = std::string(config.deferred ? " deferred/" : " forward/") + std::to_string(config.lights);
+            double gpu = 0.0;
+            const char* passes[] = { "model", "gbuffer", "lighting" };
+            for (const char* pass : passes)
+            {
+                const RollingStats* stats = frameProfiler.GetGpuStats(pass + label);
+                if (stats)
+                    gpu += stats->Percentile(50.0);
+            }
+            RollingStats frameTimes(framesPerConfig);
+            for (int f = 0; f < framesPerConfig; f++)
+                frameTimes.Add(headlessFrames[i * framesPerConfig + f].milliseconds);
+            const char* path = config.deferred ? "deferred" : "forward";
+            sweep << config.lights << "," << path << "," << gpu << "," << frameTimes.Percentile(50.0) << "\n";
+            std::cout << "LIGHTING::SWEEP " << std::setw(4) << config.lights << " lights " << std::setw(8) << path << " gpu " << std::fixed
+                << std::setprecision(3) << gpu << " ms, frame " << frameTimes.Percentile(50.0) << " ms" << std::defaultfloat << std::endl;
+        }
+    }
+    frameProfiler.Release();
+
+    //every GL object goes while the context is still current. whatever the registry holds
+    //after this was never released
+    auto releaseAll = [&]() {
+        deferred.Destroy();
+        hiz.Destroy();
+        fragmentCounter.Release();
+        frameRing.Destroy();
+        textureStreamer.Destroy();
+        ownedTextures.clear();
+        textureCache.clear();
+        materialTextures.clear();
+        modelVertexArray.Reset();
+        modelVertices.Reset();
+        modelIndices.Reset();
+        tangentBuffer.Reset();
+        lightVertexArray.Reset();
+        lightVertices.Reset();
+        modelMeshMemory.Reset();
+    };
 
+    if (options.headless)
+    {
+        //per-frame times and image hashes, plus one hash over the whole run for quick comparisons
+        std::ofstream report(options.reportPath);
+        report << "frame,milliseconds,hash,frustum_culled,occluded,fragments\n";
+        unsigned long long runHash = 14695981039346656037ull;
+        for (size_t i = 0; i < headlessFrames.size(); i++)
+        {
+            report << i << "," << headlessFrames[i].milliseconds << "," << std::hex << std::setw(16) << std::setfill('0')
+                << headlessFrames[i].hash << std::dec << std::setfill(' ') << "," << headlessFrames[i].frustumCulled << ","
+                << headlessFrames[i].occluded << "," << headlessFrames[i].fragments << "\n";
+            runHash = OffscreenTarget::HashBytes((const unsigned char*)&headlessFrames[i].hash, sizeof(unsigned long long), runHash);
+        }
+        //fragment counts arrive two frames late, the first two frames have none
+        double culled = 0.0, fragments = 0.0;
+        for (size_t i = 0; i < headlessFrames.size(); i++)
+        {
+            culled += (double)(headlessFrames[i].frustumCulled + headlessFrames[i].occluded);
+            if (i >= 2)
+                fragments += (double)headlessFrames[i].fragments;
+        }
+        std::cout << "HEADLESS::CULLING " << clusters.size() << " clusters, " << culled / std::max<size_t>(headlessFrames.size(), 1)
+            << " culled per frame, " << fragments / (double)(std::max<size_t>(headlessFrames.size(), 3) - 2) << " fragments shaded per frame" << std::endl;
+        std::cout << "HEADLESS::RING " << (frameRing.Persistent() ? "persistent" : "buffer updates") << ", " << frameRing.Stalls << " stalls, "
+            << frameRing.StallMilliseconds << " ms waited, " << frameRing.Bytes / std::max<size_t>(headlessFrames.size(), 1) << " bytes per frame" << std::endl;
+        std::cout << "HEADLESS::SIMULATION " << simulation.Ticks << " ticks, render waited " << simulation.Waits << " times, "
+            << simulation.WaitMilliseconds << " ms" << std::endl;
+        jobs.PrintStats("HEADLESS");
+        if (options.pick)
+            std::cout << "HEADLESS::PICK " << pickHits << " of " << pickCount << " rays hit, " << pickMicroseconds / std::max<size_t>(pickCount, 1)
+                << " us per ray, " << objBvh.NodeCount() << " BVH nodes" << std::endl;
+        if (textureStreamer.Active())
+            textureStreamer.PrintStats();
+        memory.PrintStats("HEADLESS");
+        std::cout << "HEADLESS::FRAMES " << headlessFrames.size() << " RUN_HASH " << std::hex << std::setw(16) << std::setfill('0')
+            << runHash << std::dec << std::setfill(' ') << std::endl;
+        releaseAll();
+        offscreen.Destroy();
+        memory.ReportLeaks();
+        headlessContext.Destroy();
+        return 0;
+    }
+
+    releaseAll();
+    memory.ReportLeaks();
     glfwTerminate();
     return 0;
 
@@ -504,21 +1259,49 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+//render toggles are handled here, movement keys and mouse go to the simulation
+SimulationInput processInput(GLFWwindow* window)
 {
 
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyBoard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyBoard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyBoard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyBoard(RIGHT, deltaTime);
-
+    SimulationInput input;
+    const int keys[SIM_KEY_COUNT] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_UP, GLFW_KEY_DOWN,
+        GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_O, GLFW_KEY_L, GLFW_KEY_SPACE };
+    for (int i = 0; i < SIM_KEY_COUNT; i++)
+        input.keys[i] = glfwGetKey(window, keys[i]) == GLFW_PRESS;
+    input.mouseOffset = mouseOffset;
+    input.scrollOffset = scrollOffset;
+    mouseOffset = glm::vec2(0.0f);
+    scrollOffset = 0.0f;
+
+    bool flashlightKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (flashlightKey && !flashlightKeyDown)
+        flashlight = !flashlight;
+    flashlightKeyDown = flashlightKey;
+
+    bool deferredKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (deferredKey && !deferredKeyDown)
+        deferredShading = !deferredShading;
+    deferredKeyDown = deferredKey;
+
+    bool depthPrepassKey = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+    if (depthPrepassKey && !depthPrepassKeyDown)
+        depthPrepass = !depthPrepass;
+    depthPrepassKeyDown = depthPrepassKey;
+
+    bool hizCullingKey = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    if (hizCullingKey && !hizCullingKeyDown)
+        hizCulling = !hizCulling;
+    hizCullingKeyDown = hizCullingKey;
+
+    bool pickKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (pickKey && !pickKeyDown)
+        pickRequested = true;
+    pickKeyDown = pickKey;
+
+    return input;
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -539,24 +1322,29 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    mouseOffset += glm::vec2(xoffset, yoffset);
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    scrollOffset += static_cast<float>(yoffset);
 }
 
-unsigned int loadTexture(char const* path)
+GlTexture loadTexture(char const* path, const std::string& owner)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    PROFILE_ZONE("texture.load", "texture");
+    GlTexture texture = GlTexture::Create();
+    unsigned int textureID = texture.Id();
     
 
     int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+    unsigned char* data;
+    {
+        PROFILE_ZONE("stbi_load", "texture");
+        data = stbi_load(path, &width, &height, &nrComponents, 0);
+    }
     
     if (data) {
         GLenum format = GL_RED;
@@ -566,9 +1354,18 @@ unsigned int loadTexture(char const* path)
             format = GL_RGB;
         else if (nrComponents == 4)
             format = GL_RGBA;
+        PROFILE_COUNTER("texture.count", 1);
+        PROFILE_COUNTER("texture.bytes", (size_t)width * height * nrComponents);
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        {
+            PROFILE_ZONE("glTexImage2D", "gpu");
+            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        }
+        {
+            PROFILE_ZONE("glGenerateMipmap", "gpu");
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        texture.Track(MEMORY_TEXTURES, owner, TextureBytes(width, height, nrComponents, true));
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -581,5 +1378,24 @@ unsigned int loadTexture(char const* path)
         std::cout << "Failed to load texture" << std::endl;
     }
     stbi_image_free(data);
-    return textureID;
+    return texture;
+}
+
+//1x1 texture of a material color, used for MTL entries that have no texture map
+GlTexture loadColorTexture(glm::vec3 color, const std::string& owner)
+{
+    unsigned char texel[4] = {
+        (unsigned char)(glm::clamp(color.x, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(color.y, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(color.z, 0.0f, 1.0f) * 255.0f + 0.5f),
+        255
+    };
+    GlTexture texture = GlTexture::Create();
+    glBindTexture(GL_TEXTURE_2D, texture.Id());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    texture.Track(MEMORY_TEXTURES, owner, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    PROFILE_COUNTER("texture.count", 1);
+    return texture;
 }
\ No newline at end of file
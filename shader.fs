@@ -1,10 +1,30 @@
 #version 330 core
 out vec4 FragColor;
 
+//permutation switches, Shader injects these after #version. the defaults match
+//the full lighting setup so the file still works when loaded without any
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 4
+#endif
+#ifndef HAS_DIR_LIGHT
+#define HAS_DIR_LIGHT 1
+#endif
+#ifndef HAS_SPOT_LIGHT
+#define HAS_SPOT_LIGHT 1
+#endif
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+
 struct Material {
     sampler2D diffuse;
     sampler2D specular;    
     sampler2D emission;
+    sampler2D normal;
+    vec3 specularColor;
     float shininess;
 }; 
 
@@ -16,15 +36,14 @@ struct DirLight {
     vec3 specular;
 };
 
+//std140 layout, each vec3 shares its 16 bytes with the float after it (PointLightBlock in Lights.h)
 struct PointLight{
     vec3 position;
-
-    float quadratic;
-    float linear;
     float constant;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
@@ -51,23 +70,62 @@ uniform Material material;
 
 uniform DirLight dirLight;
 
-#define NR_POINT_LIGHTS 4 
-uniform PointLight potLight[NR_POINT_LIGHTS];
+#if NR_POINT_LIGHTS > 0
+layout (std140) uniform PointLights {
+    PointLight potLight[NR_POINT_LIGHTS];
+};
+#endif
 
 uniform SpotLight spotLight;
 
 uniform vec3 viewPos;
 
 
-//direct light function
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);  
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+//direct light function, albedo and specColor are sampled once per fragment in main
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specColor);  
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specColor);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specColor);
+
+#if HAS_NORMAL_MAP
+in vec4 Tangent;
+
+//the tangent frame comes from the vertex tangents, or from screen-space derivatives for meshes without them
+vec3 PerturbNormal(vec3 normal)
+{
+    vec3 mapped = texture(material.normal, TexCoords).xyz * 2.0 - 1.0;
+    //generated tangents, w is the bitangent sign. without a tangent buffer the attribute reads (0, 0, 0, 1)
+    if (dot(Tangent.xyz, Tangent.xyz) > 1e-12)
+    {
+        vec3 T = normalize(Tangent.xyz - normal * dot(normal, Tangent.xyz));
+        vec3 B = Tangent.w * cross(normal, T);
+        return normalize(mat3(T, B, normal) * mapped);
+    }
+    vec3 dp1 = dFdx(FragPos);
+    vec3 dp2 = dFdy(FragPos);
+    vec2 duv1 = dFdx(TexCoords);
+    vec2 duv2 = dFdy(TexCoords);
+    vec3 dp2perp = cross(dp2, normal);
+    vec3 dp1perp = cross(normal, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+    return normalize(mat3(T * invmax, B * invmax, normal) * mapped);
+}
+#endif
 
 void main()
 {
     vec3 norm = normalize(Normal);
+#if HAS_NORMAL_MAP
+    norm = PerturbNormal(norm);
+#endif
     vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 albedo = vec3(texture(material.diffuse, TexCoords));
+#if HAS_SPECULAR_MAP
+    vec3 specColor = vec3(texture(material.specular, TexCoords));
+#else
+    vec3 specColor = material.specularColor;
+#endif
     // ambient
     //vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
   	
@@ -88,29 +146,36 @@ void main()
     //vec3 show = step(vec3(1.0), vec3(1.0) - texture(material.specular, TexCoords).rgb);
     //vec3 emission = texture(material.emission, TexCoords).rgb * show;   
 
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+    vec3 result = vec3(0.0);
+#if HAS_DIR_LIGHT
+    result += CalcDirLight(dirLight, norm, viewDir, albedo, specColor);
+#endif
+#if NR_POINT_LIGHTS > 0
     for (int i = 0; i < NR_POINT_LIGHTS; i++)
     {
-        result += CalcPointLight(potLight[i], norm, FragPos, viewDir);
+        result += CalcPointLight(potLight[i], norm, FragPos, viewDir, albedo, specColor);
     }
-    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
+#if HAS_SPOT_LIGHT
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir, albedo, specColor);
+#endif
     FragColor = vec4(result, 1.0);
 } 
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specColor)
 {
     vec3 lightDir = normalize(-light.direction);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specColor;
     return ambient + diffuse + specular;
 }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specColor)
 {
     vec3 lightDir = normalize(light.position - FragPos);
     float diff = max(dot(normal, lightDir), 0.0);
@@ -120,15 +185,15 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float distance = length(light.position - fragPos);
     float attenuation = 1.0/(light.constant + light.linear * distance + light.quadratic * distance * distance);
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specColor;
 
     return attenuation * (ambient + diffuse + specular);
 
 }
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specColor) {
     vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 reflectDir = reflect(-lightDir, normal);
@@ -138,9 +203,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff)/epsilon, 0.0, 1.0);
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specColor;
     float distance = length(light.position - fragPos);
     float attenuation = 1.0/(light.constant + light.linear * distance + light.quadratic * distance * distance);
 
@@ -3,13 +3,29 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#if HAS_NORMAL_MAP
+//xyz tangent, w bitangent sign, see GenerateTangents
+layout (location = 3) in vec4 aTangent;
+out vec4 Tangent;
+#endif
+
+//filled once per frame from the ring buffer, shared by every program built on this file
+layout (std140) uniform Transforms {
+    mat4 projection;
+    mat4 view;
+    mat4 model;
+};
+
+//the depth pre-pass reuses this shader, both passes must land on the same depth
+invariant gl_Position;
 
 void main()
 {
@@ -17,4 +33,7 @@ void main()
 	FragPos = vec3(model * vec4(aPos, 1.0));
 	Normal = mat3(transpose(inverse(model))) * aNormal;
 	TexCoords = aTexCoords;
+#if HAS_NORMAL_MAP
+	Tangent = vec4(mat3(model) * aTangent.xyz, aTangent.w);
+#endif
 }
\ No newline at end of file
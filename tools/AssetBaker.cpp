@@ -0,0 +1,388 @@
+//Offline baker: turns a directory tree of OBJ models into .objz mesh containers the viewer
+//loads with --model, so a launch skips parsing, welding and normal generation.
+//
+//Every .obj under the input directory is imported with LoadObjFile (vertices welded,
+//duplicate materials merged, missing normals and tangents generated), its triangles are
+//reordered for the post-transform vertex cache within each material range, and its
+//vertices renumbered in first-use order, which also keeps index and vertex deltas small for
+//the codec. The container holds the quantized streams, bounds and the size and time of the
+//OBJ and MTL files it came from. The texture maps its materials name are copied next to it
+//unchanged, the viewer still decodes them at load. Files are baked in parallel on the job
+//system, and outputs whose sources did not change since they were written are skipped.
+//
+//  AssetBaker <input directory> <output directory> [--force] [--keep-order]
+//
+//--force bakes every file again. --keep-order skips the reordering: grid-like meshes that
+//are exported in scanline order compress better that way (a 1M triangle UV sphere takes
+//3.6 MB instead of 5.6 MB) at the cost of more vertex shader runs. Prints one report line
+//per file, with the average cache misses per triangle before and after, and a total.
+
+#include "../JobSystem.h"
+#include "../MeshCodec.h"
+#include "../ObjLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+//entries of the FIFO cache the reordering aims at and the report measures
+const int VERTEX_CACHE_SIZE = 16;
+
+enum BakeStatus { BAKED, UP_TO_DATE, FAILED };
+
+struct BakeResult {
+	std::string path;
+	BakeStatus status = FAILED;
+	size_t inputBytes = 0;
+	size_t outputBytes = 0;
+	size_t triangles = 0;
+	double acmrBefore = 0.0;
+	double acmrAfter = 0.0;
+	double milliseconds = 0.0;
+};
+
+//average cache misses per triangle, 0.5 is the best a regular grid can do, 3 the worst
+double averageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	if (indices.empty())
+		return 0.0;
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t misses = 0;
+	for (unsigned int index : indices)
+	{
+		//a vertex is cached while fewer than VERTEX_CACHE_SIZE misses followed its own
+		if (insertedAt[index] == 0 || misses - insertedAt[index] >= VERTEX_CACHE_SIZE)
+			insertedAt[index] = ++misses;
+	}
+	return (double)misses / (double)(indices.size() / 3);
+}
+
+//Tipsify (Sander, Nehab and Barczak 2007) over one material range: fans out from a vertex
+//until its triangles are used up, then moves on to the vertex of the last fan that will
+//still be in the cache, or back through the dead-end stack. indices is rewritten in place
+void tipsify(unsigned int* indices, size_t indexCount, std::vector<int>& local, std::vector<unsigned int>& touched)
+{
+	size_t triangleCount = indexCount / 3;
+	//global vertex ids to dense ids of this range
+	touched.clear();
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		if (local[indices[i]] < 0)
+		{
+			local[indices[i]] = (int)touched.size();
+			touched.push_back(indices[i]);
+		}
+	}
+	size_t count = touched.size();
+	std::vector<unsigned int> corners(indexCount);
+	for (size_t i = 0; i < indexCount; i++)
+		corners[i] = (unsigned int)local[indices[i]];
+	for (unsigned int vertex : touched)
+		local[vertex] = -1;
+
+	//triangles around each vertex
+	std::vector<unsigned int> offsets(count + 1, 0);
+	for (unsigned int corner : corners)
+		offsets[corner + 1]++;
+	for (size_t v = 0; v < count; v++)
+		offsets[v + 1] += offsets[v];
+	std::vector<unsigned int> adjacency(indexCount);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indexCount; i++)
+		adjacency[fill[corners[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<unsigned int> live(count);
+	for (size_t v = 0; v < count; v++)
+		live[v] = offsets[v + 1] - offsets[v];
+	std::vector<size_t> stamp(count, 0);
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(indexCount);
+	size_t time = VERTEX_CACHE_SIZE + 1;
+	size_t cursor = 0;
+	long long fan = count > 0 ? 0 : -1;
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++)
+		{
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = 1;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = corners[triangle * 3 + k];
+				output.push_back(touched[v]);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamp[v] > VERTEX_CACHE_SIZE)
+					stamp[v] = time++;
+			}
+		}
+
+		//the candidate still in the cache after its remaining triangles went through it,
+		//and among those the one that entered the cache first
+		fan = -1;
+		long long best = -1;
+		for (unsigned int v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			long long priority = 0;
+			if ((long long)(time - stamp[v]) + 2 * (long long)live[v] <= VERTEX_CACHE_SIZE)
+				priority = (long long)(time - stamp[v]);
+			if (priority > best)
+			{
+				best = priority;
+				fan = v;
+			}
+		}
+		while (fan < 0 && !deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0)
+				fan = v;
+		}
+		while (fan < 0 && cursor < count)
+		{
+			if (live[cursor] > 0)
+				fan = (long long)cursor;
+			cursor++;
+		}
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+//reorders triangles per range, then renumbers vertices in the order the indices first use
+//them. ranges keep their offsets and counts
+void optimizeMesh(ObjMesh& mesh)
+{
+	std::vector<int> local(mesh.vertices.size(), -1);
+	std::vector<unsigned int> touched;
+	for (const ObjMaterialRange& range : mesh.ranges)
+		tipsify(&mesh.indices[range.indexOffset], range.indexCount, local, touched);
+
+	std::vector<unsigned int> remap(mesh.vertices.size(), ~0u);
+	std::vector<ObjVertex> vertices;
+	std::vector<glm::vec4> tangents;
+	vertices.reserve(mesh.vertices.size());
+	bool hasTangents = mesh.tangents.size() == mesh.vertices.size();
+	for (unsigned int& index : mesh.indices)
+	{
+		if (remap[index] == ~0u)
+		{
+			remap[index] = (unsigned int)vertices.size();
+			vertices.push_back(mesh.vertices[index]);
+			if (hasTangents)
+				tangents.push_back(mesh.tangents[index]);
+		}
+		index = remap[index];
+	}
+	//vertices no triangle uses are dropped
+	mesh.vertices.swap(vertices);
+	if (hasTangents)
+		mesh.tangents.swap(tangents);
+}
+
+size_t fileSize(const std::filesystem::path& path)
+{
+	std::error_code error;
+	uintmax_t size = std::filesystem::file_size(path, error);
+	return error ? 0 : (size_t)size;
+}
+
+//true when the container at outputPath was baked from objPath as it is now
+bool upToDate(const std::string& objPath, const std::filesystem::path& outputPath)
+{
+	std::ifstream file(outputPath, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+	std::vector<unsigned char> bytes((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)bytes.data(), bytes.size());
+	MeshContainerInfo info;
+	return ReadMeshInfo(bytes.data(), bytes.size(), info) && !info.sources.empty() && info.sources[0].path == objPath
+		&& SourcesCurrent(info.sources);
+}
+
+//copies the texture maps of mesh from next to the OBJ to next to the container, once each
+void copyTextures(const ObjMesh& mesh, const std::filesystem::path& sourceDirectory, const std::filesystem::path& outputDirectory,
+	std::set<std::string>& copied, std::mutex& copiedMutex)
+{
+	for (const ObjMaterial& material : mesh.materials)
+	{
+		for (const std::string* map : { &material.DiffuseMap, &material.SpecularMap, &material.NormalMap })
+		{
+			if (map->empty())
+				continue;
+			std::filesystem::path target = outputDirectory / *map;
+			{
+				std::lock_guard<std::mutex> lock(copiedMutex);
+				if (!copied.insert(target.string()).second)
+					continue;
+			}
+			std::error_code error;
+			std::filesystem::create_directories(target.parent_path(), error);
+			std::filesystem::copy_file(sourceDirectory / *map, target, std::filesystem::copy_options::update_existing, error);
+			if (error)
+				std::cout << "ERROR::BAKER::UNABLE_TO_COPY_TEXTURE: " << (sourceDirectory / *map).string() << std::endl;
+		}
+	}
+}
+
+BakeResult bakeFile(const std::string& objPath, const std::filesystem::path& outputPath, bool force, bool reorder,
+	std::set<std::string>& copied, std::mutex& copiedMutex)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BakeResult result;
+	result.path = objPath;
+	if (!force && upToDate(objPath, outputPath))
+	{
+		result.status = UP_TO_DATE;
+		result.outputBytes = fileSize(outputPath);
+		return result;
+	}
+
+	ObjMesh mesh;
+	if (!LoadObjFile(objPath, mesh))
+		return result;
+	std::vector<MeshSource> sources = ObjSources(objPath, mesh);
+	for (const MeshSource& source : sources)
+		result.inputBytes += source.size > 0 ? (size_t)source.size : 0;
+	result.triangles = mesh.indices.size() / 3;
+	result.acmrBefore = averageCacheMissRatio(mesh.indices, mesh.vertices.size());
+	if (reorder)
+		optimizeMesh(mesh);
+	result.acmrAfter = averageCacheMissRatio(mesh.indices, mesh.vertices.size());
+
+	std::error_code error;
+	std::filesystem::create_directories(outputPath.parent_path(), error);
+	if (!SaveMeshFile(outputPath.string(), mesh, sources))
+		return result;
+	copyTextures(mesh, std::filesystem::path(objPath).parent_path(), outputPath.parent_path(), copied, copiedMutex);
+	result.outputBytes = fileSize(outputPath);
+	result.status = BAKED;
+	result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+void printReport(const std::vector<BakeResult>& results, double wallMilliseconds)
+{
+	const char* statusNames[] = { "baked", "up to date", "failed" };
+	std::cout << std::left << std::setw(40) << "file" << std::right << std::setw(12) << "status" << std::setw(12) << "input"
+		<< std::setw(12) << "output" << std::setw(8) << "ratio" << std::setw(11) << "triangles" << std::setw(14) << "acmr"
+		<< std::setw(10) << "ms" << std::setw(10) << "MB/s" << std::endl;
+	size_t baked = 0, skipped = 0, failed = 0, inputBytes = 0, outputBytes = 0;
+	double bakeMilliseconds = 0.0;
+	for (const BakeResult& result : results)
+	{
+		std::cout << std::left << std::setw(40) << result.path << std::right << std::setw(12) << statusNames[result.status];
+		if (result.status == BAKED)
+		{
+			std::ostringstream acmr;
+			acmr << std::fixed << std::setprecision(2) << result.acmrBefore << "->" << result.acmrAfter;
+			std::cout << std::setw(12) << result.inputBytes << std::setw(12) << result.outputBytes << std::fixed << std::setprecision(1)
+				<< std::setw(7) << (double)result.inputBytes / std::max<size_t>(1, result.outputBytes) << "x" << std::setw(11)
+				<< result.triangles << std::setw(14) << acmr.str() << std::setw(10) << result.milliseconds << std::setw(10)
+				<< result.inputBytes / 1e3 / std::max(1e-3, result.milliseconds) << std::defaultfloat;
+			baked++;
+			inputBytes += result.inputBytes;
+			outputBytes += result.outputBytes;
+			bakeMilliseconds += result.milliseconds;
+		}
+		else if (result.status == UP_TO_DATE)
+		{
+			std::cout << std::setw(12) << "" << std::setw(12) << result.outputBytes;
+			skipped++;
+		}
+		else
+			failed++;
+		std::cout << std::endl;
+	}
+	//the sum of per-file times exceeds the wall time when files overlap on several cores
+	std::cout << std::fixed << std::setprecision(1) << "BAKER::TOTAL " << baked << " baked, " << skipped << " up to date, " << failed << " failed, " << inputBytes << " -> "
+		<< outputBytes << " bytes, " << bakeMilliseconds << " ms of work in " << wallMilliseconds << " ms on "
+		<< JobSystem::Get().ThreadCount() << " threads, " << inputBytes / 1e3 / std::max(1e-3, wallMilliseconds) << " MB/s" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> positional;
+	bool force = false;
+	bool reorder = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--force") == 0)
+			force = true;
+		else if (std::strcmp(argv[i], "--keep-order") == 0)
+			reorder = false;
+		else
+			positional.push_back(argv[i]);
+	}
+	if (positional.size() != 2)
+	{
+		std::cout << "usage: AssetBaker <input directory> <output directory> [--force] [--keep-order]" << std::endl;
+		return 1;
+	}
+	std::filesystem::path inputDirectory = positional[0];
+	std::filesystem::path outputDirectory = positional[1];
+
+	std::vector<std::string> objPaths;
+	std::error_code error;
+	for (std::filesystem::recursive_directory_iterator itr(inputDirectory, error), end; !error && itr != end; itr.increment(error))
+	{
+		if (itr->is_regular_file() && itr->path().extension() == ".obj")
+			objPaths.push_back(itr->path().string());
+	}
+	if (error)
+	{
+		std::cout << "ERROR::BAKER::UNABLE_TO_READ_DIRECTORY: " << inputDirectory.string() << std::endl;
+		return 1;
+	}
+	std::sort(objPaths.begin(), objPaths.end());
+
+	//one job per file, each of which spreads its own import and encode over the workers
+	JobSystem& jobs = JobSystem::Get();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<BakeResult> results(objPaths.size());
+	std::set<std::string> copied;
+	std::mutex copiedMutex;
+	std::vector<JobHandle> bakes;
+	for (size_t i = 0; i < objPaths.size(); i++)
+	{
+		std::filesystem::path outputPath = outputDirectory / std::filesystem::path(objPaths[i]).lexically_relative(inputDirectory);
+		outputPath.replace_extension(".objz");
+		bakes.push_back(jobs.Schedule([&, i, outputPath]() {
+			results[i] = bakeFile(objPaths[i], outputPath, force, reorder, copied, copiedMutex);
+		}));
+	}
+	for (const JobHandle& bake : bakes)
+		jobs.Wait(bake);
+	double wallMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printReport(results, wallMilliseconds);
+	for (const BakeResult& result : results)
+	{
+		if (result.status == FAILED)
+			return 1;
+	}
+	return 0;
+}